@@ -0,0 +1,37 @@
+// the checks and the main() of the host tests.
+// A test runs its checks, "test bench" runs its benchmark instead.
+#ifndef hosttest_h
+#define hosttest_h
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+
+static int failures;
+
+// counts the failure and leaves the check
+#define CHECK(c,...) do{ if(!(c)){ failures++; fprintf(stderr,"%s:%d: ",__FILE__,__LINE__); \
+	fprintf(stderr,__VA_ARGS__); fputc('\n',stderr); return; } }while(0)
+
+inline bool benchArgument(int argc,char* argv[])
+{
+	return argc > 1 && strcmp(argv[1],"bench") ==0;
+}
+
+// the exit code
+inline int testResult(void)
+{
+	if(failures){
+		fprintf(stderr,"FAILED\n");
+		return 1;
+	}
+	printf("OK\n");
+	return 0;
+}
+
+inline double seconds(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+#endif
@@ -0,0 +1,118 @@
+// fuzz target of the j{...} parser.
+//
+// With libFuzzer (clang): make json_fuzz_libfuzzer, then
+//  json_fuzz_libfuzzer [corpus dir]
+// Without it, json_fuzz runs the target on generated input:
+//  json_fuzz [runs]
+//  json_fuzz file...
+// Both are built with the address and undefined behaviour sanitizers.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "JsonParser.h"
+
+struct FuzzSpan {
+	const char *begin;
+	const char *end;
+};
+
+static void checkPair(const char* key,const char* val,void* data)
+{
+	FuzzSpan& span=*(FuzzSpan*)data;
+	// decoded in place, nul-terminated inside the buffer, never empty
+	if(key < span.begin || key + strlen(key) > span.end || !*key) abort();
+	if(val < span.begin || val + strlen(val) > span.end || !*val) abort();
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data,size_t size)
+{
+	// the parser may write the nul after the span
+	char *buf=(char*)malloc(size + 1);
+	memcpy(buf,data,size);
+	buf[size]='\0';
+	FuzzSpan span={buf,buf + size};
+	JsonSpan s={buf,buf + size};
+	uint8_t result=parseJsonObject(s,checkPair,&span);
+	if(result > JsonUnexpectedEnd) abort();
+	if(s.p < buf || s.p > buf + size) abort();
+	// the '}' may have been overwritten by the nul
+	if(result == JsonOk && (s.p == buf || data[s.p - buf - 1] != '}')) abort();
+	free(buf);
+	return 0;
+}
+
+#ifndef JSON_FUZZ_LIBFUZZER
+
+#define DefaultRuns 2000000
+#define MaxInput 96
+
+static uint32_t seed=2463534242u;
+static uint32_t rnd(uint32_t n)
+{
+	seed ^= seed << 13;
+	seed ^= seed >> 17;
+	seed ^= seed << 5;
+	return seed % n;
+}
+
+// lines the web pages and BrewPi script send, to start from
+static const char *corpus[]={
+	"{\"mode\":\"b\",\"beerSet\":\"20.5\"}",
+	"{mode:f,fridgeSet:18.0}",
+	"{\"tempFormat\":\"F\",\"Kp\":\"5.000\",\"Ki\":\"0.250\",\"Kd\":\"-1.500\"}",
+	"{i:0,c:1,b:0,f:0,h:1,p:12,x:0,d:0,a:\"28FF1B8A65150164\",n:\"beer \\\"1\\\"\"}",
+	"{}",
+};
+
+static size_t generate(uint8_t* buf)
+{
+	static const char tokens[]="{}:,\"\\ \tab1.-\r";
+	size_t len=0;
+	if(rnd(2)){
+		// a mutated corpus line
+		const char *line=corpus[rnd(sizeof(corpus) / sizeof(corpus[0]))];
+		len=strlen(line);
+		memcpy(buf,line,len);
+		for(uint32_t n=rnd(4);n;n--){
+			if(len ==0) break;
+			size_t at=rnd(len);
+			switch(rnd(3)){
+			case 0: buf[at]=tokens[rnd(sizeof(tokens) - 1)]; break;
+			case 1: memmove(buf + at,buf + at + 1,len - at - 1); len--; break;
+			default: if(len < MaxInput){ memmove(buf + at + 1,buf + at,len - at); buf[at]=rnd(256); len++; } break;
+			}
+		}
+	}else{
+		len=rnd(MaxInput);
+		for(size_t i=0;i<len;i++) buf[i]= rnd(8)? tokens[rnd(sizeof(tokens) - 1)]:rnd(256);
+		if(len && rnd(2)) buf[0]='{';
+	}
+	return len;
+}
+
+int main(int argc,char* argv[])
+{
+	if(argc > 1 && (argv[1][0] < '0' || argv[1][0] > '9')){
+		for(int i=1;i<argc;i++){
+			FILE *f=fopen(argv[i],"rb");
+			if(!f){
+				perror(argv[i]);
+				return 1;
+			}
+			static uint8_t data[65536];
+			size_t size=fread(data,1,sizeof(data),f);
+			fclose(f);
+			LLVMFuzzerTestOneInput(data,size);
+		}
+		return 0;
+	}
+	long runs= (argc > 1)? atol(argv[1]):DefaultRuns;
+	uint8_t buf[MaxInput];
+	for(long i=0;i<runs;i++)
+		LLVMFuzzerTestOneInput(buf,generate(buf));
+	printf("%ld runs OK\n",runs);
+	return 0;
+}
+
+#endif
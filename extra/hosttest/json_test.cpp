@@ -0,0 +1,180 @@
+// the j{...} parser on valid and broken input, and the key index against a
+// linear search of the table. The bench times both lookups.
+#include <stdlib.h>
+#include <string>
+#include "hosttest.h"
+#include "JsonParser.h"
+
+#define BenchRounds 1000000
+
+// the same as PiLink::keyHash()
+static constexpr uint32_t keyHash(const char* key,uint32_t hash=2166136261u){
+	return (*key)? keyHash(key+1,(hash ^ (uint8_t)*key) * 16777619u):hash;
+}
+
+static void collect(const char* key,const char* val,void* data)
+{
+	std::string& pairs=*(std::string*)data;
+	pairs += key;
+	pairs += '=';
+	pairs += val;
+	pairs += ';';
+}
+
+static uint8_t parse(const char* text,std::string& pairs,std::string& rest)
+{
+	// the parser writes in place, and may write the nul after the span
+	size_t len=strlen(text);
+	char *buf=(char*)malloc(len + 1);
+	memcpy(buf,text,len + 1);
+	JsonSpan s={buf,buf + len};
+	pairs.clear();
+	uint8_t result=parseJsonObject(s,collect,&pairs);
+	rest.assign(s.p,buf + len - s.p);
+	free(buf);
+	return result;
+}
+
+static void parserCases(void)
+{
+	static const struct {
+		const char *text;
+		uint8_t result;
+		const char *pairs;
+		const char *rest;
+	} cases[]={
+		{"{mode:b,beerSet:20.5}",JsonOk,"mode=b;beerSet=20.5;",""},
+		{" { \"mode\" : \"b\" , \"beerSet\":\"20.5\" } j{}",JsonOk,"mode=b;beerSet=20.5;"," j{}"},
+		{"{}",JsonOk,"",""},
+		{"{a:1,}",JsonOk,"a=1;",""},
+		{"{a:}",JsonOk,"",""},
+		{"{\"a\\\"b\":\"x,y:}\"}",JsonOk,"a\"b=x,y:};",""},
+		{"{a b : c d}",JsonOk,"a b=c d;",""},
+		{"{\"name\":\"Beer \\\\ 1\"}",JsonOk,"name=Beer \\ 1;",""},
+		{"",JsonExpectedBracket,"",""},
+		{"mode:b}",JsonExpectedBracket,"","mode:b}"},
+		{"{a:1",JsonUnexpectedEnd,"",""},
+		{"{a:1,b",JsonUnexpectedEnd,"a=1;",""},
+		{"{a 1}",JsonExpectedColon,"",""},
+		{"{a:1:2}",JsonExpectedComma,"","2}"},
+		{"{\"a:1}",JsonUnterminatedString,"",""},
+		{"{a:\"1}",JsonUnterminatedString,"",""},
+		{"{a:\"1\\",JsonUnterminatedString,"",""},
+	};
+	for(auto& c:cases){
+		std::string pairs,rest;
+		uint8_t result=parse(c.text,pairs,rest);
+		CHECK(result == c.result,"%s: result %u, expected %u",c.text,result,c.result);
+		CHECK(pairs == c.pairs,"%s: pairs \"%s\", expected \"%s\"",c.text,pairs.c_str(),c.pairs);
+		CHECK(rest == c.rest,"%s: rest \"%s\", expected \"%s\"",c.text,rest.c_str(),c.rest);
+	}
+}
+
+struct Entry {
+	uint32_t hash;
+	const char* key;
+	int value;
+};
+
+#define ENTRY(k,v) { keyHash(k), k, v }
+
+// the keys of PiLink::jsonParserConverters
+static const Entry entries[] PROGMEM = {
+	ENTRY("mode",0),ENTRY("beerSet",1),ENTRY("fridgeSet",2),ENTRY("heatEst",3),ENTRY("coolEst",4),
+	ENTRY("tempFormat",5),ENTRY("tempSetMin",6),ENTRY("tempSetMax",7),ENTRY("pidMax",8),
+	ENTRY("Kp",9),ENTRY("Ki",10),ENTRY("Kd",11),ENTRY("minCoolTime",12),ENTRY("minCoolIdleTime",13),
+	ENTRY("minHeatTime",14),ENTRY("minHeatIdleTime",15),ENTRY("deadTime",16),ENTRY("iMaxErr",17),
+	ENTRY("idleRangeH",18),ENTRY("idleRangeL",19),ENTRY("heatTargetH",20),ENTRY("heatTargetL",21),
+	ENTRY("coolTargetH",22),ENTRY("coolTargetL",23),ENTRY("maxHeatTimeForEst",24),
+	ENTRY("maxCoolTimeForEst",25),ENTRY("lah",26),ENTRY("hs",27),ENTRY("fridgeFastFilt",28),
+	ENTRY("fridgeSlowFilt",29),ENTRY("fridgeSlopeFilt",30),ENTRY("beerFastFilt",31),
+	ENTRY("beerSlowFilt",32),ENTRY("beerSlopeFilt",33),
+};
+#define EntryCount (sizeof(entries) / sizeof(entries[0]))
+
+static void keyIndex(void)
+{
+	CHECK(keyHash("a") == 0xe40c292cu,"FNV-1a of \"a\" is %08x",keyHash("a"));
+	for(size_t i=0;i<EntryCount;i++)
+		for(size_t j=0;j<i;j++)
+			CHECK(entries[i].hash != entries[j].hash,"%s and %s have the same hash",entries[i].key,entries[j].key);
+
+	JsonKeyIndex<Entry,64> index(entries,EntryCount);
+	for(size_t i=0;i<EntryCount;i++){
+		const Entry *e=index.find(keyHash(entries[i].key),entries[i].key);
+		CHECK(e && e->value == (int)i,"%s not found",entries[i].key);
+	}
+	const char *unknown[]={"","mod","modes","Mode","kp","beerSet ","fridgeSlopeFilter"};
+	for(const char *key:unknown)
+		CHECK(index.find(keyHash(key),key) == NULL,"\"%s\" found",key);
+	// a wrong hash finds nothing, even for a key of the table
+	CHECK(index.find(keyHash("Kd"),"Kp") == NULL,"Kp found with the hash of Kd");
+
+	// full but one, so the probes wrap around
+	JsonKeyIndex<Entry,8> small(entries,7);
+	for(size_t i=0;i<7;i++){
+		const Entry *e=small.find(keyHash(entries[i].key),entries[i].key);
+		CHECK(e && e->value == (int)i,"%s not found in the small index",entries[i].key);
+	}
+	CHECK(small.find(keyHash("Kp"),"Kp") == NULL,"Kp found in the small index");
+}
+
+// what processJsonPair() did before the index
+static const Entry* linearFind(uint32_t hash,const char* key)
+{
+	for(size_t i=0;i<EntryCount;i++){
+		if(pgm_read_dword(&entries[i].hash) != hash) continue;
+		if(strcmp_P(key,entries[i].key) ==0) return &entries[i];
+	}
+	return NULL;
+}
+
+static void count(const char*,const char*,void* data)
+{
+	(*(int*)data)++;
+}
+
+static void bench(void)
+{
+	const char *line="{\"beerSet\":\"20.50\",\"mode\":\"b\",\"Kp\":\"5.000\",\"tempFormat\":\"C\",\"beerSlopeFilt\":\"4\"}";
+	size_t len=strlen(line);
+	char buf[128];
+	int pairs=0;
+	auto start=std::chrono::steady_clock::now();
+	for(int i=0;i<BenchRounds;i++){
+		memcpy(buf,line,len + 1);
+		JsonSpan s={buf,buf + len};
+		parseJsonObject(s,count,&pairs);
+	}
+	double t=seconds(start);
+	printf("parseJsonObject: %.0f objects/s, %.1f MB/s\n",BenchRounds / t,BenchRounds * len / t / 1e6);
+
+	JsonKeyIndex<Entry,64> index(entries,EntryCount);
+	int found=0;
+	start=std::chrono::steady_clock::now();
+	for(int i=0;i<BenchRounds;i++){
+		const char *key=entries[i % EntryCount].key;
+		found += linearFind(keyHash(key),key) != NULL;
+	}
+	t=seconds(start);
+	printf("linear scan: %.1f ns/key\n",t / BenchRounds * 1e9);
+	start=std::chrono::steady_clock::now();
+	for(int i=0;i<BenchRounds;i++){
+		const char *key=entries[i % EntryCount].key;
+		found += index.find(keyHash(key),key) != NULL;
+	}
+	t=seconds(start);
+	printf("hash index: %.1f ns/key\n",t / BenchRounds * 1e9);
+	if(found != 2 * BenchRounds || pairs != 5 * BenchRounds) printf("?\n");
+}
+
+int main(int argc,char* argv[])
+{
+	if(benchArgument(argc,argv)){
+		bench();
+		return 0;
+	}
+	parserCases();
+	keyIndex();
+	return testResult();
+}
@@ -0,0 +1,190 @@
+// JsonWriter output, BufferPrint truncation, and the /getstatus reply
+// against the one built by adding the Strings of stubs/Arduino.h, which
+// take the heap like the core's. The bench compares the two replies.
+#include <stdlib.h>
+#include <new>
+#include <string>
+#include "hosttest.h"
+#include "JsonWriter.h"
+#include "TemperatureFormats.h"
+
+#define BenchReplies 2000000
+
+// heap calls of JsonWriter go with those of String
+void* operator new(size_t size)
+{
+	hostHeapCalls()++;
+	void *p=malloc(size);
+	if(!p) throw std::bad_alloc();
+	return p;
+}
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p,size_t) noexcept { free(p); }
+
+struct Status {
+	uint8_t mode,state;
+	float beerSet,beerTemp,fridgeTemp,fridgeSet,roomTemp;
+};
+
+// handleStatus() before JsonWriter
+static void statusString(const Status& s,char *reply)
+{
+	#define TEMPorNull(a) (IS_FLOAT_TEMP_VALID(a)?  String(a):String("null"))
+	String json=String("{\"mode\":\"") + String((char) s.mode)
+	+ String("\",\"state\":") + String(s.state)
+	+ String(",\"beerSet\":") + TEMPorNull(s.beerSet)
+	+ String(",\"beerTemp\":") + TEMPorNull(s.beerTemp)
+	+ String(",\"fridgeSet\":") + TEMPorNull(s.fridgeSet)
+	+ String(",\"fridgeTemp\":") + TEMPorNull(s.fridgeTemp)
+	+ String(",\"roomTemp\":") + TEMPorNull(s.roomTemp)
+	+String("}");
+	#undef TEMPorNull
+	strcpy(reply,json.c_str());
+}
+
+// handleStatus() now
+static void statusWriter(const Status& s,char *reply)
+{
+	#define TEMPorNull(a) (IS_FLOAT_TEMP_VALID(a)? (a):NAN)
+	char buf[160];
+	BufferPrint out(buf,sizeof(buf));
+	JsonWriter json(out);
+	char modeStr[2]={(char)s.mode,'\0'};
+	json.beginObject();
+	json.add("mode",modeStr);
+	json.add("state",(uint32_t)s.state);
+	json.add("beerSet",TEMPorNull(s.beerSet),2);
+	json.add("beerTemp",TEMPorNull(s.beerTemp),2);
+	json.add("fridgeSet",TEMPorNull(s.fridgeSet),2);
+	json.add("fridgeTemp",TEMPorNull(s.fridgeTemp),2);
+	json.add("roomTemp",TEMPorNull(s.roomTemp),2);
+	json.endObject();
+	#undef TEMPorNull
+	strcpy(reply,buf);
+}
+
+static std::string write(void (*fn)(JsonWriter&))
+{
+	char buf[256];
+	BufferPrint out(buf,sizeof(buf));
+	JsonWriter json(out);
+	fn(json);
+	return buf;
+}
+
+static void nesting(void)
+{
+	std::string s=write([](JsonWriter& json){
+		json.beginObject();
+		json.add("a",(int32_t)-12);
+		json.key("b");
+		json.beginArray();
+		json.number((uint32_t)4294967295u);
+		json.beginObject();
+		json.endObject();
+		json.beginArray();
+		json.endArray();
+		json.boolean(true);
+		json.null();
+		json.raw("[1]");
+		json.endArray();
+		json.add("c","x");
+		json.key("d");
+		json.beginObject();
+		json.add("e",(int32_t)-2147483647 - 1);
+		json.endObject();
+		json.endObject();
+	});
+	CHECK(s == "{\"a\":-12,\"b\":[4294967295,{},[],true,null,[1]],\"c\":\"x\",\"d\":{\"e\":-2147483648}}","%s",s.c_str());
+
+	// two values at the top level, as the log list writes
+	s=write([](JsonWriter& json){ json.beginObject(); json.endObject(); json.beginArray(); json.endArray(); });
+	CHECK(s == "{},[]","%s",s.c_str());
+}
+
+static void strings(void)
+{
+	std::string s=write([](JsonWriter& json){ json.string("a\"b\\c\n\x01/\xc3\xa9"); });
+	CHECK(s == "\"a\\\"b\\\\c\\u000a\\u0001/\xc3\xa9\"","%s",s.c_str());
+}
+
+static void numbers(void)
+{
+	const struct { float v; uint8_t decimals; const char *json; } cases[]={
+		{21.5f,2,"21.50"},{-3.456f,2,"-3.46"},{0.004f,2,"0.00"},{-0.004f,2,"0.00"},
+		{99.995f,2,"100.00"},{1.05f,1,"1.1"},{12.6f,0,"13"},{1.0125f,3,"1.013"},
+		{NAN,2,"null"},{INFINITY,2,"null"},{-INFINITY,1,"null"},
+	};
+	for(auto& c:cases){
+		char buf[32];
+		BufferPrint out(buf,sizeof(buf));
+		JsonWriter json(out);
+		json.number(c.v,c.decimals);
+		CHECK(strcmp(buf,c.json) ==0,"%g with %u decimals: %s, not %s",c.v,c.decimals,buf,c.json);
+	}
+}
+
+static void overflow(void)
+{
+	char buf[8];
+	BufferPrint out(buf,sizeof(buf));
+	JsonWriter json(out);
+	json.beginObject();
+	json.add("abc",(uint32_t)12345);
+	json.endObject();
+	CHECK(out.overflow() && out.length() == 7 && strcmp(buf,"{\"abc\":") ==0,"%s, %u",buf,(unsigned)out.length());
+
+	char one[1];
+	BufferPrint empty(one,sizeof(one));
+	empty.print("x");
+	CHECK(empty.overflow() && one[0] =='\0',"a buffer of 1 holds text");
+}
+
+static const Status statuses[]={
+	{'b',4,20.0f,19.94f,18.5f,17.0f,22.31f},
+	{'f',0,18.0f,18.01f,12.25f,-1.5f,INVALID_TEMP_FLOAT},
+	{'o',7,INVALID_TEMP_FLOAT,20.5f,INVALID_TEMP_FLOAT,INVALID_TEMP_FLOAT,-10.75f},
+};
+
+// the same reply as before
+static void status(void)
+{
+	for(auto& s:statuses){
+		char before[256],now[256];
+		statusString(s,before);
+		unsigned long calls=hostHeapCalls();
+		statusWriter(s,now);
+		CHECK(strcmp(before,now) ==0,"%s\n%s",before,now);
+		CHECK(hostHeapCalls() == calls,"%lu heap calls",hostHeapCalls() - calls);
+	}
+}
+
+static void bench(void)
+{
+	char reply[256];
+	const char *names[]={"String","JsonWriter"};
+	void (*fns[])(const Status&,char*)={statusString,statusWriter};
+	for(int f=0;f<2;f++){
+		unsigned long calls=hostHeapCalls();
+		auto start=std::chrono::steady_clock::now();
+		for(int i=0;i<BenchReplies;i++)
+			fns[f](statuses[i % 3],reply);
+		double t=seconds(start);
+		printf("/getstatus, %-10s: %5.0f ns, %4.1f heap calls per reply\n",names[f],t / BenchReplies * 1e9,
+			(double)(hostHeapCalls() - calls) / BenchReplies);
+	}
+}
+
+int main(int argc,char* argv[])
+{
+	if(benchArgument(argc,argv)){
+		bench();
+		return 0;
+	}
+	nesting();
+	strings();
+	numbers();
+	overflow();
+	status();
+	return testResult();
+}
@@ -0,0 +1,215 @@
+// LineRing and LineWriter under producer and consumer calls mixed at
+// random, on rings with each option: every line that is accepted comes out
+// whole and in order, every other one is counted as an overflow.
+#include <stdlib.h>
+#include <stdarg.h>
+#include <deque>
+#include <string>
+#include "hosttest.h"
+#include "VirtualSerial.h"
+
+#define StressRounds 400000
+#define BenchLines 2000000
+
+static uint32_t seed=12345;
+static uint32_t rnd(uint32_t n)
+{
+	seed = seed * 1103515245u + 12345u;
+	return (seed >> 8) % n;
+}
+
+// "<seq>:" and a payload that depends on seq, with a degree sign now and then
+static std::string makeLine(uint32_t seq,size_t len)
+{
+	char head[16];
+	std::string line(head,snprintf(head,sizeof(head),"%u:",seq));
+	for(size_t i=0;i<len;i++)
+		line += ((seq + i) % 29 ==0)? '\xB0':(char)('a' + (seq + i) % 26);
+	return line;
+}
+
+static std::string expected(const std::string& line,uint8_t options)
+{
+	if(!(options & LineRingUtf8Degree)) return line;
+	std::string out;
+	for(char c:line){
+		if(c == '\xB0') out += "\xC2\xB0";
+		else out += c;
+	}
+	return out;
+}
+
+class RingTest
+{
+public:
+	RingTest(uint16_t size,uint8_t options):_ring(size,options),_writer(_ring,24),_options(options),_seq(0),_lines(0){}
+
+	void run(int rounds)
+	{
+		for(int i=0;i<rounds && failures ==0;i++){
+			if(rnd(8) < 5) produce();
+			else consume();
+		}
+		// a held line still counts in available(), so until nothing comes out
+		uint32_t lines;
+		do{
+			lines=_lines;
+			consume();
+		}while(failures ==0 && _lines != lines);
+		CHECK(_queue.empty(),"%u lines lost",(unsigned)_queue.size());
+		printf("size %u options %u: %u lines, %u overflows, high water %u\n",
+			_ring.size(),_options,_lines,_ring.overflows(),_ring.highWater());
+	}
+
+private:
+	LineRing _ring;
+	LineWriter _writer;
+	uint8_t _options;
+	uint32_t _seq;
+	uint32_t _lines;
+	std::deque<std::string> _queue;
+	std::string _partial;
+
+	void produce(void)
+	{
+		std::string line=makeLine(_seq++,rnd(4) ==0? rnd(_ring.size()):rnd(40));
+		uint16_t overflows=_ring.overflows();
+		bool accepted;
+		switch(rnd(4)){
+		case 0:
+			accepted=_ring.writeLine(line.data(),line.size());
+			CHECK(accepted == (_ring.overflows() == overflows),"writeLine returned %d for line %u",accepted,_seq - 1);
+			break;
+		case 1:
+			// in pieces
+			for(size_t pos=0;pos < line.size();){
+				size_t part=1 + rnd(line.size() - pos);
+				_ring.write(line.data() + pos,part);
+				pos += part;
+			}
+			_ring.println();
+			break;
+		case 2:
+			_writer.print(line.c_str());
+			_writer.endLine();
+			break;
+		default:
+			printf_("%s",line.c_str());
+			break;
+		}
+		accepted=(_ring.overflows() == overflows);
+		if(accepted) _queue.push_back(expected(line,_options));
+	}
+
+	void printf_(const char* fmt,...)
+	{
+		va_list args;
+		va_start(args,fmt);
+		_writer.vprintf(fmt,args);
+		va_end(args);
+		_writer.endLine();
+	}
+
+	void consume(void)
+	{
+		std::string line;
+		if(_options & LineRingContiguous){
+			size_t len;
+			char *p=_ring.nextLine(len);
+			if(!p) return;
+			CHECK(strlen(p) == len,"line length %u, nextLine said %u",(unsigned)strlen(p),(unsigned)len);
+			line.assign(p,len);
+		}else{
+			if(_ring.available() ==0) return;
+			int c;
+			while((c=_ring.read()) != '\n'){
+				CHECK(c >= 0,"a line without its end: \"%s\"",line.c_str());
+				line += (char)c;
+			}
+		}
+		CHECK(!_queue.empty(),"unexpected line \"%s\"",line.c_str());
+		CHECK(line == _queue.front(),"got \"%s\", expected \"%s\"",line.c_str(),_queue.front().c_str());
+		_queue.pop_front();
+		_lines++;
+	}
+};
+
+static void stress(void)
+{
+	const uint16_t sizes[]={64,97,256,1024};
+	const uint8_t options[]={0,LineRingUtf8Degree,LineRingContiguous,LineRingContiguous | LineRingUtf8Degree};
+	for(uint16_t size:sizes)
+		for(uint8_t option:options){
+			RingTest test(size,option);
+			test.run(StressRounds);
+		}
+}
+
+// a contiguous ring that can't move the line has to drop it in append()
+static void contiguousDrop(void)
+{
+	LineRing ring(16,LineRingContiguous);
+	size_t len;
+	CHECK(ring.writeLine("0123456789",10),"first line");
+	CHECK(ring.writeLine("ab",2),"second line");
+	CHECK(ring.nextLine(len) != NULL,"first line back");
+	CHECK(ring.nextLine(len) != NULL,"second line back");
+	// tail at 11, head at 14: there is room for 11 bytes and the '\n', but
+	// not before the end, and moved to the start it would reach the tail
+	CHECK(!ring.writeLine("0123456789a",11),"a dropped line reported as written");
+	CHECK(ring.overflows() ==1,"%u overflows",ring.overflows());
+	CHECK(ring.writeLine("abc",3),"the next line");
+	char *line=ring.nextLine(len);
+	CHECK(line && strcmp(line,"abc") ==0,"got \"%s\"",line? line:"");
+}
+
+static void bench(void)
+{
+	const char *line="{\"BeerTemp\":20.12,\"BeerSet\":20.00,\"FridgeTemp\":18.50}";
+	size_t lineLen=strlen(line);
+	size_t len;
+
+	LineRing ring(1024,LineRingContiguous);
+	auto start=std::chrono::steady_clock::now();
+	for(int i=0;i<BenchLines;i++){
+		ring.writeLine(line,lineLen);
+		ring.nextLine(len);
+	}
+	double t=seconds(start);
+	printf("writeLine+nextLine: %.0f lines/s, %.1f MB/s\n",BenchLines / t,BenchLines * (lineLen + 1) / t / 1e6);
+
+	LineRing chars(1024);
+	start=std::chrono::steady_clock::now();
+	for(int i=0;i<BenchLines;i++){
+		for(size_t j=0;j<lineLen;j++) chars.print(line[j]);
+		chars.println();
+		while(chars.read() != '\n');
+	}
+	t=seconds(start);
+	printf("print(char)+read(): %.0f lines/s\n",BenchLines / t);
+
+	LineRing out(1024,LineRingContiguous);
+	LineWriter writer(out,128);
+	start=std::chrono::steady_clock::now();
+	for(int i=0;i<BenchLines;i++){
+		writer.print("{\"BeerTemp\":");
+		writer.write('2');
+		writer.write("0.12,\"BeerSet\":20.00",20);
+		writer.print(",\"FridgeTemp\":18.50}");
+		writer.endLine();
+		out.nextLine(len);
+	}
+	t=seconds(start);
+	printf("LineWriter+nextLine: %.0f lines/s\n",BenchLines / t);
+}
+
+int main(int argc,char* argv[])
+{
+	if(benchArgument(argc,argv)){
+		bench();
+		return 0;
+	}
+	contiguousDrop();
+	stress();
+	return testResult();
+}
@@ -0,0 +1,260 @@
+// a fermentation logged a minute at a time into SPIFFS in a temporary
+// directory, then decoded: every period must come back with the values
+// that were logged. A log with EventTags must decode too. The bench logs
+// 30 days, and compares the size with what format version 5 takes for the
+// same records.
+#include "espconfig.h"
+#include <vector>
+#include <unistd.h>
+#include "hosttest.h"
+#include "BrewPiProxy.h"
+#include "GravityTracker.h"
+#include "BrewLogger.h"
+#include "BrewLogDecoder.h"
+
+#define TestDays 3
+#define BenchDays 30
+#define MinutesPerDay (24 * 60)
+// beer set, beer, fridge, fridge set, room, aux and gravity
+#define Channels 7
+
+FS SPIFFS;
+FileCacheClass FileCache;
+void FileCacheClass::invalidate(const char* path){}
+GravityTracker gravityTracker;
+BrewLogger brewLogger;
+
+static time_t now=1500000000;
+time_t TimeKeeperClass::getTimeSeconds(void){ return now; }
+TimeKeeperClass TimeKeeper;
+
+// what the controller reports: beerSet, beerTemp, fridgeTemp, fridgeSet, room
+static float temps[5];
+static uint8_t mode='b';
+static uint8_t state=0;
+BrewPiProxy brewPi;
+void BrewPiProxy::getLogInfo(char *pUnit,uint8_t *pMode,uint8_t *pState)
+{
+	*pUnit='C';
+	*pMode=mode;
+	*pState=state;
+}
+void BrewPiProxy::getAllStatus(uint8_t *pState,uint8_t *pMode,float *pBeerTemp,float *pBeerSet,float *pFridgeTemp,
+	float *pFridgeSet,float *pRoomTemp)
+{
+	*pState=state;
+	*pMode=mode;
+	*pBeerSet=temps[OrderBeerSet];
+	*pBeerTemp=temps[OrderBeerTemp];
+	*pFridgeTemp=temps[OrderFridgeTemp];
+	*pFridgeSet=temps[OrderFridgeSet];
+	*pRoomTemp=temps[OrderRoomTemp];
+}
+
+static uint32_t seed=7;
+static int rnd(int n)
+{
+	seed = seed * 1103515245u + 12345u;
+	return (seed >> 8) % n;
+}
+
+// a value as BrewLogger::convertTemperature() keeps it
+static float logged(float v)
+{
+	return (int)(v * 100.0) / 100.0;
+}
+
+typedef struct _Period {
+	uint32_t time;
+	float value[Channels];
+	char mode;
+	uint8_t state;
+} Period;
+
+// a slow fermentation: the beer follows the setting, the fridge cycles
+// around it, the room drifts over the day, the gravity drops.
+// The session starts with the first minute, startSession() logs it.
+static bool simulate(int minutes,std::vector<Period>& periods)
+{
+	float beer=18.0,fridge=18.0,gravity=1.050;
+	for(int i=0;i<minutes;i++){
+		if(i % (2 * MinutesPerDay) == 0) temps[OrderBeerSet] = 18 + (i / (2 * MinutesPerDay)) * 0.5;
+		beer += (temps[OrderBeerSet] - beer) * 0.01 + (rnd(7) - 3) * 0.01;
+		fridge += ((i / 20) % 2)? 0.05:-0.05;
+		temps[OrderBeerTemp]=beer;
+		temps[OrderFridgeTemp]=fridge;
+		temps[OrderFridgeSet]=temps[OrderBeerSet] - 1.5;
+		temps[OrderRoomTemp]= 21 + 3 * sin(i * 2 * M_PI / MinutesPerDay);
+		state= ((i / 20) % 2)? 1:0;
+		if(i % 3000 == 2999) mode= (mode == 'b')? 'f':'b';
+		Period p;
+		p.time=now;
+		for(int c=0;c<5;c++) p.value[c]=logged(temps[c]);
+		p.value[OrderExtTemp]=NAN;
+		// only in the period it is given
+		p.value[OrderGravity]=NAN;
+		if(i % 15 == 7){
+			gravity -= 0.00005;
+			brewLogger.addGravity(gravity);
+			p.value[OrderGravity]=GravityDecode(GravityEncode(gravity));
+		}
+		p.mode=mode;
+		p.state=state;
+		periods.push_back(p);
+		if(i ==0){
+			if(!brewLogger.startSession("test")) return false;
+		}else{
+			brewLogger.loop();
+		}
+		hostMillis() += 60000;
+		now += 60;
+	}
+	return true;
+}
+
+// what format version 5 takes for the same period records
+static size_t v5Size(const std::vector<Period>& periods)
+{
+	size_t size=0;
+	for(size_t i=0;i<periods.size();i++){
+		uint8_t changed=0;
+		for(int c=0;c<Channels;c++){
+			const float *last= i? periods[i - 1].value:NULL;
+			float v=periods[i].value[c];
+			bool same= last && (last[c] == v || (isnan(last[c]) && isnan(v)));
+			// aux temp and gravity are in a record only when they are given
+			if(c >= OrderExtTemp) same=isnan(v);
+			if(!same) changed++;
+		}
+		size += 2 + 2 * changed;
+	}
+	return size;
+}
+
+// the samples of the decoder, as periods
+class Collector: public BrewLogListener
+{
+public:
+	std::vector<Period>& periods;
+	Collector(std::vector<Period>& p):periods(p){}
+
+	void onSample(const BrewLogSample& s){
+		Period p;
+		p.time=s.time;
+		memcpy(p.value,s.value,sizeof(p.value));
+		p.mode=s.mode;
+		p.state=s.state;
+		periods.push_back(p);
+	}
+};
+
+// the log read back with the decoder of extra/logdecoder.
+// periodBytes: the size of the period records in the file
+static bool decode(const char* path,std::vector<Period>& periods,size_t& size,size_t& periodBytes)
+{
+	FILE* f=fopen(path,"rb");
+	if(!f) return false;
+	std::vector<uint8_t> log;
+	uint8_t buf[4096];
+	size_t len;
+	while((len=fread(buf,1,sizeof(buf),f)) >0) log.insert(log.end(),buf,buf + len);
+	fclose(f);
+	size=log.size();
+
+	Collector collector(periods);
+	BrewLogDecoder decoder(&collector);
+	bool ok=decoder.feed(log.data(),log.size()) && decoder.finish();
+	if(!ok) fprintf(stderr,"%s\n",decoder.error());
+
+	periodBytes=0;
+	for(size_t pos=0;ok && pos < log.size();pos += len){
+		len=BrewLogDecoder::recordLength(log.data() + pos,log.size() - pos);
+		if(len ==0) break;
+		if(log[pos] == PeriodTag || log[pos] == DeltaPeriodTag) periodBytes += len;
+	}
+	return ok;
+}
+
+static void roundTrip(int days,bool bench)
+{
+	char dir[]="/tmp/bpl_log_XXXXXX";
+	CHECK(mkdtemp(dir),"no temporary directory");
+	std::string root=std::string(dir) + "/";
+	SPIFFS.setRoot(root.c_str());
+
+	// the first period is logged right after the start
+	hostMillis()=60000;
+	brewLogger.begin();
+	std::vector<Period> periods;
+	auto start=std::chrono::steady_clock::now();
+	CHECK(simulate(days * MinutesPerDay,periods),"the session is not started");
+	brewLogger.endSession();
+	double logTime=seconds(start);
+
+	std::vector<Period> decoded;
+	size_t size,periodBytes;
+	start=std::chrono::steady_clock::now();
+	bool ok=decode(SPIFFS.hostPath(LOG_PATH "/test").c_str(),decoded,size,periodBytes);
+	double decodeTime=seconds(start);
+	std::string clean="rm -rf " + std::string(dir);
+	if(system(clean.c_str())) fprintf(stderr,"%s failed\n",clean.c_str());
+	CHECK(ok,"the log can't be decoded");
+
+	CHECK(decoded.size() == periods.size(),"%u periods decoded, %u logged",
+		(unsigned)decoded.size(),(unsigned)periods.size());
+	for(size_t i=0;i<periods.size();i++){
+		const Period& s=decoded[i];
+		const Period& p=periods[i];
+		CHECK(s.time == p.time,"period %u at %u, logged at %u",(unsigned)i,s.time,p.time);
+		for(int c=0;c<Channels;c++){
+			bool same= (isnan(s.value[c]) && isnan(p.value[c])) || fabs(s.value[c] - p.value[c]) < 0.00005;
+			CHECK(same,"period %u channel %d: %.4f, logged %.4f",(unsigned)i,c,s.value[c],p.value[c]);
+		}
+		// a change of mode or state is logged after the period record
+		if(i ==0) continue;
+		const Period& before=periods[i - 1];
+		CHECK(s.mode == before.mode && s.state == before.state,"period %u: mode %c state %u, logged %c %u",
+			(unsigned)i,s.mode,s.state,before.mode,before.state);
+	}
+	if(bench){
+		size_t v5Periods=v5Size(decoded);
+		size_t v5=size - periodBytes + v5Periods;
+		printf("%d days, %u periods: %u bytes, %u bytes/day. Version 5: %u bytes/day, %.2fx\n",
+			days,(unsigned)periods.size(),(unsigned)size,(unsigned)(size / days),
+			(unsigned)(v5 / days),(double)v5 / size);
+		printf("period records: %.2f bytes, version 5: %.2f bytes\n",
+			(double)periodBytes / periods.size(),(double)v5Periods / periods.size());
+		printf("logData: %.0f periods/s, with the file writes. decode: %.1f MB/s\n",
+			periods.size() / logTime,size / decodeTime / 1e6);
+	}
+}
+
+// the volatile log fills the bytes of events it no longer has with
+// EventTags, which the decoder skips
+static void eventTags(void)
+{
+	const uint8_t log[]={
+		StartLogTag,6,0,60,0x59,0x68,0x2F,0x00,
+		PeriodTag,0x02,0x07,0xD0,
+		EventTag,0,EventTag,0,EventTag,0,
+		PeriodTag,0x02,0x07,0xDA,
+		EventTag,0,
+	};
+	std::vector<Period> periods;
+	Collector collector(periods);
+	BrewLogDecoder decoder(&collector);
+	bool ok=decoder.feed(log,sizeof(log)) && decoder.finish();
+	CHECK(ok,"%s",decoder.error());
+	CHECK(periods.size() ==2,"%u periods",(unsigned)periods.size());
+	CHECK(periods[1].time - periods[0].time == 60,"%u s between the periods",periods[1].time - periods[0].time);
+	CHECK(periods[0].value[OrderBeerTemp] == 20.0f && periods[1].value[OrderBeerTemp] == 20.1f,"beer temperature %.2f, %.2f",
+		periods[0].value[OrderBeerTemp],periods[1].value[OrderBeerTemp]);
+}
+
+int main(int argc,char* argv[])
+{
+	bool bench=benchArgument(argc,argv);
+	if(!bench) eventTags();
+	roundTrip(bench? BenchDays:TestDays,bench);
+	return testResult();
+}
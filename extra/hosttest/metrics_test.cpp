@@ -0,0 +1,236 @@
+// the histogram buckets, a scope timed by the cycle counter, the
+// Prometheus and JSON output, and the task limit of the scheduler. The
+// bench times record(), a scope and the /metrics page.
+#include <stdlib.h>
+#include <string>
+#include "hosttest.h"
+#include "Metrics.h"
+#include "TaskScheduler.h"
+#include "VirtualSerial.h"
+
+#if EnableMetrics != true
+#error build with -DEnableMetrics=true
+#endif
+
+#define BenchRecords 50000000
+#define BenchPages 20000
+
+LineRing brewPiRxBuffer(256);
+LineRing brewPiTxBuffer(256);
+
+class StringPrint: public Print
+{
+public:
+	std::string text;
+	size_t write(uint8_t c){ text += (char)c; return 1; }
+};
+
+static void buckets(void)
+{
+	MetricsProbe probe;
+	const uint32_t us[]={0,1,2,3,4,5,8,9,1000,1024,1025,(1u << 21),(1u << 21) + 1,0xFFFFFFFFu};
+	// bucket i holds (2^(i-1), 2^i], 0 and 1 are in bucket 0
+	const int bucket[]={0,0,1,2,2,3,3,4,10,10,11,21,-1,-1};
+	uint64_t sum=0;
+	for(uint8_t i=0;i<sizeof(us)/sizeof(us[0]);i++){
+		probe.record(us[i]);
+		sum += us[i];
+	}
+	uint32_t expect[MetricsBuckets]={0};
+	for(int b:bucket) if(b >=0) expect[b]++;
+	for(uint8_t i=0;i<MetricsBuckets;i++)
+		CHECK(probe.bucket(i) == expect[i],"bucket %u: %u, not %u",i,probe.bucket(i),expect[i]);
+	CHECK(probe.count() == 14 && probe.sum() == sum && probe.max() == 0xFFFFFFFFu,
+		"count %u, sum %llu, max %u",probe.count(),(unsigned long long)probe.sum(),probe.max());
+	probe.clear();
+	CHECK(probe.count() ==0 && probe.sum() ==0 && probe.max() ==0 && probe.bucket(0) ==0,"not cleared");
+	// only registered probes are listed, so far control_jitter of Metrics.cpp
+	CHECK(MetricsProbe::first() && MetricsProbe::first()->next() == NULL,"an unregistered probe is listed");
+}
+
+static void scope(void)
+{
+	MetricsProbe probe;
+	ESP.cycles=1000;
+	{
+		METRICS_SCOPE(probe);
+		ESP.cycles += 80 * 250;
+	}
+	// across the wrap of the counter
+	ESP.cycles=0xFFFFFF00u;
+	{
+		METRICS_SCOPE(probe);
+		ESP.cycles += 80 * 100;
+	}
+	CHECK(probe.count() ==2 && probe.sum() == 350 && probe.max() == 250,
+		"count %u, sum %llu, max %u",probe.count(),(unsigned long long)probe.sum(),probe.max());
+}
+
+static MetricsProbe plain,web;
+
+static void controlTask(void)
+{
+	hostMillis() += 3;
+}
+
+static const char expectPrometheus[]=
+	"# TYPE bpl_latency_us histogram\n"
+	"bpl_latency_us_bucket{probe=\"control_jitter\",le=\"1\"} 0\n"
+	"bpl_latency_us_bucket{probe=\"control_jitter\",le=\"2\"} 0\n"
+	"bpl_latency_us_bucket{probe=\"control_jitter\",le=\"4\"} 0\n"
+	"bpl_latency_us_bucket{probe=\"control_jitter\",le=\"8\"} 0\n"
+	"bpl_latency_us_bucket{probe=\"control_jitter\",le=\"16\"} 0\n"
+	"bpl_latency_us_bucket{probe=\"control_jitter\",le=\"32\"} 0\n"
+	"bpl_latency_us_bucket{probe=\"control_jitter\",le=\"64\"} 0\n"
+	"bpl_latency_us_bucket{probe=\"control_jitter\",le=\"128\"} 0\n"
+	"bpl_latency_us_bucket{probe=\"control_jitter\",le=\"256\"} 0\n"
+	"bpl_latency_us_bucket{probe=\"control_jitter\",le=\"512\"} 0\n"
+	"bpl_latency_us_bucket{probe=\"control_jitter\",le=\"1024\"} 0\n"
+	"bpl_latency_us_bucket{probe=\"control_jitter\",le=\"2048\"} 0\n"
+	"bpl_latency_us_bucket{probe=\"control_jitter\",le=\"4096\"} 0\n"
+	"bpl_latency_us_bucket{probe=\"control_jitter\",le=\"8192\"} 2\n"
+	"bpl_latency_us_bucket{probe=\"control_jitter\",le=\"+Inf\"} 2\n"
+	"bpl_latency_us_sum{probe=\"control_jitter\"} 10000\n"
+	"bpl_latency_us_count{probe=\"control_jitter\"} 2\n"
+	"bpl_latency_us_bucket{probe=\"plain\",le=\"1\"} 1\n"
+	"bpl_latency_us_bucket{probe=\"plain\",le=\"2\"} 2\n"
+	"bpl_latency_us_bucket{probe=\"plain\",le=\"4\"} 3\n"
+	"bpl_latency_us_bucket{probe=\"plain\",le=\"+Inf\"} 5\n"
+	"bpl_latency_us_sum{probe=\"plain\"} 8000000006\n"
+	"bpl_latency_us_count{probe=\"plain\"} 5\n"
+	"# TYPE bpl_latency_max_us gauge\n"
+	"bpl_latency_max_us{probe=\"control_jitter\"} 5000\n"
+	"bpl_latency_max_us{probe=\"plain\"} 4000000000\n"
+	"# TYPE bpl_task_runs_total counter\n"
+	"bpl_task_runs_total{task=\"control\"} 1\n"
+	"bpl_task_runs_total{task=\"web\"} 1\n"
+	"# TYPE bpl_task_overruns_total counter\n"
+	"bpl_task_overruns_total{task=\"control\"} 1\n"
+	"bpl_task_overruns_total{task=\"web\"} 0\n"
+	"# TYPE bpl_task_max_us gauge\n"
+	"bpl_task_max_us{task=\"control\"} 3000\n"
+	"bpl_task_max_us{task=\"web\"} 0\n"
+	"# TYPE bpl_task_max_late_ms gauge\n"
+	"bpl_task_max_late_ms{task=\"control\"} 0\n"
+	"bpl_task_max_late_ms{task=\"web\"} 0\n"
+	"# TYPE bpl_tasks_dropped gauge\nbpl_tasks_dropped 0\n"
+	"# TYPE bpl_idle_ms_total counter\nbpl_idle_ms_total 0\n"
+	"# TYPE bpl_uptime_ms counter\nbpl_uptime_ms 3\n"
+	"# TYPE bpl_line_overflows_total counter\nbpl_line_overflows_total{ring=\"rx\"} 0\nbpl_line_overflows_total{ring=\"tx\"} 1\n"
+	"# TYPE bpl_ring_high_water_bytes gauge\nbpl_ring_high_water_bytes{ring=\"rx\"} 0\nbpl_ring_high_water_bytes{ring=\"tx\"} 6\n"
+	"# TYPE bpl_free_heap_bytes gauge\nbpl_free_heap_bytes 30000\n";
+
+static void output(void)
+{
+	plain.begin("plain");
+	// registered once
+	plain.begin("twice");
+	web.begin("web","/tcc");
+	plain.record(1);
+	plain.record(2);
+	plain.record(3);
+	// past the last bucket, and a sum past 32 bits
+	plain.record(4000000000u);
+	plain.record(4000000000u);
+
+	// 5ms late, then 5ms early
+	hostMillis()=1000;
+	Metrics.controlTick();
+	hostMillis()=2005;
+	Metrics.controlTick();
+	hostMillis()=3000;
+	Metrics.controlTick();
+
+	// the control task takes 3ms of a 2ms budget
+	hostMillis()=10000;
+	TaskScheduler.add("control",controlTask,1000,2);
+	TaskScheduler.add("web",[](){},0,5);
+	TaskScheduler.run();
+
+	brewPiTxBuffer.writeLine("hello",5);
+	char line[300];
+	memset(line,'x',sizeof(line));
+	brewPiTxBuffer.writeLine(line,sizeof(line));
+	ESP.freeHeap=30000;
+
+	StringPrint out;
+	Metrics.printPrometheus(out);
+	CHECK(out.text == expectPrometheus,"/metrics:\n%s",out.text.c_str());
+
+	StringPrint json;
+	Metrics.printJson(json);
+	// web has no records, and isn't listed
+	const char *expect="{\"up\":3,\"idle\":0,\"heap\":30000,\"probes\":{\"control_jitter\":[2,5000,5000],\"plain\":[5,1600000001,4000000000]}}";
+	CHECK(json.text == expect,"json:\n%s",json.text.c_str());
+
+	web.record(7);
+	json.text.clear();
+	Metrics.printJson(json);
+	CHECK(json.text.find(",\"web /tcc\":[1,7,7]}}") != std::string::npos,"json:\n%s",json.text.c_str());
+}
+
+// an add over SchedulerMaxTasks fails and is counted
+static void schedulerLimit(void)
+{
+	TaskSchedulerClass scheduler;
+	for(int i=0;i<SchedulerMaxTasks;i++)
+		CHECK(scheduler.add("task",[](){},0,1),"task %d not added",i);
+	CHECK(!scheduler.add("over",[](){},0,1),"task over the limit added");
+	CHECK(scheduler.count() == SchedulerMaxTasks && scheduler.dropped() ==1,"%u tasks, %u dropped",scheduler.count(),scheduler.dropped());
+}
+
+static void bench(void)
+{
+	MetricsProbe probe;
+	uint32_t us=1;
+	auto start=std::chrono::steady_clock::now();
+	for(int i=0;i<BenchRecords;i++){
+		probe.record(us);
+		us=us * 1103515245u + 12345u;
+		us >>= 12;
+	}
+	double t=seconds(start);
+	printf("record: %.2f ns\n",t / BenchRecords * 1e9);
+
+	start=std::chrono::steady_clock::now();
+	for(int i=0;i<BenchRecords;i++){
+		METRICS_SCOPE(probe);
+		ESP.cycles += 80 * (i & 1023);
+	}
+	t=seconds(start);
+	printf("scope: %.2f ns\n",t / BenchRecords * 1e9);
+
+	// the probes of the firmware, with one web probe for each route
+	static MetricsProbe probes[24];
+	static char labels[16][12];
+	for(int i=0;i<24;i++){
+		if(i < 8){
+			probes[i].begin("probe");
+		}else{
+			snprintf(labels[i - 8],sizeof(labels[0]),"/route%d",i - 8);
+			probes[i].begin("web",labels[i - 8]);
+		}
+		for(uint32_t v=1;v < 100000;v=v * 3 + 1) probes[i].record(v);
+	}
+	StringPrint out;
+	start=std::chrono::steady_clock::now();
+	for(int i=0;i<BenchPages;i++){
+		out.text.clear();
+		Metrics.printPrometheus(out);
+	}
+	t=seconds(start);
+	printf("/metrics, %d probes: %u bytes, %.1f us\n",24,(unsigned)out.text.size(),t / BenchPages * 1e6);
+}
+
+int main(int argc,char* argv[])
+{
+	if(benchArgument(argc,argv)){
+		bench();
+		return 0;
+	}
+	buckets();
+	scope();
+	output();
+	schedulerLimit();
+	return testResult();
+}
@@ -0,0 +1,163 @@
+// the embedded pages sent in chunks of the TCP window must come out whole,
+// and copy() must work from any alignment. The bench reports bytes/s and
+// callbacks per page, and for nul-terminated pages, the same for the
+// per-chunk strlen_P() callback of sendProgmem() before.
+#include <stdlib.h>
+#include <string>
+#include "hosttest.h"
+#include "ProgmemResponse.h"
+#include "data_nindex_htm.h"
+#include "data_index_htm.h"
+#include "data_setup_htm.h"
+#include "data_viewlog_htm.h"
+
+// bytes asked for in a callback, the send buffer of lwIP
+#define ChunkSize 1460
+#define BenchBytes (256 * 1024 * 1024)
+
+static const struct {
+	const char *name;
+	const unsigned char *data;
+	size_t size;
+} gzipPages[]={
+	{"index (gzip)",data_nindex_htm_gz,sizeof(data_nindex_htm_gz)},
+	{"lcd (gzip)",data_lcd_min_htm_gz,sizeof(data_lcd_min_htm_gz)},
+	{"setup (gzip)",data_setup_min_htm_gz,sizeof(data_setup_min_htm_gz)},
+	{"viewlog (gzip)",data_viewlog_min_htm_gz,sizeof(data_viewlog_min_htm_gz)},
+};
+
+// a nul-terminated page of about size bytes, like the config pages
+static std::string textPage(size_t size)
+{
+	std::string page="<html><head><title>BrewPiLess</title></head><body>\n";
+	while(page.size() + 64 < size)
+		page += "<div class=\"row\"><label>Setting</label><input type=\"text\"></div>\n";
+	page += "</body></html>";
+	return page;
+}
+
+// sends the whole response, returns the number of callbacks
+static size_t sendAll(AsyncAbstractResponse& response,uint8_t* out,size_t chunk)
+{
+	size_t callbacks=0;
+	while(response._sentLength < response._contentLength){
+		size_t left=response._contentLength - response._sentLength;
+		size_t len=response._fillBuffer(out + response._sentLength,(left < chunk)? left:chunk);
+		if(len ==0) break;
+		response._sentLength += len;
+		callbacks++;
+	}
+	return callbacks;
+}
+
+// flash bytes the old callback reads, strlen_P() included
+static size_t oldFlashRead;
+
+// the callback of sendProgmem() before ProgmemResponse
+static size_t oldFill(const char* html,uint8_t* buffer,size_t maxLen,size_t alreadySent)
+{
+	if(strlen_P(html + alreadySent) > maxLen){
+		oldFlashRead += strlen(html + alreadySent) + maxLen;
+		memcpy_P((char*)buffer,html + alreadySent,maxLen);
+		return maxLen;
+	}
+	oldFlashRead += strlen(html + alreadySent) * 4;
+	memcpy_P((char*)buffer,html + alreadySent,strlen_P(html + alreadySent));
+	return strlen_P(html + alreadySent);
+}
+
+static void copyAlignment(void)
+{
+	static uint32_t words[300];
+	uint8_t *src=(uint8_t*)words;
+	for(size_t i=0;i<sizeof(words);i++) src[i]=rand();
+	uint8_t dst[1300];
+	for(int from=0;from<8;from++)
+		for(int to=0;to<5;to++)
+			for(size_t len=0;len<40;len++){
+				memset(dst,0,sizeof(dst));
+				ProgmemResponse::copy(dst + to,src + from,len);
+				CHECK(memcmp(dst + to,src + from,len) ==0,"copy of %u bytes from +%d to +%d",(unsigned)len,from,to);
+				CHECK(dst[to + len] ==0,"copy of %u bytes from +%d to +%d writes after the end",(unsigned)len,from,to);
+			}
+}
+
+static void pages(void)
+{
+	for(auto& page:gzipPages){
+		ProgmemResponse response("text/html",page.data,page.size,true);
+		CHECK(response._contentLength == page.size,"%s: length %u",page.name,(unsigned)response._contentLength);
+		CHECK(response._headers.size() ==1 && response._headers[0].first == "Content-Encoding","%s: no gzip header",page.name);
+		std::string out(page.size,'\0');
+		size_t callbacks=sendAll(response,(uint8_t*)&out[0],ChunkSize);
+		CHECK(memcmp(out.data(),page.data,page.size) ==0,"%s differs",page.name);
+		CHECK(callbacks == (page.size + ChunkSize - 1) / ChunkSize,"%s: %u callbacks",page.name,(unsigned)callbacks);
+	}
+	// nul-terminated, from an odd address
+	std::string text=" " + textPage(20000);
+	const char *html=text.c_str() + 1;
+	ProgmemResponse response("text/html",html);
+	CHECK(response._contentLength == strlen(html),"text length %u",(unsigned)response._contentLength);
+	std::string out(response._contentLength,'\0');
+	sendAll(response,(uint8_t*)&out[0],ChunkSize - 3);
+	CHECK(out == html,"the text page differs");
+}
+
+static void benchPage(const char* name,const void* data,size_t size,bool text)
+{
+	std::string out(size + 1,'\0');
+	int rounds=BenchBytes / size + 1;
+	size_t callbacks=0;
+	auto start=std::chrono::steady_clock::now();
+	for(int i=0;i<rounds;i++){
+		ProgmemResponse response("text/html",data,text? 0:size,!text);
+		callbacks=sendAll(response,(uint8_t*)&out[0],ChunkSize);
+	}
+	double t=seconds(start);
+	printf("%-16s %6u bytes, %3u callbacks: %7.1f MB/s",name,(unsigned)size,(unsigned)callbacks,
+		(double)size * rounds / t / 1e6);
+	if(!text){
+		printf("\n");
+		return;
+	}
+	const char *html=(const char*)data;
+	// the host scans memory far faster than the ESP reads flash, so the
+	// flash bytes read are the figure to compare
+	oldFlashRead=0;
+	for(size_t sent=0;sent < size;)
+		sent += oldFill(html,(uint8_t*)&out[sent],ChunkSize,sent);
+	size_t flashRead=oldFlashRead;
+	// quadratic, so fewer rounds
+	rounds=rounds / 16 + 1;
+	start=std::chrono::steady_clock::now();
+	for(int i=0;i<rounds;i++){
+		for(size_t sent=0;sent < size;)
+			sent += oldFill(html,(uint8_t*)&out[sent],ChunkSize,sent);
+	}
+	t=seconds(start);
+	printf(", strlen_P per chunk: %7.1f MB/s, %.1fx the flash reads\n",(double)size * rounds / t / 1e6,
+		(double)flashRead / (2 * size));
+}
+
+static void bench(void)
+{
+	for(auto& page:gzipPages) benchPage(page.name,page.data,page.size,false);
+	const size_t sizes[]={4096,16384,65536};
+	for(size_t size:sizes){
+		std::string text=textPage(size);
+		char name[24];
+		snprintf(name,sizeof(name),"text %uK",(unsigned)(size / 1024));
+		benchPage(name,text.c_str(),text.size(),true);
+	}
+}
+
+int main(int argc,char* argv[])
+{
+	if(benchArgument(argc,argv)){
+		bench();
+		return 0;
+	}
+	copyAlignment();
+	pages();
+	return testResult();
+}
@@ -0,0 +1,60 @@
+// the head of a ranged log response: one Accept-Ranges header, "bytes",
+// for HTTP/1.1 and 1.0, next to the "none" the library adds for 1.1.
+#include <stdlib.h>
+#include <string>
+#include "hosttest.h"
+#include "RangeResponse.h"
+
+class TestResponse: public RangeResponse
+{
+public:
+	TestResponse(int code,size_t size){
+		_code = code;
+		_contentType = "application/octet-stream";
+		_contentLength = size;
+	}
+};
+
+static int count(const std::string& head,const char* text)
+{
+	int n=0;
+	for(size_t at=head.find(text); at != std::string::npos; at=head.find(text,at + 1)) n++;
+	return n;
+}
+
+static void rangedHead(uint8_t version)
+{
+	TestResponse response(206,100);
+	response.addRangeHeaders(1,100,200,1000);
+	std::string head=response._assembleHead(version).c_str();
+	CHECK(count(head,"Accept-Ranges:") ==1 && count(head,"Accept-Ranges: bytes\r\n") ==1,"HTTP/1.%d:\n%s",version,head.c_str());
+	CHECK(count(head,"Content-Range: bytes 100-199/1000\r\n") ==1,"HTTP/1.%d:\n%s",version,head.c_str());
+	CHECK(response._headLength == head.length(),"HTTP/1.%d: head length %u, not %u",version,
+		(unsigned)response._headLength,(unsigned)head.length());
+}
+
+static void wholeHead(void)
+{
+	TestResponse response(200,1000);
+	response.addRangeHeaders(0,0,1000,1000);
+	std::string head=response._assembleHead(1).c_str();
+	CHECK(count(head,"Accept-Ranges:") ==1 && count(head,"Accept-Ranges: bytes\r\n") ==1,"%s",head.c_str());
+	CHECK(count(head,"Content-Range:") ==0,"%s",head.c_str());
+}
+
+// without addRangeHeaders() the library's "none" stays
+static void noRangeHead(void)
+{
+	TestResponse response(200,1000);
+	std::string head=response._assembleHead(1).c_str();
+	CHECK(count(head,"Accept-Ranges:") ==1 && count(head,"Accept-Ranges: none\r\n") ==1,"%s",head.c_str());
+}
+
+int main(int argc,char* argv[])
+{
+	rangedHead(1);
+	rangedHead(0);
+	wholeHead();
+	noRangeHead();
+	return testResult();
+}
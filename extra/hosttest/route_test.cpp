@@ -0,0 +1,160 @@
+// the table and findRoute() of WebRoutes.h against the if/else chains of
+// canHandle() and handleRequest() they replaced, which are kept here as
+// the reference. Both sides compare the url as the core's String does,
+// with strcmp(). A handler is named by a string on both sides.
+#include <stdlib.h>
+#include "hosttest.h"
+#include "WebRoutes.h"
+
+#define BenchRequests 20000000
+
+#define File "file"
+
+#define ROUTE(m,p,a,h) {pathHash(p),m,a,#h,p},
+
+static const WebRoute<const char*> _routes[]={
+	WEB_ROUTES(ROUTE)
+};
+
+static const uint8_t _routeNumber=sizeof(_routes)/sizeof(_routes[0]);
+
+// canHandle() and handleRequest() now: the handler, File, or NULL when
+// the request is handed on
+static const char* dispatchTable(uint8_t method,const char *url)
+{
+	const WebRoute<const char*> *route=findRoute(_routes,_routeNumber,method,url);
+	if(route) return route->handler;
+	return (method == HTTP_GET)? File:NULL;
+}
+
+#define URL(p) (strcmp(url,p) ==0)
+
+// canHandle() before the table, without the file lookup: 1 for a fixed
+// path, 2 for a file
+static int canHandleChain(uint8_t method,const char *url)
+{
+	if(method == HTTP_GET){
+		if(URL(POLLING_PATH) || URL(CONFIG_PATH) || URL(TIME_PATH)
+		 || URL(RESETWIFI_PATH) || URL(CONTROL_CC_PATH)
+		 || URL(GETSTATUS_PATH) || URL(SNAPSHOT_PATH)
+		 || URL(LOGGING_PATH))
+			return 1;
+		return 2;
+	}else if(method == HTTP_DELETE && URL(DELETE_PATH)){
+		return 1;
+	}else if(method == HTTP_POST){
+		if(URL(PUTLINE_PATH) || URL(CONFIG_PATH)
+			|| URL(FPUTS_PATH) || URL(FLIST_PATH)
+			|| URL(TIME_PATH)
+			|| URL(LOGGING_PATH))
+			return 1;
+	}
+	return 0;
+}
+
+// handleRequest() before the table
+static const char* handleRequestChain(uint8_t method,const char *url)
+{
+	if(method == HTTP_GET && URL(POLLING_PATH)) return "handlePolling";
+	else if(method == HTTP_POST && URL(PUTLINE_PATH)) return "handlePutLine";
+	else if(method == HTTP_GET && URL(CONTROL_CC_PATH)) return "handleControlConstant";
+	else if(method == HTTP_GET && URL(CONFIG_PATH)) return "handleGetConfig";
+	else if(method == HTTP_POST && URL(CONFIG_PATH)) return "handleSetConfig";
+	else if(method == HTTP_GET && URL(TIME_PATH)) return "handleGetTime";
+	else if(method == HTTP_POST && URL(TIME_PATH)) return "handleSetTime";
+	else if(method == HTTP_GET && URL(RESETWIFI_PATH)) return "handleResetWiFi";
+	else if(method == HTTP_POST && URL(FLIST_PATH)) return "handleFileList";
+	else if(method == HTTP_DELETE && URL(DELETE_PATH)) return "handleFileDelete";
+	else if(method == HTTP_POST && URL(FPUTS_PATH)) return "handleFilePuts";
+	else if(method == HTTP_GET && URL(GETSTATUS_PATH)) return "handleGetStatus";
+	else if(method == HTTP_GET && URL(SNAPSHOT_PATH)) return "handleSnapshot";
+	else if(URL(LOGGING_PATH)){
+		if(method == HTTP_POST) return "handleSetLogging";
+		return "handleGetLogging";
+	}else if(method == HTTP_GET) return File;
+	return NULL;
+}
+
+static const char* dispatchChain(uint8_t method,const char *url)
+{
+	if(canHandleChain(method,url) ==0) return NULL;
+	return handleRequestChain(method,url);
+}
+
+static bool same(const char *a,const char *b)
+{
+	return a == b || (a && b && strcmp(a,b) ==0);
+}
+
+#define Name(h) ((h)? (h):"none")
+
+static const struct {
+	uint8_t method;
+	const char *url;
+} requests[]={
+	{HTTP_GET,"/"},{HTTP_GET,"/index.htm"},{HTTP_GET,"/bwf.js"},{HTTP_GET,"/getstatus"},
+	{HTTP_GET,"/log"},{HTTP_POST,"/log"},{HTTP_GET,"/tcc"},{HTTP_POST,"/putline"},
+	{HTTP_GET,"/getline_p"},{HTTP_GET,"/snapshot"},{HTTP_POST,"/config"},{HTTP_DELETE,"/rm"},
+	{HTTP_POST,"/index.htm"},{HTTP_DELETE,"/log"},{HTTP_GET,"/tc"},{HTTP_GET,"/logs"},
+};
+#define RequestNumber (sizeof(requests)/sizeof(requests[0]))
+
+static void collisions(void)
+{
+	for(uint8_t i=0;i<_routeNumber;i++){
+		CHECK(_routes[i].hash == urlHash(_routes[i].path),"%s: the hash differs at compile time",_routes[i].path);
+		for(uint8_t j=0;j<i;j++)
+			CHECK(strcmp(_routes[i].path,_routes[j].path) ==0 || _routes[i].hash != _routes[j].hash,
+				"%s and %s have the same hash",_routes[i].path,_routes[j].path);
+	}
+}
+
+// both find the same handler, or both hand the request on
+static void sameRoutes(void)
+{
+	for(uint8_t i=0;i<_routeNumber;i++)
+		CHECK(same(dispatchTable(_routes[i].method,_routes[i].path),_routes[i].handler),"%s: not found",_routes[i].path);
+	for(auto& r:requests)
+		CHECK(same(dispatchTable(r.method,r.url),dispatchChain(r.method,r.url)),"%d %s: %s, not %s",r.method,r.url,
+			Name(dispatchTable(r.method,r.url)),Name(dispatchChain(r.method,r.url)));
+}
+
+static double bench(const char* (*dispatch)(uint8_t,const char*),uint8_t method,const char *url,int n)
+{
+	const char *volatile sink;
+	auto start=std::chrono::steady_clock::now();
+	for(int i=0;i<n;i++){
+		// keep the compiler from hoisting the lookup
+		const char *volatile p=url;
+		sink=dispatch(method,p);
+	}
+	(void)sink;
+	return seconds(start) / n * 1e9;
+}
+
+static void bench(void)
+{
+	static const char *methods[]={"","GET","POST","DELETE"};
+	int n=BenchRequests / RequestNumber;
+	double table=0,chain=0;
+	printf("%-6s %-12s %8s %8s\n","","","chain","table");
+	for(auto& r:requests){
+		double c=bench(dispatchChain,r.method,r.url,n);
+		double t=bench(dispatchTable,r.method,r.url,n);
+		chain += c;
+		table += t;
+		printf("%-6s %-12s %5.1f ns %5.1f ns\n",methods[r.method],r.url,c,t);
+	}
+	printf("%-19s %5.1f ns %5.1f ns\n","mean",chain / RequestNumber,table / RequestNumber);
+}
+
+int main(int argc,char* argv[])
+{
+	if(benchArgument(argc,argv)){
+		bench();
+		return 0;
+	}
+	collisions();
+	sameRoutes();
+	return testResult();
+}
@@ -0,0 +1,169 @@
+// the part of the Arduino core used by the sources under test, for the host
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <math.h>
+#include <time.h>
+
+// the time is set by the test
+inline unsigned long& hostMillis(void){ static unsigned long ms; return ms; }
+inline unsigned long millis(void){ return hostMillis(); }
+inline unsigned long micros(void){ return hostMillis() * 1000; }
+inline void delay(unsigned long ms){ hostMillis() += ms; }
+inline void yield(void){}
+// one thread on the host
+inline void noInterrupts(void){}
+inline void interrupts(void){}
+
+// the cycle counter and the heap, also set by the test
+class EspClass
+{
+public:
+	EspClass(void):cycles(0),freeHeap(0){}
+	uint32_t getCycleCount(void){ return cycles; }
+	uint8_t getCpuFreqMHz(void){ return 80; }
+	uint32_t getFreeHeap(void){ return freeHeap; }
+
+	uint32_t cycles;
+	uint32_t freeHeap;
+};
+inline EspClass& hostEsp(void){ static EspClass esp; return esp; }
+#define ESP hostEsp()
+
+#define PROGMEM
+#define PGM_P const char*
+#define PSTR(s) (s)
+#define strlen_P strlen
+#define strcmp_P strcmp
+#define memcpy_P memcpy
+#define vsnprintf_P vsnprintf
+#define pgm_read_byte(p) (*(const uint8_t*)(p))
+#define pgm_read_word(p) (*(const uint16_t*)(p))
+#define pgm_read_dword(p) (*(const uint32_t*)(p))
+#define pgm_read_ptr(p) (*(void* const*)(p))
+
+typedef uint8_t byte;
+
+// heap calls of String, also counted by a test
+inline unsigned long& hostHeapCalls(void){ static unsigned long calls; return calls; }
+
+// the String of the core: a heap block of the exact size for each String,
+// realloc() for each concatenation
+class String
+{
+public:
+	String(const char* s=""){ set(s,strlen(s)); }
+	String(const String& s){ set(s._buf,s._len); }
+	explicit String(char c){ set(&c,1); }
+	explicit String(unsigned char v){ format("%u",v); }
+	explicit String(int v){ format("%d",v); }
+	explicit String(unsigned int v){ format("%u",v); }
+	explicit String(long v){ format("%ld",v); }
+	explicit String(unsigned long v){ format("%lu",v); }
+	explicit String(float v,unsigned char decimals=2){ format("%.*f",decimals,v); }
+	~String(){ free(_buf); }
+
+	String& operator=(const String& s){
+		if(this != &s){
+			free(_buf);
+			set(s._buf,s._len);
+		}
+		return *this;
+	}
+	String& operator+=(const String& s){ return concat(s._buf,s._len); }
+	String& operator+=(const char* s){ return concat(s,strlen(s)); }
+	const char* c_str(void) const { return _buf; }
+	unsigned int length(void) const { return _len; }
+	void replace(const String& find,const String& with){
+		if(find._len ==0) return;
+		String out("");
+		const char* from=_buf;
+		const char* at;
+		while((at=strstr(from,find._buf)) != NULL){
+			out.concat(from,at - from);
+			out.concat(with._buf,with._len);
+			from=at + find._len;
+		}
+		out.concat(from,strlen(from));
+		*this=out;
+	}
+private:
+	char* _buf;
+	size_t _len;
+
+	void set(const char* s,size_t len){
+		hostHeapCalls()++;
+		_buf=(char*)malloc(len + 1);
+		memcpy(_buf,s,len);
+		_buf[len]='\0';
+		_len=len;
+	}
+	void format(const char* f,...){
+		char b[32];
+		va_list args;
+		va_start(args,f);
+		int len=vsnprintf(b,sizeof(b),f,args);
+		va_end(args);
+		set(b,len);
+	}
+	String& concat(const char* s,size_t len){
+		hostHeapCalls()++;
+		_buf=(char*)realloc(_buf,_len + len + 1);
+		memcpy(_buf + _len,s,len + 1);
+		_len += len;
+		return *this;
+	}
+};
+
+// a + b + c adds to a copy of a
+class StringSumHelper: public String
+{
+public:
+	StringSumHelper(const String& s):String(s){}
+	StringSumHelper(const char* s):String(s){}
+};
+
+inline StringSumHelper& operator+(const StringSumHelper& lhs,const String& rhs)
+{
+	StringSumHelper& sum=const_cast<StringSumHelper&>(lhs);
+	sum += rhs;
+	return sum;
+}
+
+inline StringSumHelper& operator+(const StringSumHelper& lhs,const char* rhs)
+{
+	StringSumHelper& sum=const_cast<StringSumHelper&>(lhs);
+	sum += rhs;
+	return sum;
+}
+
+class Print
+{
+public:
+	virtual ~Print(){}
+	virtual size_t write(uint8_t c)=0;
+	virtual size_t write(const uint8_t* buffer,size_t size){
+		size_t n=0;
+		while(size-- && write(*buffer++)) n++;
+		return n;
+	}
+	size_t write(const char* str){ return write((const uint8_t*)str,strlen(str)); }
+	size_t print(const char* str){ return write(str); }
+	size_t print(char c){ return write((uint8_t)c); }
+	size_t printf(const char* format,...){
+		char buf[256];
+		va_list args;
+		va_start(args,format);
+		int len=vsnprintf(buf,sizeof(buf),format,args);
+		va_end(args);
+		return write((const uint8_t*)buf,(len < (int)sizeof(buf))? len:sizeof(buf) - 1);
+	}
+};
+
+#endif
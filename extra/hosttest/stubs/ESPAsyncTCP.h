@@ -0,0 +1,95 @@
+// a loopback AsyncClient for the host. What the code under test adds is kept
+// in 'wire' until the test, as the peer, takes it and acknowledges it. Data
+// from the peer goes straight to the onData handler.
+#ifndef ESPAsyncTCP_h
+#define ESPAsyncTCP_h
+
+#include <functional>
+#include <string>
+#include <Arduino.h>
+
+// the send buffer of lwIP
+#define TCP_SND_BUF (2 * 1460)
+
+class AsyncClient;
+
+typedef std::function<void(void*, AsyncClient*)> AcConnectHandler;
+typedef std::function<void(void*, AsyncClient*, size_t len, uint32_t time)> AcAckHandler;
+typedef std::function<void(void*, AsyncClient*, int8_t error)> AcErrorHandler;
+typedef std::function<void(void*, AsyncClient*, void *data, size_t len)> AcDataHandler;
+typedef std::function<void(void*, AsyncClient*, uint32_t time)> AcTimeoutHandler;
+
+class AsyncClient
+{
+public:
+	// the peer side
+	std::string wire;
+	bool closed;
+	uint32_t sends;
+
+	AsyncClient(void):closed(false),sends(0),_space(TCP_SND_BUF),_ackArg(NULL),_discArg(NULL),
+		_timeoutArg(NULL),_dataArg(NULL),_pollArg(NULL){}
+
+	void onAck(AcAckHandler cb, void* arg = 0){ _ackCb=cb; _ackArg=arg; }
+	void onDisconnect(AcConnectHandler cb, void* arg = 0){ _discCb=cb; _discArg=arg; }
+	void onTimeout(AcTimeoutHandler cb, void* arg = 0){ _timeoutCb=cb; _timeoutArg=arg; }
+	void onData(AcDataHandler cb, void* arg = 0){ _dataCb=cb; _dataArg=arg; }
+	void onPoll(AcConnectHandler cb, void* arg = 0){ _pollCb=cb; _pollArg=arg; }
+
+	bool canSend(void){ return _space > 0; }
+	size_t space(void){ return _space; }
+	size_t add(const char* data, size_t size, uint8_t apiflags = 0){
+		if(size > _space) size=_space;
+		wire.append(data,size);
+		_space -= size;
+		return size;
+	}
+	bool send(void){ sends++; return true; }
+	void close(bool now = false){ closed=true; }
+	void free(void){}
+
+	// the peer takes len bytes from the wire, and they are acknowledged
+	std::string take(size_t len){
+		std::string data=wire.substr(0,len);
+		wire.erase(0,data.size());
+		_space += data.size();
+		if(_ackCb) _ackCb(_ackArg,this,data.size(),1);
+		return data;
+	}
+	void receive(const void* data, size_t len){ if(_dataCb) _dataCb(_dataArg,this,(void*)data,len); }
+	void poll(void){ if(_pollCb) _pollCb(_pollArg,this); }
+	// the client is deleted by the handler
+	void disconnect(void){ if(_discCb) _discCb(_discArg,this); }
+
+private:
+	size_t _space;
+	AcAckHandler _ackCb;
+	void* _ackArg;
+	AcConnectHandler _discCb;
+	void* _discArg;
+	AcTimeoutHandler _timeoutCb;
+	void* _timeoutArg;
+	AcDataHandler _dataCb;
+	void* _dataArg;
+	AcConnectHandler _pollCb;
+	void* _pollArg;
+};
+
+class AsyncServer
+{
+public:
+	AsyncServer(uint16_t port):_port(port),_arg(NULL){}
+	void onClient(AcConnectHandler cb, void* arg){ _cb=cb; _arg=arg; }
+	void setNoDelay(bool nodelay){}
+	void begin(void){}
+
+	// a new connection, as the test sees it
+	void connect(AsyncClient* client){ _cb(_arg,client); }
+
+private:
+	uint16_t _port;
+	AcConnectHandler _cb;
+	void* _arg;
+};
+
+#endif
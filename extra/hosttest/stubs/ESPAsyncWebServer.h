@@ -0,0 +1,63 @@
+// the request methods and the response classes of ESPAsyncWebServer,
+// without the server. The test calls _fillBuffer() the way
+// AsyncAbstractResponse::_ack() does, and moves _sentLength itself.
+#ifndef ESPAsyncWebServer_h
+#define ESPAsyncWebServer_h
+
+#include <Arduino.h>
+#include <string>
+#include <vector>
+#include <utility>
+
+typedef enum {
+  HTTP_ANY, HTTP_GET, HTTP_POST, HTTP_DELETE, HTTP_PUT, HTTP_PATCH, HTTP_HEAD, HTTP_OPTIONS
+} WebRequestMethod;
+
+class AsyncWebServerResponse
+{
+public:
+	int _code;
+	std::string _contentType;
+	size_t _contentLength;
+	bool _sendContentLength;
+	bool _chunked;
+	size_t _headLength;
+	size_t _sentLength;
+	std::vector<std::pair<std::string,std::string> > _headers;
+
+	AsyncWebServerResponse(void):_code(0),_contentLength(0),_sendContentLength(true),_chunked(false),
+		_headLength(0),_sentLength(0){}
+	virtual ~AsyncWebServerResponse(){}
+	void addHeader(const char* name,const char* value){ _headers.push_back(std::make_pair(name,value)); }
+	void addHeader(const String& name,const String& value){ addHeader(name.c_str(),value.c_str()); }
+
+	// as the library does it, with the headers it adds for HTTP/1.1
+	virtual String _assembleHead(uint8_t version){
+		if(version){
+			addHeader("Accept-Ranges","none");
+			if(_chunked) addHeader("Transfer-Encoding","chunked");
+		}
+		char buf[64];
+		snprintf(buf,sizeof(buf),"HTTP/1.%d %d\r\n",version,_code);
+		std::string out=buf;
+		if(_sendContentLength){
+			snprintf(buf,sizeof(buf),"Content-Length: %u\r\n",(unsigned)_contentLength);
+			out += buf;
+		}
+		if(_contentType.length()) out += "Content-Type: " + _contentType + "\r\n";
+		for(auto& h:_headers) out += h.first + ": " + h.second + "\r\n";
+		_headers.clear();
+		out += "\r\n";
+		_headLength=out.length();
+		return String(out.c_str());
+	}
+};
+
+class AsyncAbstractResponse: public AsyncWebServerResponse
+{
+public:
+	virtual bool _sourceValid(){ return false; }
+	virtual size_t _fillBuffer(uint8_t* buf,size_t maxLen){ return 0; }
+};
+
+#endif
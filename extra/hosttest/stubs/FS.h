@@ -0,0 +1,104 @@
+// SPIFFS in a host directory. SPIFFS is flat, so '/' in a path becomes '_'.
+#ifndef FS_H
+#define FS_H
+
+#include <Arduino.h>
+#include <memory>
+#include <string>
+
+enum SeekMode { SeekSet = 0, SeekCur = 1, SeekEnd = 2 };
+
+struct FSInfo {
+	size_t totalBytes;
+	size_t usedBytes;
+	size_t blockSize;
+	size_t pageSize;
+	size_t maxOpenFiles;
+	size_t maxPathLength;
+};
+
+class File
+{
+public:
+	File(void){}
+	File(FILE* f,const char* name):_file(new Handle(f)),_name(name){}
+
+	operator bool() const { return _file && _file->f; }
+	size_t write(uint8_t c){ return write(&c,1); }
+	size_t write(const uint8_t* buf,size_t size){ return *this? fwrite(buf,1,size,_file->f):0; }
+	size_t print(const char* str){ return write((const uint8_t*)str,strlen(str)); }
+	int read(void){ uint8_t c; return (read(&c,1) ==1)? c:-1; }
+	size_t read(uint8_t* buf,size_t size){ return *this? fread(buf,1,size,_file->f):0; }
+	size_t readBytes(char* buf,size_t size){ return read((uint8_t*)buf,size); }
+	int available(void){ return *this? (int)(size() - position()):0; }
+	bool seek(uint32_t pos,SeekMode mode = SeekSet){
+		return *this && fseek(_file->f,pos,(mode == SeekSet)? SEEK_SET:(mode == SeekCur)? SEEK_CUR:SEEK_END) ==0;
+	}
+	size_t position(void){ return *this? ftell(_file->f):0; }
+	size_t size(void){
+		if(!*this) return 0;
+		long pos=ftell(_file->f);
+		fseek(_file->f,0,SEEK_END);
+		long size=ftell(_file->f);
+		fseek(_file->f,pos,SEEK_SET);
+		return size;
+	}
+	void flush(void){ if(*this) fflush(_file->f); }
+	void close(void){
+		if(!*this) return;
+		fclose(_file->f);
+		_file->f=NULL;
+	}
+	const char* name(void){ return _name.c_str(); }
+
+private:
+	// shared by the copies, like the handle of the core's File
+	struct Handle {
+		FILE* f;
+		Handle(FILE* file):f(file){}
+		~Handle(){ if(f) fclose(f); }
+	};
+	std::shared_ptr<Handle> _file;
+	std::string _name;
+};
+
+class FS
+{
+public:
+	// the directory the files are in, with its trailing '/'
+	void setRoot(const char* root){ _root=root; }
+
+	File open(const char* path,const char* mode){
+		std::string m=mode;
+		const char* host= (m == "r")? "rb":(m == "r+")? "rb+":(m == "w")? "wb":(m == "w+")? "wb+":(m == "a")? "ab":"ab+";
+		FILE* f=fopen(hostPath(path).c_str(),host);
+		return f? File(f,path):File();
+	}
+	bool exists(const char* path){
+		FILE* f=fopen(hostPath(path).c_str(),"rb");
+		if(f) fclose(f);
+		return f != NULL;
+	}
+	bool remove(const char* path){ return ::remove(hostPath(path).c_str()) ==0; }
+	bool rename(const char* from,const char* to){ return ::rename(hostPath(from).c_str(),hostPath(to).c_str()) ==0; }
+	bool info(FSInfo& info){
+		memset(&info,0,sizeof(info));
+		info.totalBytes=3 * 1024 * 1024;
+		info.blockSize=8192;
+		info.pageSize=256;
+		return true;
+	}
+
+	std::string hostPath(const char* path){
+		std::string host=_root;
+		for(const char* p= (*path == '/')? path + 1:path;*p;p++) host += (*p == '/')? '_':*p;
+		return host;
+	}
+
+private:
+	std::string _root;
+};
+
+extern FS SPIFFS;
+
+#endif
@@ -0,0 +1,2 @@
+// flash is ordinary memory on the host, see Arduino.h
+#include <Arduino.h>
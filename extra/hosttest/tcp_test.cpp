@@ -0,0 +1,207 @@
+// BrewPiTcpServer over the loopback AsyncClient of stubs/ESPAsyncTCP.h.
+// Response lines go through the client queue to the wire, and the test
+// acknowledges them as the peer. Every line must arrive whole and in order,
+// or be counted as dropped. Command lines, split anywhere and mixed with
+// telnet negotiation, must reach brewPi.putLine() as they were sent.
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include "hosttest.h"
+#include "BrewPiTcpServer.h"
+#include "BrewPiProxy.h"
+
+#define LoopbackLines 200000
+#define BenchLines 2000000
+
+// the RX side of the proxy
+BrewPiProxy brewPi;
+static std::vector<std::string> received;
+void BrewPiProxy::putLine(const char* str){ received.push_back(str); }
+
+static uint32_t seed=1;
+static uint32_t rnd(uint32_t n)
+{
+	seed = seed * 1103515245u + 12345u;
+	return (seed >> 8) % n;
+}
+
+class TestServer: public BrewPiTcpServer
+{
+public:
+	TestServer(void):BrewPiTcpServer(BREWPI_TCP_SERVER_PORT){ begin(); }
+	AsyncClient* connect(void){
+		AsyncClient *client=new AsyncClient;
+		_server.connect(client);
+		return client;
+	}
+	// the newest client
+	BrewPiTcpClient* client(void){ return _clients; }
+	uint8_t count(void){ return _count; }
+};
+
+static std::string statusLine(uint32_t seq)
+{
+	char line[96];
+	int len=snprintf(line,sizeof(line),"T:{\"seq\":%u,\"BeerTemp\":20.12,\"BeerSet\":20.00,\"FridgeTemp\":18.50,\"State\":%u}",
+		seq,seq % 10);
+	return std::string(line,len);
+}
+
+// checks the lines that have arrived, keeps a partial one
+class Peer
+{
+public:
+	Peer(AsyncClient* client):_client(client),_next(0),lines(0){}
+
+	bool take(size_t len){
+		_partial += _client->take(len);
+		size_t nl;
+		while((nl=_partial.find('\n')) != std::string::npos){
+			std::string line=_partial.substr(0,nl);
+			_partial.erase(0,nl + 1);
+			unsigned seq;
+			if(sscanf(line.c_str(),"T:{\"seq\":%u,",&seq) != 1 || seq < _next || line != statusLine(seq)){
+				fprintf(stderr,"bad line \"%s\", after %u\n",line.c_str(),_next);
+				return false;
+			}
+			_next=seq + 1;
+			lines++;
+		}
+		return true;
+	}
+	bool idle(void){ return _client->wire.empty() && _partial.empty(); }
+
+private:
+	AsyncClient *_client;
+	std::string _partial;
+	uint32_t _next;
+public:
+	uint32_t lines;
+};
+
+static void clients(void)
+{
+	TestServer server;
+	AsyncClient *a=server.connect();
+	AsyncClient *b=server.connect();
+	AsyncClient *c=server.connect();
+	CHECK(server.count() == BrewPiTcpMaxClients,"%u clients",server.count());
+	CHECK(c->closed && !a->closed && !b->closed,"the client over the limit is not closed");
+	delete c;
+
+	server.send("hello",5);
+	CHECK(a->wire == "hello\n" && b->wire == "hello\n","\"%s\" \"%s\"",a->wire.c_str(),b->wire.c_str());
+	a->disconnect();
+	CHECK(server.count() ==1,"%u clients after a disconnect",server.count());
+	server.send("again",5);
+	CHECK(b->wire == "hello\nagain\n","\"%s\"",b->wire.c_str());
+	b->disconnect();
+	CHECK(server.count() ==0,"%u clients at the end",server.count());
+}
+
+// lines are sent as fast as they are queued, the peer acknowledges at random
+static void loopback(void)
+{
+	TestServer server;
+	AsyncClient *client=server.connect();
+	Peer peer(client);
+	uint32_t sent=0;
+	for(uint32_t seq=0;seq < LoopbackLines;seq++){
+		std::string line=statusLine(seq);
+		server.send(line.data(),line.size());
+		sent++;
+		if(rnd(4) ==0) client->poll();
+		if(rnd(3) ==0) CHECK(peer.take(rnd(client->wire.size() + 1)),"at line %u",seq);
+	}
+	// the rest of the queue goes out as the peer acknowledges it
+	for(int i=0;i<100 && !client->wire.empty();i++)
+		CHECK(peer.take(client->wire.size()),"draining");
+	CHECK(peer.idle(),"%u bytes left on the wire",(unsigned)client->wire.size());
+	uint16_t dropped=server.client()->dropped();
+	CHECK(peer.lines + dropped == sent,"%u lines arrived, %u dropped, %u sent",peer.lines,dropped,sent);
+	printf("loopback: %u lines, %u dropped\n",peer.lines,dropped);
+	client->disconnect();
+}
+
+static void commands(void)
+{
+	TestServer server;
+	AsyncClient *client=server.connect();
+	std::vector<std::string> lines;
+	std::string stream;
+	for(int i=0;i<20000;i++){
+		std::string line;
+		switch(rnd(4)){
+		case 0: line="j{mode:b,beerSet:" + std::to_string(rnd(300)) + "}"; break;
+		case 1: line="t"; break;
+		case 2: line=std::string(rnd(BrewPiTcpLineSize + 8),'x'); break;
+		default: line="j{\"beerSet\":\"20." + std::to_string(rnd(100)) + "\"}"; break;
+		}
+		// telnet: WILL/DONT with an option, or a two byte command
+		if(rnd(4) ==0) stream += rnd(2)? "\xFF\xFB\x18":"\xFF\xF1";
+		stream += line;
+		stream += rnd(2)? "\r\n":"\n";
+		// an overlong line is dropped, an empty one is not passed on
+		if(!line.empty() && line.size() < BrewPiTcpLineSize) lines.push_back(line);
+	}
+	received.clear();
+	for(size_t pos=0;pos < stream.size();){
+		size_t part=1 + rnd(1460);
+		if(part > stream.size() - pos) part=stream.size() - pos;
+		client->receive(stream.data() + pos,part);
+		pos += part;
+	}
+	CHECK(received.size() == lines.size(),"%u commands, %u expected",(unsigned)received.size(),(unsigned)lines.size());
+	for(size_t i=0;i<lines.size();i++)
+		CHECK(received[i] == lines[i],"command %u is \"%s\", expected \"%s\"",(unsigned)i,received[i].c_str(),lines[i].c_str());
+	client->disconnect();
+}
+
+static void bench(void)
+{
+	TestServer server;
+	AsyncClient *client=server.connect();
+	std::string line=statusLine(12345);
+
+	// a peer that keeps up: everything on the wire is acknowledged after each line
+	auto start=std::chrono::steady_clock::now();
+	for(int i=0;i<BenchLines;i++){
+		server.send(line.data(),line.size());
+		client->take(client->wire.size());
+	}
+	double t=seconds(start);
+	printf("send, ack per line: %.0f lines/s\n",BenchLines / t);
+
+	// a delayed ack, every 8 lines: fewer, larger adds
+	start=std::chrono::steady_clock::now();
+	for(int i=0;i<BenchLines;i++){
+		server.send(line.data(),line.size());
+		if(i % 8 == 7) client->take(client->wire.size());
+	}
+	t=seconds(start);
+	printf("send, ack per 8 lines: %.0f lines/s, %u dropped\n",BenchLines / t,server.client()->dropped());
+
+	std::string stream;
+	for(int i=0;i<1000;i++) stream += "j{\"mode\":\"b\",\"beerSet\":\"20.50\"}\r\n";
+	start=std::chrono::steady_clock::now();
+	for(int i=0;i < BenchLines / 1000;i++){
+		received.clear();
+		for(size_t pos=0;pos < stream.size();pos += 1460)
+			client->receive(stream.data() + pos,(stream.size() - pos < 1460)? (stream.size() - pos):1460);
+	}
+	t=seconds(start);
+	printf("receive: %.0f lines/s\n",BenchLines / t);
+	client->disconnect();
+}
+
+int main(int argc,char* argv[])
+{
+	if(benchArgument(argc,argv)){
+		bench();
+		return 0;
+	}
+	clients();
+	loopback();
+	commands();
+	return testResult();
+}
@@ -0,0 +1,202 @@
+#include <math.h>
+#include <string.h>
+#include "BrewLogDecoder.h"
+
+#define StartLogTag 0xFF
+#define ResumeBrewTag 0xFE
+#define PeriodTag 0xF0
+#define StageTag 0xF1
+#define EventTag 0xF2
+#define ModeTag 0xF4
+#define DeltaPeriodTag 0xF5
+#define OriginGravityTag 0xF8
+
+#define INVALID_TEMP_INT 0x7FFF
+
+BrewLogDecoder::BrewLogDecoder(BrewLogListener *listener):_listener(listener),_error(NULL),_truncated(false),
+	_offset(0),_samples(0),_started(false),_time(0),_carryLen(0)
+{
+	memset(&_header,0,sizeof(_header));
+	for(int i=0;i<BrewLogChannelNumber;i++) _raw[i]=INVALID_TEMP_INT;
+	memset(&_sample,0,sizeof(_sample));
+	_sample.mode=' ';
+	_sample.originGravity=NAN;
+}
+
+size_t BrewLogDecoder::recordLength(const uint8_t *ptr,size_t avail)
+{
+	if(avail < 2) return 0;
+	uint8_t tag=ptr[0];
+	uint8_t mask=ptr[1];
+	size_t len=2;
+	if(tag == PeriodTag){
+		for(int i=0;i<BrewLogChannelNumber;i++) if(mask & (1<<i)) len +=2;
+	}else if(tag == DeltaPeriodTag){
+		for(int i=0;i<BrewLogChannelNumber;i++){
+			if(!(mask & (1<<i))) continue;
+			if(i < BrewLogAuxTemp){
+				for(int n=0;;n++){
+					if(n == BrewLogMaxVarintSize) return BrewLogInvalidRecord;
+					if(len >= avail) return 0;
+					if(!(ptr[len++] & 0x80)) break;
+				}
+			}else{
+				len +=2;
+			}
+		}
+	}else if(tag == StartLogTag){
+		len=8;
+	}else if(tag == ResumeBrewTag || tag == OriginGravityTag){
+		len=4;
+	}
+	return (len <= avail)? len:0;
+}
+
+float BrewLogDecoder::decodeTemperature(uint16_t raw)
+{
+	if(raw == INVALID_TEMP_INT) return NAN;
+	// 0 ~ 225 as it is, -100 ~ 0 as 22500 - t
+	int v=(raw >= 22500)? (22500 - (int)raw):(int)raw;
+	return (float)v / 100.0f;
+}
+
+float BrewLogDecoder::decodeGravity(uint16_t raw)
+{
+	if(raw == INVALID_TEMP_INT) return NAN;
+	// the same as the chart: specific gravity * 10000, or plato * 1000
+	return (raw > 8000)? (float)raw / 10000.0f:(float)raw / 1000.0f;
+}
+
+bool BrewLogDecoder::feed(const uint8_t *data,size_t len)
+{
+	if(_error) return false;
+	// complete the record left from the last chunk
+	while(_carryLen > 0 && len > 0){
+		_carry[_carryLen++] = *data++;
+		len--;
+		size_t rlen=recordLength(_carry,_carryLen);
+		if(rlen == BrewLogInvalidRecord){
+			_error="invalid record";
+			return false;
+		}else if(rlen){
+			if(!process(_carry,rlen)) return false;
+			_carryLen=0;
+		}else if(_carryLen == sizeof(_carry)){
+			_error="invalid record";
+			return false;
+		}
+	}
+
+	size_t idx=0;
+	while(idx < len){
+		size_t rlen=recordLength(data + idx,len - idx);
+		if(rlen ==0) break;
+		if(rlen == BrewLogInvalidRecord){
+			_error="invalid record";
+			return false;
+		}
+		if(!process(data + idx,rlen)) return false;
+		idx += rlen;
+	}
+	// an incomplete record is shorter than the longest one
+	if(len - idx >= sizeof(_carry)){
+		_error="invalid record";
+		return false;
+	}
+	_carryLen = len - idx;
+	memcpy(_carry,data + idx,_carryLen);
+	return true;
+}
+
+bool BrewLogDecoder::finish(void)
+{
+	if(_error) return false;
+	if(_carryLen){
+		_error="incomplete record at the end";
+		_truncated=true;
+		return false;
+	}
+	return true;
+}
+
+bool BrewLogDecoder::process(const uint8_t *ptr,size_t len)
+{
+	uint8_t tag=ptr[0];
+	if(!_started && tag != StartLogTag){
+		_error="no log header";
+		return false;
+	}
+	if(tag == StartLogTag){
+		uint8_t version=ptr[1] & 0x0F;
+		if(version != 5 && version != 6){
+			_error="unsupported log version";
+			return false;
+		}
+		_header.version = version;
+		_header.fahrenheit = (ptr[1] & 0x10) != 0;
+		_header.period = (ptr[2] << 8) | ptr[3];
+		_header.starttime = ((uint32_t)ptr[4] << 24) | ((uint32_t)ptr[5] << 16) | ((uint32_t)ptr[6] << 8) | ptr[7];
+		_time = _header.starttime;
+		_started=true;
+		if(_listener) _listener->onHeader(_header);
+	}else if(tag == PeriodTag || tag == DeltaPeriodTag){
+		if(tag == DeltaPeriodTag && _header.version < 6){
+			_error="delta record in version 5 log";
+			return false;
+		}
+		period(ptr);
+	}else if(tag == ResumeBrewTag){
+		uint32_t gap=((uint32_t)ptr[1] << 16) | (ptr[2] << 8) | ptr[3];
+		_time = _header.starttime + gap;
+		if(_listener) _listener->onResume(_time);
+	}else if(tag == OriginGravityTag){
+		_sample.originGravity = decodeGravity(((ptr[2] & 0x7F) << 8) | ptr[3]);
+	}else if(tag == ModeTag){
+		_sample.mode = (char)ptr[1];
+	}else if(tag == StageTag){
+		_sample.state = ptr[1];
+	}else if(tag == EventTag){
+		// filler of the volatile log, two bytes
+	}else{
+		_error="unknown tag";
+		return false;
+	}
+	_offset += len;
+	return true;
+}
+
+void BrewLogDecoder::period(const uint8_t *ptr)
+{
+	uint8_t tag=ptr[0];
+	uint8_t mask=ptr[1];
+	int idx=2;
+	for(int i=0;i<BrewLogChannelNumber;i++){
+		if(!(mask & (1<<i))){
+			// aux temperature and gravity are not repeated
+			if(i >= BrewLogAuxTemp) _raw[i]=INVALID_TEMP_INT;
+			continue;
+		}
+		if(tag == DeltaPeriodTag && i < BrewLogAuxTemp){
+			uint32_t z=0;
+			int shift=0;
+			uint8_t b;
+			do{
+				b=ptr[idx++];
+				z |= (uint32_t)(b & 0x7F) << shift;
+				shift += 7;
+			}while(b & 0x80);
+			int delta=(z & 1)? -(int)((z+1) >>1):(int)(z >>1);
+			_raw[i] = (uint16_t)(_raw[i] + delta);
+		}else{
+			_raw[i] = ((ptr[idx] & 0x7F) << 8) | ptr[idx+1];
+			idx +=2;
+		}
+	}
+
+	_sample.time = _time;
+	for(int i=0;i<BrewLogGravity;i++) _sample.value[i]=decodeTemperature(_raw[i]);
+	_sample.value[BrewLogGravity]=decodeGravity(_raw[BrewLogGravity]);
+	_time += _header.period;
+	_samples ++;
+	if(_listener) _listener->onSample(_sample);
+}
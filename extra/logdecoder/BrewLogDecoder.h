@@ -0,0 +1,97 @@
+#ifndef BrewLogDecoder_H
+#define BrewLogDecoder_H
+#include <stdint.h>
+#include <stddef.h>
+
+// host side decoder of BrewLogger binary logs, version 5 and 6.
+// Data are fed in chunks of any size; only a partial record is kept between
+// chunks, so a log of any size is decoded in constant memory.
+
+#define BrewLogChannelNumber 7
+
+#define BrewLogBeerSet 0
+#define BrewLogBeerTemp 1
+#define BrewLogFridgeTemp 2
+#define BrewLogFridgeSet 3
+#define BrewLogRoomTemp 4
+#define BrewLogAuxTemp 5
+#define BrewLogGravity 6
+
+// recordLength() of a record that can't be right
+#define BrewLogInvalidRecord ((size_t)-1)
+// a zigzag 16 bit delta never needs more
+#define BrewLogMaxVarintSize 3
+
+// one period record, with the mode, state and OG in effect.
+// Invalid or missing values are NAN.
+typedef struct _BrewLogSample{
+	uint32_t time;
+	float    value[BrewLogChannelNumber];
+	char     mode;
+	uint8_t  state;
+	float    originGravity;
+} BrewLogSample;
+
+typedef struct _BrewLogHeader{
+	uint8_t  version;
+	bool     fahrenheit;
+	uint16_t period;
+	uint32_t starttime;
+} BrewLogHeader;
+
+class BrewLogListener
+{
+public:
+	virtual ~BrewLogListener(){}
+	virtual void onHeader(const BrewLogHeader& header){}
+	virtual void onSample(const BrewLogSample& sample)=0;
+	// time the log is resumed after a gap
+	virtual void onResume(uint32_t time){}
+};
+
+class BrewLogDecoder
+{
+public:
+	BrewLogDecoder(BrewLogListener *listener);
+
+	// false on a format error, see error()
+	bool feed(const uint8_t *data,size_t len);
+	// false if the log ends in the middle of a record
+	bool finish(void);
+
+	const char *error(void) const { return _error; }
+	// the only error is a partial record at the end, like a log cut by power failure
+	bool truncated(void) const { return _truncated; }
+	// offset of the error or the next record
+	uint64_t offset(void) const { return _offset; }
+	uint64_t sampleCount(void) const { return _samples; }
+
+	// length of the record at ptr, 0 if it is not complete in avail bytes,
+	// BrewLogInvalidRecord if a varint is longer than BrewLogMaxVarintSize
+	static size_t recordLength(const uint8_t *ptr,size_t avail);
+	// same encoding as BrewLogger::convertTemperature()
+	static float decodeTemperature(uint16_t raw);
+	static float decodeGravity(uint16_t raw);
+
+private:
+	BrewLogListener *_listener;
+	const char *_error;
+	bool _truncated;
+	uint64_t _offset;
+	uint64_t _samples;
+
+	bool _started;
+	BrewLogHeader _header;
+	uint32_t _time;
+	uint16_t _raw[BrewLogChannelNumber];
+	BrewLogSample _sample;
+
+	// the longest record: DeltaPeriodTag of five 3-byte varints, ext temp and gravity
+	uint8_t _carry[21];
+	size_t _carryLen;
+
+	bool process(const uint8_t *ptr,size_t len);
+	void period(const uint8_t *ptr);
+};
+
+#endif
@@ -0,0 +1,279 @@
+// bpllog: convert BrewPiLess logs to CSV or column files.
+//
+//  bpllog [-f csv|col|none] [-o output] [-b] log...
+//
+//  csv : time,beerSet,beerTemp,fridgeTemp,fridgeSet,roomTemp,auxTemp,gravity,mode,state,og
+//        to stdout, or to the output file, with one header line for all
+//        the logs. Invalid values are empty.
+//  col : one little endian file per column, <output>.<column>.
+//        time is uint32, mode and state are uint8, the others are float32 (NaN if invalid).
+//        output defaults to the log file name.
+//  none: decode only
+//  -b  : print throughput to stderr
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "BrewLogDecoder.h"
+
+#define ReadBufferSize 65536
+#define ColumnBufferSize 16384
+
+static const char *ColumnNames[BrewLogChannelNumber]={
+	"beerSet","beerTemp","fridgeTemp","fridgeSet","roomTemp","auxTemp","gravity"};
+
+class CsvWriter: public BrewLogListener
+{
+public:
+	CsvWriter(FILE *out):_out(out),_header(false){}
+	// one header line for all the logs
+	void onHeader(const BrewLogHeader& header)
+	{
+		if(_header) return;
+		_header=true;
+		fputs("time",_out);
+		for(int i=0;i<BrewLogChannelNumber;i++) fprintf(_out,",%s",ColumnNames[i]);
+		fputs(",mode,state,og\n",_out);
+	}
+	void onSample(const BrewLogSample& s)
+	{
+		char line[160];
+		char *p=line;
+		p = putInt(p,s.time);
+		for(int i=0;i<BrewLogChannelNumber;i++){
+			*p++ = ',';
+			if(!isnan(s.value[i])) p = putFixed(p,s.value[i],(i == BrewLogGravity)? 4:2);
+		}
+		*p++ = ',';
+		*p++ = s.mode;
+		*p++ = ',';
+		p = putInt(p,s.state);
+		*p++ = ',';
+		if(!isnan(s.originGravity)) p = putFixed(p,s.originGravity,4);
+		*p++ = '\n';
+		fwrite(line,1,p - line,_out);
+	}
+private:
+	FILE *_out;
+	bool _header;
+
+	// printf is the bottleneck, values are fixed point in the log anyway.
+	static char *putInt(char *p,uint32_t v)
+	{
+		char digits[10];
+		int n=0;
+		do{
+			digits[n++] = '0' + v % 10;
+			v /= 10;
+		}while(v);
+		while(n) *p++ = digits[--n];
+		return p;
+	}
+
+	static char *putFixed(char *p,float v,int decimals)
+	{
+		uint32_t scale=(decimals == 4)? 10000:100;
+		long fixed=lrintf(v * scale);
+		if(fixed < 0){
+			*p++ = '-';
+			fixed = -fixed;
+		}
+		p = putInt(p,fixed / scale);
+		*p++ = '.';
+		uint32_t frac=fixed % scale;
+		for(uint32_t d=scale/10;d >0;d /= 10){
+			*p++ = '0' + (frac / d) % 10;
+		}
+		return p;
+	}
+};
+
+// a column file, written in large blocks
+class ColumnFile
+{
+public:
+	ColumnFile(void):_file(NULL),_len(0){}
+	~ColumnFile(){ close(); }
+	bool open(const char *prefix,const char *column)
+	{
+		char path[1024];
+		snprintf(path,sizeof(path),"%s.%s",prefix,column);
+		_file=fopen(path,"wb");
+		if(!_file) fprintf(stderr,"error open %s\n",path);
+		return _file != NULL;
+	}
+	void close(void)
+	{
+		if(!_file) return;
+		flush();
+		fclose(_file);
+		_file=NULL;
+	}
+	void put8(uint8_t v)
+	{
+		if(_len + 1 > ColumnBufferSize) flush();
+		_buffer[_len++] = v;
+	}
+	void put32(uint32_t v)
+	{
+		if(_len + 4 > ColumnBufferSize) flush();
+		_buffer[_len++] = (uint8_t)v;
+		_buffer[_len++] = (uint8_t)(v >> 8);
+		_buffer[_len++] = (uint8_t)(v >> 16);
+		_buffer[_len++] = (uint8_t)(v >> 24);
+	}
+	void putFloat(float v)
+	{
+		uint32_t u;
+		memcpy(&u,&v,4);
+		put32(u);
+	}
+private:
+	FILE *_file;
+	uint8_t _buffer[ColumnBufferSize];
+	size_t _len;
+
+	void flush(void)
+	{
+		fwrite(_buffer,1,_len,_file);
+		_len=0;
+	}
+};
+
+class ColumnWriter: public BrewLogListener
+{
+public:
+	ColumnWriter(const char *prefix):_ok(true)
+	{
+		_ok = _time.open(prefix,"time") && _ok;
+		for(int i=0;i<BrewLogChannelNumber;i++) _ok = _value[i].open(prefix,ColumnNames[i]) && _ok;
+		_ok = _mode.open(prefix,"mode") && _ok;
+		_ok = _state.open(prefix,"state") && _ok;
+		_ok = _og.open(prefix,"og") && _ok;
+	}
+	bool ok(void) const { return _ok; }
+	void onSample(const BrewLogSample& s)
+	{
+		_time.put32(s.time);
+		for(int i=0;i<BrewLogChannelNumber;i++) _value[i].putFloat(s.value[i]);
+		_mode.put8((uint8_t)s.mode);
+		_state.put8(s.state);
+		_og.putFloat(s.originGravity);
+	}
+private:
+	bool _ok;
+	ColumnFile _time;
+	ColumnFile _value[BrewLogChannelNumber];
+	ColumnFile _mode;
+	ColumnFile _state;
+	ColumnFile _og;
+};
+
+class NullWriter: public BrewLogListener
+{
+public:
+	void onSample(const BrewLogSample& s){}
+};
+
+static void usage(void)
+{
+	fprintf(stderr,"usage: bpllog [-f csv|col|none] [-o output] [-b] log...\n");
+	exit(2);
+}
+
+// returns number of bytes decoded, or -1 on error
+static long long decodeFile(const char *path,BrewLogListener *listener)
+{
+	FILE *in=fopen(path,"rb");
+	if(!in){
+		fprintf(stderr,"error open %s\n",path);
+		return -1;
+	}
+	static uint8_t buffer[ReadBufferSize];
+	BrewLogDecoder decoder(listener);
+	long long total=0;
+	size_t len;
+	bool ok=true;
+	while(ok && (len=fread(buffer,1,sizeof(buffer),in)) > 0){
+		ok=decoder.feed(buffer,len);
+		total += len;
+	}
+	fclose(in);
+	if(ok) ok=decoder.finish();
+	if(!ok){
+		fprintf(stderr,"%s: %s at offset %llu\n",path,decoder.error(),(unsigned long long)decoder.offset());
+		// a log cut by power failure ends in a partial record, the rest is good.
+		// Anything else is corruption.
+		if(!decoder.truncated() || decoder.offset() ==0) return -1;
+	}
+	return total;
+}
+
+int main(int argc,char **argv)
+{
+	const char *format="csv";
+	const char *output=NULL;
+	bool bench=false;
+	int i=1;
+	for(;i<argc && argv[i][0] == '-';i++){
+		if(strcmp(argv[i],"-f") ==0 && i+1 < argc) format=argv[++i];
+		else if(strcmp(argv[i],"-o") ==0 && i+1 < argc) output=argv[++i];
+		else if(strcmp(argv[i],"-b") ==0) bench=true;
+		else usage();
+	}
+	if(i >= argc) usage();
+	bool csv=strcmp(format,"csv") ==0;
+	bool col=strcmp(format,"col") ==0;
+	if(!csv && !col && strcmp(format,"none") !=0) usage();
+	if(col && output && argc - i > 1){
+		fprintf(stderr,"-o with one log only for col\n");
+		return 2;
+	}
+
+	FILE *out=stdout;
+	if(csv && output){
+		out=fopen(output,"w");
+		if(!out){
+			fprintf(stderr,"error open %s\n",output);
+			return 1;
+		}
+	}
+
+	int ret=0;
+	long long bytes=0;
+	struct timespec begin,end;
+	clock_gettime(CLOCK_MONOTONIC,&begin);
+	// the logs go to one CSV
+	CsvWriter *csvWriter=csv? new CsvWriter(out):NULL;
+	for(;i<argc;i++){
+		BrewLogListener *listener;
+		if(csv) listener=csvWriter;
+		else if(col){
+			ColumnWriter *writer=new ColumnWriter(output? output:argv[i]);
+			if(!writer->ok()){
+				delete writer;
+				ret=1;
+				continue;
+			}
+			listener=writer;
+		}
+		else listener=new NullWriter();
+
+		long long len=decodeFile(argv[i],listener);
+		if(listener != csvWriter) delete listener;
+		if(len <0) ret=1;
+		else bytes += len;
+	}
+	delete csvWriter;
+	if(out != stdout) fclose(out);
+	else fflush(out);
+	clock_gettime(CLOCK_MONOTONIC,&end);
+
+	if(bench){
+		double seconds=(end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) / 1e9;
+		fprintf(stderr,"%lld bytes in %.3f s, %.1f MB/s\n",bytes,seconds,
+			(seconds > 0)? bytes / seconds / 1e6:0.0);
+	}
+	return ret;
+}
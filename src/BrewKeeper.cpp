@@ -5,6 +5,7 @@
 #include "BrewPiProxy.h"
 #include "BrewKeeper.h"
 #include "mystrlib.h"
+#include "FileCache.h"
 
 #if EnableGravitySchedule
 
@@ -47,16 +48,8 @@ void BrewKeeper::keep(time_t now)
 
 	if(IS_INVALID_CONTROL_TEMP(temp)) return;
 	if(OUT_OF_RANGE(temp,beerSet,MINIMUM_TEMPERATURE_STEP)){
-		// set temp
-		//_write("j{beerSet:" + temp + "}");
-		char buff[36];
-		strcpy(buff,"j{beerSet:");
-		int len=strlen(buff);
-		len+=sprintFloat(buff+len,temp,2);
-		strcpy(buff+len,"}");
-
-		//BPSerial.print(buff);
-		_write(buff);
+		// set temp, directly instead of "j{beerSet:...}"
+		brewPi.setBeerSetting(temp);
 
 	}
 }
@@ -265,7 +258,7 @@ void BrewProfile::setOriginalGravity(float gravity){
 #define MAX_BREWING_STATE_LEN 256
 
 void BrewProfile::_saveBrewingStatus(void){
-	File pf=SPIFFS.open(BrewStatusFile,"w");
+	File pf=FileCache.openToWrite(BrewStatusFile);
 	if(pf){
 	    int ogpoints=(int) round(_OGPoints * 1000.0);
 		const int STATUS_JSON_BUFFER_SIZE =  2 *JSON_OBJECT_SIZE(4) + JSON_OBJECT_SIZE(3);
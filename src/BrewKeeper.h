@@ -104,15 +104,14 @@ protected:
 	Gravity _lastGravity;
 #endif
 
-	void (*_write)(const char*);
 	void _loadProfile(void);
 public:
 #if EnableGravitySchedule
-	BrewKeeper(void(*puts)(const char*)):_filename(""),_write(puts),_lastGravity(INVALID_GRAVITY){}
+	BrewKeeper(void):_filename(""),_lastGravity(INVALID_GRAVITY){}
 	void updateGravity(float sg){ _lastGravity=FloatToGravity(sg);}
 	void updateOriginalGravity(float sg){ _profile.setOriginalGravity(sg); }
 #else
-	BrewKeeper(void(*puts)(const char*)):_filename(""),_write(puts){}
+	BrewKeeper(void):_filename(""){}
 #endif
 	void setFile(String filename){_filename=filename;}
 	void keep(time_t now);
@@ -3,6 +3,10 @@
 #include <FS.h>
 
 #include "TimeKeeper.h"
+#include "GravityTracker.h"
+#include "FileCache.h"
+#include "JsonWriter.h"
+#include "Metrics.h"
 
 #define INVALID_RECOVERY_TIME 0xFF
 #define INVALID_TEMPERATURE -250
@@ -11,9 +15,44 @@
 #define LOG_PATH "/log"
 #define LOG_RECORD_FILE "/loginfo"
 #define MAX_FILE_NUMBER 10
+// sparse time index of a log, "/log/<name>.i"
+#define LOG_INDEX_EXT ".i"
+// number of period records between time index entries
+#define LogIndexInterval 60
+// records not yet in the log file, "/log/<name>.j"
+#define LOG_JOURNAL_EXT ".j"
+// log file is written in whole SPIFFS pages
+#define LogFlushSize 256
+// journal frame: magic, offset(4), length(2), data, checksum(2)
+#define JournalMagic 0xA5
+#define JournalHeaderSize 7
+// resume state, "/log/<name>.c", saved with every time index entry
+#define LOG_CHECKPOINT_EXT ".c"
+#define LogCheckpointMagic 0x42504C43
+// hourly and daily summary of channels, "/log/<name>.h" and "/log/<name>.d"
+#define LOG_HOUR_ROLLUP_EXT ".h"
+#define LOG_DAY_ROLLUP_EXT ".d"
+#define RollupHour 0
+#define RollupDay 1
+// beer, fridge, room, aux temperature and gravity
+#define RollupChannelNumber 5
 
 #define LogBufferSize 1024
 
+// log format version, in the low nibble of the StartLogTag header byte.
+// version 5: PeriodTag records of absolute values only.
+// version 6: DeltaPeriodTag records with PeriodTag keyframes.
+#define LogFormatVersion 6
+#define DeltaLogVersion 6
+// period records between absolute PeriodTag keyframes
+#define LogKeyframeInterval 30
+// DeltaPeriodTag: five 3-byte varints + ext temp + gravity
+#define LogMaxRecordSize 21
+// a zigzag 16 bit delta never needs more
+#define LogMaxVarintSize 3
+// recordLength() of a record that can't be right
+#define InvalidLogRecord ((size_t)-1)
+
 #define StartLogTag 0xFF
 #define ResumeBrewTag 0xFE
 #define PeriodTag 0xF0
@@ -21,6 +60,8 @@
 #define EventTag 0xF2
 //#define SetPointTag 0xF3
 #define ModeTag 0xF4
+// mask, zig-zag varint deltas of temperatures(0~4), absolute ext temp & gravity
+#define DeltaPeriodTag 0xF5
 //#define BeerSetPointTag 0xF7
 #define OriginGravityTag 0xF8
 //#define AuxTempTag 0xF9
@@ -29,6 +70,28 @@
 #define INVALID_GRAVITY_INT 0x7FFF
 
 #define VolatileHeaderSize 28
+// the volatile header with a ResumeBrewTag before the values
+#define RangeHeaderSize (VolatileHeaderSize + 4)
+
+// period slots kept while not recording, 48 slots = 48 minutes at 1 minute period.
+// A slot takes 16 bytes and an event 8. They share the RAM of the log buffer,
+// and the defaults fit in it (960 of LogBufferSize bytes). With more, RAM grows
+// by 16 * VolatileLogSlots + 8 * VolatileLogEvents - LogBufferSize bytes,
+// e.g. 1440 slots (24 hours) take 28.8KB more.
+#ifndef VolatileLogSlots
+#define VolatileLogSlots 48
+#endif
+// mode, state and OG changes within the slots
+#ifndef VolatileLogEvents
+#define VolatileLogEvents (VolatileLogSlots/2)
+#endif
+#if VolatileLogSlots > 2048
+#error "VolatileLogSlots too large"
+#endif
+// start tag, mode and state in front of volatile data of a fresh load
+#define VolatileLeadSize 12
+// a full period record with mode, state and OG changes
+#define VolatileUnitSize 24
 
 #define OrderBeerSet 0
 #define OrderBeerTemp 1
@@ -46,6 +109,80 @@ typedef struct _FileIndexEntry{
 	unsigned long time;
 } FileIndexEntry;
 
+// time index entry, points to the end of a PeriodTag record
+// and carries the full channel values after that record.
+typedef struct _LogIndexEntry{
+	uint32_t time;
+	uint32_t offset;
+	uint16_t data[7];
+	uint8_t  mode;
+	uint8_t  state;
+} LogIndexEntry;
+
+// a finished hour or day, appended to the rollup file as it is (little endian).
+// time is the start of the hour/day in UTC. Values are in the unit of the log,
+// temperature * 100 and gravity * 10000. count is 0 for channels without data.
+typedef struct _RollupEntry{
+	uint32_t time;
+	int16_t  min[RollupChannelNumber];
+	int16_t  max[RollupChannelNumber];
+	int16_t  mean[RollupChannelNumber];
+	uint16_t count[RollupChannelNumber];
+} RollupEntry;
+
+// the hour or day in progress
+typedef struct _RollupAccumulator{
+	uint32_t time;
+	int32_t  sum[RollupChannelNumber];
+	int16_t  min[RollupChannelNumber];
+	int16_t  max[RollupChannelNumber];
+	uint16_t count[RollupChannelNumber];
+} RollupAccumulator;
+
+// state of a log at a record boundary, to resume without scanning the whole log.
+typedef struct _LogCheckpoint{
+	uint32_t magic;
+	uint32_t starttime;
+	uint32_t length;
+	uint32_t time;
+	uint16_t data[5];
+	uint8_t  version;
+	uint8_t  reserved;
+	GravityTrackerState gravity;
+	RollupAccumulator rollup[2];
+	uint16_t checksum;
+} LogCheckpoint;
+
+// one period of the volatile log. pos is the lower 16 bits of its stream position
+typedef struct _VolatileSlot{
+	uint16_t data[7];
+	uint16_t pos;
+} VolatileSlot;
+
+// mode, state or OG change after the slot of seq
+typedef struct _VolatileEvent{
+	uint32_t seq;
+	uint8_t  tag;
+	uint16_t value;
+} VolatileEvent;
+
+// read position of a volatile log request
+typedef struct _VolatileCursor{
+	uint8_t  headerSize;
+	uint8_t  headerSent;
+	uint8_t  unitOffset;
+	uint8_t  unitLength;
+	uint32_t seq;
+	// stream position of the next byte; the end and the slot after the last,
+	// fixed at the start
+	uint32_t pos;
+	uint32_t end;
+	uint32_t endSeq;
+	char     header[VolatileLeadSize];
+	// the unit being sent, it stays complete even if its slot is dropped
+	uint8_t  unit[VolatileUnitSize];
+} VolatileCursor;
+
 typedef struct _FileIndexes
 {
 	FileIndexEntry files[MAX_FILE_NUMBER];
@@ -59,9 +196,22 @@ class BrewLogger
 public:
 	BrewLogger(void){
 		_recording=false;
-		_isFileOpen=false;
 		_fsspace=0;
 		_tempLogPeriod=60000;
+		_logVersion=LogFormatVersion;
+		_logFahrenheit=false;
+		_periodsToKeyframe=0;
+		_flushedIndex=0;
+		_journalIndex=0;
+		_bytesLogged=0;
+		_bytesWritten=0;
+		_writeCount=0;
+		_slotHead=0;
+		_slotCount=0;
+		_headSeq=0;
+		_eventHead=0;
+		_eventCount=0;
+		_headPos=_nextPos=VolatileLeadSize;
 		resetTempData();
 	}
 	void begin(void)
@@ -80,40 +230,42 @@ public:
 		}
 	}
 
-	String fsinfo(void)
+	void fsinfo(JsonWriter& json)
 	{
 		FSInfo fs_info;
 		SPIFFS.info(fs_info);
-		String ret=String("{\"size\":") + String(fs_info.totalBytes)
-			+",\"used\":"  + String(fs_info.usedBytes)
-			+",\"block\":" + String(fs_info.blockSize)
-			+",\"page\":"  + String(fs_info.pageSize)
-			+"}";
-		return ret;
+		json.beginObject();
+		json.add("size",(uint32_t)fs_info.totalBytes);
+		json.add("used",(uint32_t)fs_info.usedBytes);
+		json.add("block",(uint32_t)fs_info.blockSize);
+		json.add("page",(uint32_t)fs_info.pageSize);
+		json.endObject();
 	}
 
-	String loggingStatus(void)
+	void loggingStatus(JsonWriter& json)
 	{
 		// populate JS
-		String ret=String("{\"rec\":");
+		json.beginObject();
 		if(_fileInfo.logname[0] != 0){
-			ret += "1, \"log\":\"" + String(_fileInfo.logname)
-				+"\",\"start\":" + String(_fileInfo.starttime);
+			json.add("rec",(int32_t)1);
+			json.add("log",_fileInfo.logname);
+			json.add("start",(uint32_t)_fileInfo.starttime);
 		}else{
-			ret += "0";
+			json.add("rec",(int32_t)0);
 		}
-		ret += ",\"fs\":" + fsinfo();
-		ret += ",\"list\":[";
-
+		json.key("fs");
+		fsinfo(json);
+		json.key("list");
+		json.beginArray();
 		for(int i=0;i<MAX_FILE_NUMBER;i++){
 			if(_fileInfo.files[i].name[0] == 0) break;
-			if(i!=0) ret +=",";
-			ret +="{\"name\":\"" + String(_fileInfo.files[i].name);
-			ret +="\",\"time\":" +String(_fileInfo.files[i].time) +"}";
+			json.beginObject();
+			json.add("name",_fileInfo.files[i].name);
+			json.add("time",(uint32_t)_fileInfo.files[i].time);
+			json.endObject();
 		}
-		ret += "]}";
-
-		return ret;
+		json.endArray();
+		json.endObject();
 	}
 
 	void rmLog(int index)
@@ -124,6 +276,13 @@ public:
 		sprintf(buff,"%s/%s",LOG_PATH,_fileInfo.files[index].name);
 		SPIFFS.remove(buff);
 		DBG_PRINTF("remove %d: %s\n",index,buff);
+		indexFilePath(buff,_fileInfo.files[index].name);
+		SPIFFS.remove(buff);
+		rollupFilePath(buff,_fileInfo.files[index].name,RollupHour);
+		SPIFFS.remove(buff);
+		rollupFilePath(buff,_fileInfo.files[index].name,RollupDay);
+		SPIFFS.remove(buff);
+		FileCache.invalidate(LOG_PATH "/");
 		int i;
 		for(i=index+1;i<MAX_FILE_NUMBER;i++){
 			if(_fileInfo.files[i].name[0]=='\0') break;
@@ -140,60 +299,55 @@ public:
 
     void initProcessSavedData(void){
         _resumeLastLogTime = _fileInfo.starttime;
+        resetRollups();
     }
     size_t processSavedData(char *buffer,size_t size)
     {
         size_t idx=0;
-        uint8_t tag,mask;
 
         while(idx < size)
         {
-            // read tag
-			tag =_logBuffer[idx++];
-		    mask=_logBuffer[idx++];
-			if(tag == PeriodTag){
+			const uint8_t *ptr=(const uint8_t*)buffer + idx;
+			size_t len=recordLength(ptr,size - idx);
+			// not enough data for this record!
+			// return and wait for more data
+			if(len == 0) return idx;
+			if(len == InvalidLogRecord){
+				// corrupt, look for the next record from the next byte
+				DBG_PRINTF("invalid record @%d\n",idx);
+				idx++;
+				continue;
+			}
+
+			uint8_t tag=ptr[0];
+			uint8_t mask=ptr[1];
+			if(tag == PeriodTag || tag == DeltaPeriodTag){
+				// the values written after the checkpoint
+				uint16_t values[7];
+				for(int i=0;i<5;i++) values[i]=_iTempData[i];
+				values[OrderExtTemp]=INVALID_TEMP_INT;
+				values[OrderGravity]=INVALID_GRAVITY_INT;
+				decodePeriodRecord(ptr,values);
+				for(int i=0;i<5;i++) _iTempData[i]=values[i];
+				// entries already in the rollup files are not added again
+				rollupAdd(_resumeLastLogTime,values);
 		        _resumeLastLogTime += _tempLogPeriod/1000;
-		        int numberInRecord=0;
-
-		        for(int i=0;i<7;i++) if(mask & (1<<i)) numberInRecord +=2;
-
-		        if((numberInRecord + idx) > size){
-		            // not enough data for this record!
-		            // rewind and return
-		            return idx - 2;
-		        }else{
-		            if(mask & (1<<OrderGravity)){
-		                size_t ridx = idx;
-        		        for(int i=0;i<7;i++){
-	        		        if(mask & (1<<i)){
-		        		        if( i == OrderGravity){
-			        	    	    byte d0=_logBuffer[ridx];
-    			        	        byte d1=_logBuffer[ridx+1];
-    				                int gravityInt = (d0 << 8) | d1;
-                                    DBG_PRINTF("resume@%ld, SG:%d\n",_resumeLastLogTime,gravityInt);
-                                    // dont trust the data
-                                    if(gravityInt > 8000 && gravityInt < 12500)
-                                        gravityTracker.add(GravityDecode(gravityInt),_resumeLastLogTime);
-				                } // if this is Gravity data
-				                ridx+=2;
-			                } // if the field exists
-			            } // for each bit
-		            } // if gravity data exists
-
-		            idx += numberInRecord;
-			    } // else, of data not enough
-		    }else if(tag == ResumeBrewTag){
-				if((2 + idx) > size){
-		            // not enough data for this record!
-		            // rewind and return
-		            return idx - 2;
-				}else{
-					size_t d1 =_logBuffer[idx++];
-		    		size_t d0 =_logBuffer[idx++];
-					size_t tdiff= (mask <<16) + (d1 << 8) + d0;
-			    	_resumeLastLogTime = _fileInfo.starttime + tdiff;
+				// gravity is always the last field, in absolute value
+				if(mask & (1<<OrderGravity)){
+					int gravityInt = ((ptr[len-2] & 0x7F) << 8) | ptr[len-1];
+					DBG_PRINTF("resume@%ld, SG:%d\n",_resumeLastLogTime,gravityInt);
+					// dont trust the data
+					if(gravityInt > 8000 && gravityInt < 12500)
+						gravityTracker.add(GravityDecode(gravityInt),_resumeLastLogTime);
 				}
-	    	}
+		    }else if(tag == ResumeBrewTag){
+				size_t tdiff= (mask <<16) + (ptr[2] << 8) + ptr[3];
+			    _resumeLastLogTime = _fileInfo.starttime + tdiff;
+			}else if(tag == StartLogTag){
+				// keep writing the same version when resuming an old log
+				_logVersion = mask & 0x0F;
+			}
+			idx += len;
         } // while data available
         return idx;
     }
@@ -202,6 +356,8 @@ public:
     	initProcessSavedData();
 		char buff[36];
 		sprintf(buff,"%s/%s",LOG_PATH,_fileInfo.logname);
+		// records lost from RAM by power failure
+		replayJournal(buff);
 
 		_logFile=SPIFFS.open(buff,"a+");
 		if(! _logFile){
@@ -212,7 +368,15 @@ public:
  		
 		 DBG_PRINTF("resume file:%s size:%d\n",buff,fsize);
 
-		size_t totalRead=0;
+		// the unit of the log, for range headers
+		uint8_t start[2];
+		_logFile.seek(0,SeekSet);
+		if(_logFile.read(start,2) ==2 && start[0] == StartLogTag)
+			_logFahrenheit = (start[1] & 0xF0) == 0xF0;
+
+		// only the records after the checkpoint need to be processed
+		size_t totalRead=loadCheckpoint(fsize);
+		_logFile.seek(totalRead,SeekSet);
 		size_t byteRead;
 		size_t processed;
 		size_t byteToRead=LogBufferSize;
@@ -231,7 +395,7 @@ public:
                 char *src=_logBuffer + processed;
                 char *dst=_logBuffer;
                 left =  (byteRead+left)- processed;
-                for(int i=0;i<left;i++) *dst++ = *src++;
+                for(size_t i=0;i<left;i++) *dst++ = *src++;
 
 	        	byteToRead=LogBufferSize - left;
     		    readPtr=dst;
@@ -247,18 +411,24 @@ public:
 		// log a "new start" log
 		_logFile.seek(0,SeekEnd);
 		_logIndex =0;
+		_flushedIndex=0;
+		_journalIndex=0;
 		_savedLength = fsize;
 		DBG_PRINTF("resume, total _savedLength:%d, _logIndex:%d\n",_savedLength,_logIndex);
 
 		_lastTempLog=0;
 		_recording = true;
-		_isFileOpen=false;
+		// index the first record after resuming
+		_periodsToIndex=0;
+		// channel values are unknown to the reader after the gap
+		_periodsToKeyframe=0;
 
 		char unit;
 		brewPi.getLogInfo(&unit,&_mode,&_state);
 
 		// add resume tag
 		addResumeTag();
+		syncJournal();
 		//DBG_PRINTF("resume done _savedLength:%d, _logIndex:%d\n",_savedLength,_logIndex);
 		return true;
 	}
@@ -290,6 +460,23 @@ public:
 		_recording = true;
 		_savedLength=0;
 
+		_logTime = _fileInfo.starttime;
+		_periodsToIndex=0;
+		_logVersion=LogFormatVersion;
+		_periodsToKeyframe=0;
+		indexFilePath(buff,filename);
+		SPIFFS.remove(buff);
+		journalFilePath(buff,filename);
+		SPIFFS.remove(buff);
+		checkpointFilePath(buff,filename);
+		SPIFFS.remove(buff);
+		rollupFilePath(buff,filename,RollupHour);
+		SPIFFS.remove(buff);
+		rollupFilePath(buff,filename,RollupDay);
+		SPIFFS.remove(buff);
+		FileCache.invalidate(LOG_PATH "/");
+		resetRollups();
+
 		char unit;
 		brewPi.getLogInfo(&unit,&_mode,&_state);
 		startLog(unit == 'F');
@@ -298,6 +485,7 @@ public:
 		loop(); // get once
 		addMode(_mode);
 		addState(_state);
+		syncJournal();
 
 		saveIdxFile();
 		return true;
@@ -305,8 +493,17 @@ public:
 
 	void endSession(void){
 		if(!_recording) return;
+		writeLog(_logIndex);
+		// the last hour and day, not finished
+		flushRollup(RollupHour);
+		flushRollup(RollupDay);
 		_recording=false;
 		_logFile.close();
+		char buff[36];
+		journalFilePath(buff,_fileInfo.logname);
+		SPIFFS.remove(buff);
+		checkpointFilePath(buff,_fileInfo.logname);
+		SPIFFS.remove(buff);
 		// copy the file name into last entry
 		int index=0;
 		for(;index<MAX_FILE_NUMBER;index++)
@@ -338,6 +535,7 @@ public:
 	}
 
 	void logData(void){
+		METRICS_PROBE("log_data");
 		uint8_t state, mode;
 		float fTemps[5];
 
@@ -347,57 +545,25 @@ public:
 
 
 		uint16_t iTemp;
+		uint16_t lastTemp[5];
 		uint8_t changeMask=0;
-		int   changeNum=0;
 
 		for(int i=0;i<5;i++){
 			iTemp=convertTemperature(fTemps[i]);
+			lastTemp[i]=_iTempData[i];
 			if(_iTempData[i] != iTemp){
 				changeMask |= (1 << i);
 				_iTempData[i] = iTemp;
-				changeNum ++;
 				//DBG_PRINTF("tempData %i changed:%d\n",i,iTemp);
 			}
 		}
-		if( _extTemp != INVALID_TEMP_INT){
-				changeMask |= (1 << OrderExtTemp);
-				changeNum ++;
-		}
-
-		if( _extGravity != INVALID_GRAVITY_INT){
-				changeMask |= (1 << OrderGravity);
-				changeNum ++;
-		}
-
-		int startIdx = allocByte(2+ changeNum * 2);
-		if(startIdx < 0) return;
-		int idx=startIdx;
-		writeBuffer(idx++,PeriodTag);
-		writeBuffer(idx++,changeMask);
-
-		for(int i=0;i<5;i++){
-			if(changeMask & (1<<i)){
-
-				writeBuffer(idx ++,(_iTempData[i]>> 8) & 0x7F);
-				writeBuffer(idx ++,_iTempData[i] & 0xFF);
-			}
-		}
-
-
-		if( _extTemp != INVALID_TEMP_INT){
-			writeBuffer(idx++,(_extTemp >>8) & 0x7F);
-			writeBuffer(idx++,_extTemp & 0xFF);
-			_extTemp = INVALID_TEMP_INT;
-		}
-
-		if( _extGravity != INVALID_GRAVITY_INT){
-			writeBuffer(idx++,(_extGravity >>8) & 0x7F);
-			writeBuffer(idx++,_extGravity & 0xFF);
-			//DBG_PRINTF("gravity %d: %d %d\n",_extGravity,(_extGravity >>8) & 0x7F,_extGravity & 0xFF);
-			_extGravity = INVALID_GRAVITY_INT;
+		if(_recording){
+			if(!logPeriodRecord(lastTemp,changeMask)) return;
+		}else{
+			addVolatileSlot();
 		}
-
-		commitData(startIdx,2+ changeNum * 2);
+		_extTemp = INVALID_TEMP_INT;
+		_extGravity = INVALID_GRAVITY_INT;
 
 		if(_extOriginGravity != INVALID_GRAVITY_INT){
 			addOG(_extOriginGravity);
@@ -415,147 +581,197 @@ public:
 			_state = state;
 			addState(state);
 		}
+		// one journal write for all records of the period
+		syncJournal();
 	}
 
 
-	size_t beginCopyAfter(size_t last)
+	// offsets of the records logged between time "from" and "to", (to==0 means up to now).
+	// Data starts from the time index entry at or before "from", and the header
+	// carrying the full channel values of that entry is made into "header".
+	// The header keeps the start time of the log, so that the gaps of later
+	// ResumeBrewTags stay right; a ResumeBrewTag moves to the time of the entry.
+	// returns the size of the header, 0 if there is no index entry.
+	size_t locateRange(uint32_t from,uint32_t to,size_t& start,size_t& end,char *header)
 	{
-		if(!_recording) return 0;
-		_readStart = last;
-		DBG_PRINTF("beginCopyAfter:%d, _logIndex=%ld, saved=%ld last >= (_logIndex +_savedLength)=%c\n",last,_logIndex,_savedLength, (last >= (_logIndex +_savedLength))? 'Y':'N' );
-		if(last >= (_logIndex +_savedLength)) return 0;
-		return ( _logIndex+_savedLength - last);
+		LogIndexEntry entry;
+		size_t headerSize=0;
+		start=0;
+		end=_logIndex+_savedLength;
+
+		if(findIndexEntry(from,false,entry)){
+			start = entry.offset;
+			makeHeader(header,entry.time,entry.data,entry.mode,entry.state);
+			headerSize = RangeHeaderSize;
+		}
+		if(to !=0 && findIndexEntry(to,true,entry)){
+			end = entry.offset;
+		}
+		DBG_PRINTF("locateRange from:%ld to:%ld, offset:%d - %d\n",from,to,start,end);
+		return headerSize;
 	}
 
-	size_t read(uint8_t *buffer, size_t maxLen, size_t index)
+	// log data from savedLength() on are kept in RAM
+	size_t savedLength(void)
 	{
-		size_t sizeRead;
-		size_t rindex= index + _readStart;
-		DBG_PRINTF("read _readStart =%ld, index:%ld, rindex=%ld\n",_readStart,index,rindex);
-
-		if(rindex > (_savedLength +_logIndex)) return maxLen; // return whatever it wants.
-
-		if( rindex < _savedLength){
-			//DBG_PRINTF("read from file\n");
-			// read from file
-			if(!_isFileOpen){
-				char buff[36];
-				sprintf(buff,"%s/%s",LOG_PATH,_fileInfo.logname);
-				_file=SPIFFS.open(buff,"r");
-
-				DBG_PRINTF("Open file:%s\n",buff);
+		return _savedLength;
+	}
 
-				if(!_file){
-					DBG_PRINTF("error open file\n");
-					return 0;
-				}
-				_isFileOpen=true;
-				DBG_PRINTF("file opened.\n");
-//				if(rindex !=0) _file.seek(rindex,SeekSet);
-			}
-			sizeRead = _savedLength - rindex;
-			if(sizeRead > maxLen) sizeRead=maxLen;
-
-			_file.seek(rindex,SeekSet);
-			sizeRead=_file.read(buffer,sizeRead);
-			if(sizeRead ==0){
-				DBG_PRINTF("!!!!file read error!!!!!!\n");
-				_file.close();
-				_isFileOpen=false;
-				// read will be called again if return length is zero.
-			}else{
-				if(sizeRead < maxLen && (rindex + sizeRead == _savedLength)){
-					// end of file
-					size_t request = maxLen - sizeRead;
-					memcpy(buffer + sizeRead,_logBuffer,request);
-					DBG_PRINTF("from file:%ld from buffer:%ld\n",sizeRead,request);
-					sizeRead += request;
-				}
-			}
-		}else{
-			//DBG_PRINTF("read from buffer\n");
-			// read from buffer
-			rindex -=  _savedLength;
-			// rindex should be smaller than _logIndex
-			sizeRead = _logIndex - rindex;
-			if(sizeRead > maxLen) sizeRead=maxLen;
-			memcpy(buffer,_logBuffer+rindex,sizeRead);
-		}
-/*
-			if((sizeRead+ rindex) >= _savedLength ){
-				_file.close();
-				_isFileOpen=false;
-//				DBG_PRINTF("file closed.\n");
-			}*/
-
-		DBG_PRINTF("sizeRead:%ld\n",sizeRead);
+	size_t readBuffered(size_t offset,uint8_t *buffer,size_t maxLen)
+	{
+		if(!_recording || offset < _savedLength) return 0;
+		size_t rindex = offset - _savedLength;
+		if(rindex >= _logIndex) return 0;
+		size_t sizeRead = _logIndex - rindex;
+		if(sizeRead > maxLen) sizeRead=maxLen;
+		memcpy(buffer,_logBuffer+rindex,sizeRead);
 		return sizeRead;
 	}
 
+	uint32_t bytesLogged(void){ return _bytesLogged;}
+	uint32_t bytesWritten(void){ return _bytesWritten;}
+	uint32_t writeCount(void){ return _writeCount;}
+
 	void getFilePath(char* buf,int index)
 	{
 		sprintf(buf,"%s/%s",LOG_PATH,_fileInfo.files[index].name);
 	}
 
-	size_t volatileDataOffset(void)
+	void getCurrentLogPath(char* buf)
 	{
-		return _startOffset;
+		sprintf(buf,"%s/%s",LOG_PATH,_fileInfo.logname);
 	}
 
-	size_t volatileDataAvailable(size_t start,size_t offset)
+	unsigned long getFileStartTime(int index)
 	{
-		// get size;
-		size_t dataAvail=(_logHead <= _logIndex)? (_logIndex-_logHead):(LogBufferSize + _logIndex - _logHead);
-		dataAvail += VolatileHeaderSize; // for make-up header
-		//DBG_PRINTF("volatileDataAvailable,start:%d, offset:%d, _logHead %d _logIndex %d, _startOffset:%d, dataAvail:%d\n",start, offset,_logHead,_logIndex,_startOffset, dataAvail);
-		if( ((start + offset) == 0)
-			|| ((start + offset) < _startOffset)   // error case
-		    || ((start + offset) > (_startOffset + dataAvail))) {  //error case
-			// force reload, start=offset=0, the same case
-			// send header?
-			_sendHeader=true;
-			_sendOffset=0;
-		}else{
+		return _fileInfo.files[index].time;
+	}
 
-			size_t d= _startOffset + dataAvail - (start + offset);
-			dataAvail= d;
-			// assume the header should already be sent.
-			_sendHeader=false;
-			_sendOffset=start + offset - _startOffset - VolatileHeaderSize + _logHead;
-			if(_sendOffset > LogBufferSize) _sendOffset -= LogBufferSize;
+	unsigned long currentStartTime(void)
+	{
+		return _fileInfo.starttime;
+	}
 
-			//DBG_PRINTF("prepare send from %d of %d\n",_sendOffset,d);
-		}
+	void getRollupPath(char* buf,int index,int rollup)
+	{
+		rollupFilePath(buf,_fileInfo.files[index].name,rollup);
+	}
 
-		return dataAvail;
+	// rollup entries of the current log, including the hour or day in progress
+	size_t rollupSize(int rollup)
+	{
+		if(!_recording) return 0;
+		char buff[36];
+		rollupFilePath(buff,_fileInfo.logname,rollup);
+		size_t size=0;
+		File f=SPIFFS.open(buff,"r");
+		if(f){
+			size=f.size();
+			f.close();
+		}
+		RollupEntry entry;
+		if(makeRollupEntry(rollup,entry)) size += sizeof(entry);
+		return size;
 	}
 
-	size_t readVolatileData(uint8_t *buffer, size_t maxLen, size_t index)
+	size_t readRollup(int rollup,uint8_t *buffer,size_t maxLen,size_t index)
 	{
-		size_t bufIdx=0;
-		size_t readIdx;
-		if(_sendHeader){
-			if(index < VolatileHeaderSize){
-				// maxLen < VolatileHeaderSize?
-				char header[VolatileHeaderSize];
-				volatileHeader(header);
-				for(int i=index;bufIdx<maxLen && i<VolatileHeaderSize;i++)
-					buffer[bufIdx++]=header[i];
-				readIdx = _logHead;
-			}else{
-				readIdx = index -VolatileHeaderSize;
+		if(!_recording) return 0;
+		char buff[36];
+		rollupFilePath(buff,_fileInfo.logname,rollup);
+		size_t sizeRead=0;
+		size_t fsize=0;
+		File f=SPIFFS.open(buff,"r");
+		if(f){
+			fsize=f.size();
+			if(index < fsize){
+				f.seek(index,SeekSet);
+				sizeRead=f.read(buffer,(fsize - index < maxLen)? (fsize - index):maxLen);
+			}
+			f.close();
+		}
+		// followed by the entry in progress
+		RollupEntry entry;
+		if(sizeRead < maxLen && index + sizeRead >= fsize && makeRollupEntry(rollup,entry)){
+			size_t off=index + sizeRead - fsize;
+			if(off < sizeof(entry)){
+				size_t len=sizeof(entry) - off;
+				if(len > maxLen - sizeRead) len = maxLen - sizeRead;
+				memcpy(buffer + sizeRead,(const uint8_t*)&entry + off,len);
+				sizeRead += len;
 			}
-		}else{
-			readIdx = _sendOffset + index;
 		}
+		return sizeRead;
+	}
 
-		//DBG_PRINTF("readVolatileData maxLen=%d, index=%d, readIdx=%d\n",maxLen,index,readIdx);
+	size_t currentLogLength(void)
+	{
+		return _recording? (_savedLength + _logIndex):0;
+	}
+
+	// number of period records, counting the gaps of resumption
+	uint32_t periodRecordNumber(void)
+	{
+		if(!_recording) return 0;
+		return (_logTime - _fileInfo.starttime) / (_tempLogPeriod/1000);
+	}
+
+	// stream position of the lead of a fresh load
+	size_t volatileDataOffset(void)
+	{
+		return _headPos - VolatileLeadSize;
+	}
 
-		while(bufIdx < maxLen){
-			if(readIdx >= LogBufferSize) readIdx -= LogBufferSize;
-			buffer[bufIdx++] = _logBuffer[readIdx++];
+	// cursor is kept by each request
+	size_t volatileDataAvailable(size_t start,size_t offset,VolatileCursor& cursor)
+	{
+		size_t position=start + offset;
+		cursor.headerSent=0;
+		cursor.unitOffset=0;
+		cursor.unitLength=0;
+		cursor.end=_nextPos;
+		cursor.endSeq=_headSeq + _slotCount;
+		// continue from the slot at position, if it is still there
+		if(position >= _headPos && position <= _nextPos){
+			if(position == _nextPos) return 0;
+			int low=0, high=_slotCount -1;
+			while(low <= high){
+				int mid=(low + high)/2;
+				size_t pos=slotPosition(_headSeq + mid);
+				if(pos == position){
+					cursor.headerSize=0;
+					cursor.seq=_headSeq + mid;
+					cursor.pos=position;
+					return _nextPos - position;
+				}
+				if(pos < position) low = mid +1;
+				else high = mid -1;
+			}
 		}
+		// force reload, led by a header
+		volatileLead(cursor.header);
+		cursor.headerSize=VolatileLeadSize;
+		cursor.seq=_headSeq;
+		cursor.pos=_headPos;
+		return VolatileLeadSize + _nextPos - _headPos;
+	}
 
+	size_t readVolatileData(uint8_t *buffer, size_t maxLen,VolatileCursor& cursor)
+	{
+		size_t bufIdx=0;
+		while(bufIdx < maxLen && cursor.headerSent < cursor.headerSize)
+			buffer[bufIdx++] = cursor.header[cursor.headerSent++];
+
+		// always the length given at the start of the response
+		while(bufIdx < maxLen && cursor.pos < cursor.end){
+			if(cursor.unitOffset == cursor.unitLength) nextVolatileUnit(cursor);
+			size_t len=cursor.unitLength - cursor.unitOffset;
+			if(len > maxLen - bufIdx) len = maxLen - bufIdx;
+			memcpy(buffer + bufIdx,cursor.unit + cursor.unitOffset,len);
+			bufIdx += len;
+			cursor.unitOffset += len;
+			cursor.pos += len;
+		}
 		return bufIdx;
 	}
 
@@ -574,6 +790,83 @@ public:
 		DBG_PRINTF("AuxTemp:%d\n",_extTemp);
 	}
 
+	// length of the record at ptr, 0 if it is not complete in avail bytes.
+	// InvalidLogRecord if a varint is longer than LogMaxVarintSize.
+	static size_t recordLength(const uint8_t *ptr,size_t avail)
+	{
+		if(avail < 2) return 0;
+		uint8_t tag=ptr[0];
+		uint8_t mask=ptr[1];
+		size_t len=2;
+		if(tag == PeriodTag){
+			for(int i=0;i<7;i++) if(mask & (1<<i)) len +=2;
+		}else if(tag == DeltaPeriodTag){
+			for(int i=0;i<7;i++){
+				if(!(mask & (1<<i))) continue;
+				if(i < OrderExtTemp){
+					for(int n=0;;n++){
+						if(n == LogMaxVarintSize) return InvalidLogRecord;
+						if(len >= avail) return 0;
+						if(!(ptr[len++] & 0x80)) break;
+					}
+				}else{
+					len +=2;
+				}
+			}
+		}else if(tag == StartLogTag){
+			len=8;
+		}else if(tag == ResumeBrewTag || tag == OriginGravityTag){
+			len=4;
+		}
+		return (len <= avail)? len:0;
+	}
+
+	// apply a complete PeriodTag or DeltaPeriodTag record to the channels in its mask.
+	static void decodePeriodRecord(const uint8_t *ptr,uint16_t *values)
+	{
+		uint8_t tag=ptr[0];
+		uint8_t mask=ptr[1];
+		int idx=2;
+		for(int i=0;i<7;i++){
+			if(!(mask & (1<<i))) continue;
+			if(tag == DeltaPeriodTag && i < OrderExtTemp){
+				uint32_t z=0;
+				int shift=0;
+				uint8_t b;
+				do{
+					b=ptr[idx++];
+					z |= (uint32_t)(b & 0x7F) << shift;
+					shift += 7;
+				}while(b & 0x80);
+				values[i] = (uint16_t)(values[i] + unzigzag(z));
+			}else{
+				values[i] = ((ptr[idx] & 0x7F) << 8) | ptr[idx+1];
+				idx +=2;
+			}
+		}
+	}
+
+	static uint32_t zigzag(int v)
+	{
+		return (v < 0)? ((uint32_t)(-v) * 2 -1):((uint32_t)v * 2);
+	}
+
+	static int unzigzag(uint32_t z)
+	{
+		return (z & 1)? -(int)((z+1) >>1):(int)(z >>1);
+	}
+
+	static int encodeVarint(uint8_t *buf,uint32_t v)
+	{
+		int len=0;
+		while(v >= 0x80){
+			buf[len++] = (v & 0x7F) | 0x80;
+			v >>= 7;
+		}
+		buf[len++] = v;
+		return len;
+	}
+
 private:
 	size_t _fsspace;
 	uint32_t  _tempLogPeriod;
@@ -584,10 +877,14 @@ private:
 
 	size_t _logIndex;
 	size_t _savedLength;
-	size_t _readStart;
-	char _logBuffer[LogBufferSize];
-	File _file;
-	bool _isFileOpen;
+	// the log buffer is used only when recording, the volatile slots only when not.
+	union{
+		char _logBuffer[LogBufferSize];
+		struct{
+			VolatileSlot slots[VolatileLogSlots];
+			VolatileEvent events[VolatileLogEvents];
+		} _volatile;
+	};
 
 	File    _logFile;
 
@@ -600,13 +897,34 @@ private:
 	uint16_t  _extGravity;
 	uint16_t  _extOriginGravity;
 
-	// for circular buffer
-	int _logHead;
+	// time of next period record, and time index
+	uint32_t _logTime;
+	uint16_t _periodsToIndex;
+	// format of the current log, and records to next keyframe
+	uint8_t  _logVersion;
+	bool     _logFahrenheit;
+	uint16_t _periodsToKeyframe;
+	// _logBuffer[0, _flushedIndex) is in the log file, [_flushedIndex,_journalIndex) in the journal
+	size_t _flushedIndex;
+	size_t _journalIndex;
+	uint32_t _bytesLogged;
+	uint32_t _bytesWritten;
+	uint32_t _writeCount;
+	RollupAccumulator _rollup[2];
+
+	// volatile log: _slotCount slots from _slotHead, the first one of seq _headSeq
+	int _slotHead;
+	int _slotCount;
+	uint32_t _headSeq;
 	uint32_t _headTime;
-	uint32_t _startOffset;
-	bool _sendHeader;
-	uint32_t _sendOffset;
-	uint16_t  _headData[7];
+	// stream position of the head slot, and the end of the stream
+	uint32_t _headPos;
+	uint32_t _nextPos;
+	// mode and state before the head slot
+	uint8_t _headMode;
+	uint8_t _headState;
+	int _eventHead;
+	int _eventCount;
 
 	void resetTempData(void)
 	{
@@ -630,19 +948,16 @@ private:
 		DBG_PRINTF("SPIFFS space:%d\n",_fsspace);
 	}
 
-	void volatileHeader(char *buf)
+	// start tag, mode and state before the head slot
+	void volatileLead(char *buf)
 	{
 		char unit;
 		uint8_t mode,state;
 
 		brewPi.getLogInfo(&unit,&mode,&state);
-		bool fahrenheit=(unit == 'F');
-
 		char* ptr=buf;
-		uint8_t headerTag=5;
-		//8
 		*ptr++ = StartLogTag;
-		*ptr++ = headerTag | (fahrenheit? 0xF0:0xE0) ;
+		*ptr++ = LogFormatVersion | ((unit == 'F')? 0xF0:0xE0);
 		int period = _tempLogPeriod/1000;
 		*ptr++ = (char) (period >> 8);
 		*ptr++ = (char) (period & 0xFF);
@@ -650,12 +965,38 @@ private:
 		*ptr++ = (char) (_headTime >> 16);
 		*ptr++ = (char) (_headTime >> 8);
 		*ptr++ = (char) (_headTime & 0xFF);
+		*ptr++ = ModeTag;
+		*ptr++ = _headMode;
+		*ptr++ = StageTag;
+		*ptr++ = _headState;
+	}
+
+	void makeHeader(char *buf,uint32_t time,const uint16_t *data,uint8_t mode,uint8_t state)
+	{
+		char* ptr=buf;
+		uint8_t headerTag=_logVersion;
+		//8
+		*ptr++ = StartLogTag;
+		*ptr++ = headerTag | (_logFahrenheit? 0xF0:0xE0) ;
+		int period = _tempLogPeriod/1000;
+		*ptr++ = (char) (period >> 8);
+		*ptr++ = (char) (period & 0xFF);
+		*ptr++ = (char) (_fileInfo.starttime >> 24);
+		*ptr++ = (char) (_fileInfo.starttime >> 16);
+		*ptr++ = (char) (_fileInfo.starttime >> 8);
+		*ptr++ = (char) (_fileInfo.starttime & 0xFF);
+		// resume: 4
+		uint32_t gap=time - _fileInfo.starttime;
+		*ptr++ = ResumeBrewTag;
+		*ptr++ = (char) (gap >> 16);
+		*ptr++ = (char) (gap >> 8);
+		*ptr++ = (char) (gap & 0xFF);
 		// a record full of all data = 2 + 7 * 2= 16
 		*ptr++ = (char) PeriodTag;
 		*ptr++ = (char) 0x7F;
 		for(int i=0;i<7;i++){
-			*ptr++ = _headData[i] >> 8;
-			*ptr++ = _headData[i] & 0xFF;
+			*ptr++ = data[i] >> 8;
+			*ptr++ = data[i] & 0xFF;
 		}
 		// mode : 2
 		*ptr++ = ModeTag;
@@ -667,10 +1008,11 @@ private:
 
 	void startLog(bool fahrenheit)
 	{
+		_logFahrenheit=fahrenheit;
 		char *ptr=_logBuffer;
 		// F0FF  peroid   4 bytes
 		// Start system time 4bytes
-		uint8_t headerTag=5;
+		uint8_t headerTag=_logVersion;
 		*ptr++ = StartLogTag;
 		*ptr++ = headerTag | (fahrenheit? 0xF0:0xE0) ;
 		int period = _tempLogPeriod/1000;
@@ -681,7 +1023,8 @@ private:
 		*ptr++ = (char) (_fileInfo.starttime >> 8);
 		*ptr++ = (char) (_fileInfo.starttime & 0xFF);
 		_logIndex=0;
-		_isFileOpen=false;
+		_flushedIndex=0;
+		_journalIndex=0;
 		_savedLength=0;
 		commitData(_logIndex,ptr - _logBuffer );
 
@@ -692,108 +1035,180 @@ private:
 	{
 		DBG_PRINTF("startVolatileLog, mode=%c, beerteemp=%d\n",_mode,_iTempData[OrderBeerTemp]);
 		_headTime=TimeKeeper.getTimeSeconds();
-		_logHead = 0;
-		_logIndex = 0;
-		_startOffset=0;
+		_slotHead=0;
+		_slotCount=0;
+		_headSeq=0;
+		_eventHead=0;
+		_eventCount=0;
+		_headPos=VolatileLeadSize;
+		_nextPos=_headPos;
+		_headMode=_mode;
+		_headState=_state;
 		_lastTempLog=0;
-		for(int i=0;i<5;i++) _headData[i]=_iTempData[i];
-		_headData[5]= _extTemp;
-		_headData[6]= _extGravity;
+		_logVersion=LogFormatVersion;
 	}
 
-
-
-	int freeBufferSpace(void)
+	// ring index of the slot of seq
+	int slotIndex(uint32_t seq)
 	{
-		//DBG_PRINTF("_logHead:%d, _logIndex: %d\n",_logHead,_logIndex);
-		if(_logIndex >= _logHead){
-			return LogBufferSize - _logIndex -1 + _logHead;
-		}else {
-			// _logIndex < _logHead
-			return _logHead - _logIndex - 1;
-		}
+		int idx=_slotHead + (int)(seq - _headSeq);
+		return (idx >= VolatileLogSlots)? (idx - VolatileLogSlots):idx;
 	}
 
-	void dropData(void)
+	size_t slotPosition(uint32_t seq)
 	{
-		noInterrupts();
-		// move headto nex time stamp.
-		// four temperatures in one period
-		int idx = _logHead;
-		int dataDrop=0;
-		byte tag;
-		byte mask;
-
-		while(1){
-			if(idx >= LogBufferSize) idx -= LogBufferSize;
-			tag =_logBuffer[idx++];
-		    mask=_logBuffer[idx++];
-			dataDrop +=2;
+		return _headPos + (uint16_t)(_volatile.slots[slotIndex(seq)].pos - _volatile.slots[_slotHead].pos);
+	}
 
-			if(tag == PeriodTag) break;
+	void addVolatileSlot(void)
+	{
+		if(_slotCount == VolatileLogSlots) dropSlot();
+		VolatileSlot& slot=_volatile.slots[slotIndex(_headSeq + _slotCount)];
+		for(int i=0;i<5;i++) slot.data[i]=_iTempData[i];
+		slot.data[OrderExtTemp]=_extTemp;
+		slot.data[OrderGravity]=_extGravity;
+		slot.pos=(uint16_t)_nextPos;
+		_slotCount ++;
+		_nextPos += volatileRecord(slot,NULL);
+	}
 
-			if(tag == OriginGravityTag){
-    			idx += 2;
-	    		dataDrop +=2;
-			}
+	void addVolatileEvent(uint8_t tag,uint16_t value)
+	{
+		// keep the events of the slots in the window
+		while(_eventCount == VolatileLogEvents && _slotCount >0) dropSlot();
+		if(_slotCount ==0){
+			applyEvent(tag,value);
+			return;
 		}
+		VolatileEvent& event=_volatile.events[eventIndex(_eventCount)];
+		event.seq=_headSeq + _slotCount -1;
+		event.tag=tag;
+		event.value=value;
+		_eventCount ++;
+		_nextPos += (tag == OriginGravityTag)? 4:2;
+	}
 
+	int eventIndex(int i)
+	{
+		int idx=_eventHead + i;
+		return (idx >= VolatileLogEvents)? (idx - VolatileLogEvents):idx;
+	}
 
-		DBG_PRINTF("before tag %d, mask=%x\n",dataDrop,mask);
+	void applyEvent(uint8_t tag,uint16_t value)
+	{
+		if(tag == ModeTag) _headMode=(uint8_t)value;
+		else if(tag == StageTag) _headState=(uint8_t)value;
+	}
 
+	// drop the head slot and its events, O(1) besides the events
+	void dropSlot(void)
+	{
+		while(_eventCount >0 && _volatile.events[_eventHead].seq == _headSeq){
+			applyEvent(_volatile.events[_eventHead].tag,_volatile.events[_eventHead].value);
+			if(++_eventHead == VolatileLogEvents) _eventHead=0;
+			_eventCount --;
+		}
+		_headPos = (_slotCount > 1)? slotPosition(_headSeq +1):_nextPos;
+		if(++_slotHead == VolatileLogSlots) _slotHead=0;
+		_slotCount --;
+		_headSeq ++;
+		_headTime += _tempLogPeriod/1000;
+	}
 
+	// full period record of a slot, returns the length
+	size_t volatileRecord(const VolatileSlot& slot,uint8_t *buf)
+	{
+		uint8_t mask=0x1F;
+		if(slot.data[OrderExtTemp] != INVALID_TEMP_INT) mask |= (1 << OrderExtTemp);
+		if(slot.data[OrderGravity] != INVALID_GRAVITY_INT) mask |= (1 << OrderGravity);
+		size_t len=2;
 		for(int i=0;i<7;i++){
-			if(mask & (1<<i)){
-				if(idx >= LogBufferSize) idx -= LogBufferSize;
-				byte d0=_logBuffer[idx++];
-				byte d1=_logBuffer[idx++];
-				dataDrop +=2;
-				_headData[i] = (d0<<8) | d1;
-				DBG_PRINTF("update idx:%d to %d\n",i,_headData[i]);
+			if(!(mask & (1<<i))) continue;
+			if(buf){
+				buf[len] = (slot.data[i] >> 8) & 0x7F;
+				buf[len+1] = slot.data[i] & 0xFF;
 			}
+			len +=2;
+		}
+		if(buf){
+			buf[0]=PeriodTag;
+			buf[1]=mask;
+		}
+		return len;
+	}
+
+	// the next unit of a response into its cursor.
+	// Slots dropped since the response started are replaced by period records
+	// without values, which the chart takes as unchanged, so the time of the
+	// following slots stays right. EventTags fill the rest of their bytes,
+	// or everything left if the volatile log was restarted or stopped.
+	void nextVolatileUnit(VolatileCursor& cursor)
+	{
+		cursor.unitOffset=0;
+		bool live= !_recording && cursor.seq >= _headSeq && cursor.seq < _headSeq + _slotCount
+				&& slotPosition(cursor.seq) == cursor.pos;
+		if(live){
+			cursor.unitLength=volatileUnit(cursor.seq,cursor.unit);
+			cursor.seq ++;
+			if(cursor.unitLength > cursor.end - cursor.pos) cursor.unitLength=cursor.end - cursor.pos;
+			return;
 		}
-		// drop any F tag
-		while(_logBuffer[idx] != PeriodTag ){
-			if(idx >= LogBufferSize) idx -= LogBufferSize;
-			if(OriginGravityTag == _logBuffer[idx]){
-				idx +=4;
-				dataDrop +=4;
+		// the bytes of dropped slots, up to the head slot
+		bool dropped= !_recording && cursor.seq <= _headSeq && cursor.pos < _headPos
+				&& (_headSeq - cursor.seq) * 2 <= _headPos - cursor.pos;
+		uint32_t limit=(dropped && _headPos < cursor.end)? _headPos:cursor.end;
+		uint32_t fill=limit - cursor.pos;
+		if(fill > VolatileUnitSize) fill=VolatileUnitSize;
+		uint8_t len=0;
+		while(len < fill){
+			if(dropped && cursor.seq < _headSeq && cursor.seq < cursor.endSeq){
+				cursor.unit[len++]=PeriodTag;
+				cursor.seq ++;
 			}else{
-				idx +=2;
-				dataDrop +=2;
+				cursor.unit[len++]=EventTag;
 			}
+			if(len < fill) cursor.unit[len++]=0;
 		}
-
-		if(idx >= LogBufferSize) idx -= LogBufferSize;
-		_startOffset += dataDrop;
-		_logHead = idx;
-		_headTime += _tempLogPeriod/1000;
-		interrupts();
-		DBG_PRINTF("Drop %d\n",dataDrop);
+		cursor.unitLength=len;
 	}
 
-	int volatileLoggingAlloc(int size)
+	// the record of slot seq followed by its events
+	size_t volatileUnit(uint32_t seq,uint8_t *buf)
 	{
-		int space=freeBufferSpace();
-;
-		while(space < size){
-			//DBG_PRINTF("Free %d req: %d\n",space,size);
-			dropData();
-			space=freeBufferSpace();
+		size_t len=volatileRecord(_volatile.slots[slotIndex(seq)],buf);
+		// events are in order of seq
+		int low=0, high=_eventCount;
+		while(low < high){
+			int mid=(low + high)/2;
+			if(_volatile.events[eventIndex(mid)].seq < seq) low = mid +1;
+			else high = mid;
 		}
-
-		return _logIndex;
+		for(int i=low;i<_eventCount;i++){
+			const VolatileEvent& event=_volatile.events[eventIndex(i)];
+			if(event.seq != seq) break;
+			buf[len++]=event.tag;
+			if(event.tag == OriginGravityTag){
+				buf[len++]=0;
+				buf[len++]=(event.value >> 8) | 0x80;
+				buf[len++]=event.value & 0xFF;
+			}else{
+				buf[len++]=event.value;
+			}
+		}
+		return len;
 	}
 
 	int allocByte(byte size)
 	{
-		if(!_recording){
-			return volatileLoggingAlloc(size);
-		}
 		if((_logIndex+size) > LogBufferSize){
 			DBG_PRINTF("buffer full, %d + %d >= %d! saved=%d\n",_logIndex,size,LogBufferSize,_savedLength);
-				_savedLength += _logIndex;
-				_logIndex =0;
+			// keep the records not written yet
+			size_t pending=_logIndex - _flushedIndex;
+			memmove(_logBuffer,_logBuffer + _flushedIndex,pending);
+			_savedLength += _flushedIndex;
+			_journalIndex -= _flushedIndex;
+			_flushedIndex =0;
+			_logIndex = pending;
 		}
 		if(size >= _fsspace){
 			// run out of space.
@@ -818,41 +1233,207 @@ private:
 
 	void commitData(int idx,int len)
 	{
+		METRICS_PROBE("commit_data");
 		 _logIndex += len;
 
-		if(!_recording){
-			if(_logIndex >= LogBufferSize)
-				_logIndex -= LogBufferSize;
+		_bytesLogged += len;
+		// write whole pages only, the rest is kept in RAM and journal
+		size_t end = _savedLength + _logIndex;
+		end -= end % LogFlushSize;
+		if(end > _savedLength + _flushedIndex) writeLog(end - _savedLength);
+	}
+
+	// write _logBuffer up to index end to the log file
+	void writeLog(size_t end)
+	{
+		if(end <= _flushedIndex) return;
+		size_t wlen=_logFile.write((const uint8_t*)_logBuffer + _flushedIndex,end - _flushedIndex);
+		_logFile.flush();
+		_bytesWritten += wlen;
+		_writeCount ++;
+		if(wlen != end - _flushedIndex){
+			DBG_PRINTF("!!!write failed @ %d\n",_savedLength + _flushedIndex);
+		}
+		// the journal holds only records not in the log file
+		if(_journalIndex > _flushedIndex){
+			char buff[36];
+			journalFilePath(buff,_fileInfo.logname);
+			SPIFFS.remove(buff);
+		}
+		_flushedIndex = end;
+		_journalIndex = end;
+	}
+
+	void journalFilePath(char *buf,const char *logname)
+	{
+		sprintf(buf,"%s/%s%s",LOG_PATH,logname,LOG_JOURNAL_EXT);
+	}
+
+	// Fletcher-16
+	static uint16_t checksum(const uint8_t *data,size_t len,uint16_t sum=0)
+	{
+		uint16_t s1= sum & 0xFF;
+		uint16_t s2= sum >> 8;
+		for(size_t i=0;i<len;i++){
+			s1 = (s1 + data[i]) % 255;
+			s2 = (s2 + s1) % 255;
+		}
+		return (s2 << 8) | s1;
+	}
+
+	// append records not in the log file to the journal
+	void syncJournal(void)
+	{
+		if(!_recording || _journalIndex >= _logIndex) return;
+		char buff[36];
+		journalFilePath(buff,_fileInfo.logname);
+		File journal=SPIFFS.open(buff,"a");
+		if(!journal){
+			DBG_PRINTF("error open journal\n");
 			return;
 		}
-		char *buf = _logBuffer + idx;
+		uint32_t offset = _savedLength + _journalIndex;
+		uint16_t len = _logIndex - _journalIndex;
+		uint8_t header[JournalHeaderSize];
+		header[0]= JournalMagic;
+		header[1]= (uint8_t)(offset >> 24);
+		header[2]= (uint8_t)(offset >> 16);
+		header[3]= (uint8_t)(offset >> 8);
+		header[4]= (uint8_t)(offset & 0xFF);
+		header[5]= (uint8_t)(len >> 8);
+		header[6]= (uint8_t)(len & 0xFF);
+		const uint8_t *data=(const uint8_t*)_logBuffer + _journalIndex;
+		uint16_t sum=checksum(data,len,checksum(header,JournalHeaderSize));
+		uint8_t tail[2]={(uint8_t)(sum >> 8),(uint8_t)(sum & 0xFF)};
+
+		size_t wlen=journal.write(header,JournalHeaderSize);
+		wlen += journal.write(data,len);
+		wlen += journal.write(tail,2);
+		journal.close();
+		_bytesWritten += wlen;
+		_writeCount ++;
+		_journalIndex = _logIndex;
+	}
+
+	// append the valid journal frames beyond the end of the log file, then drop the journal.
+	void replayJournal(const char *logPath)
+	{
+		char buff[36];
+		journalFilePath(buff,_fileInfo.logname);
+		File journal=SPIFFS.open(buff,"r");
+		if(!journal) return;
+		File logFile=SPIFFS.open(logPath,"a");
+		if(!logFile){
+			journal.close();
+			return;
+		}
+		size_t fsize=logFile.size();
+		uint8_t header[JournalHeaderSize];
+		uint8_t *data=(uint8_t*)_logBuffer;
+
+		while(journal.read(header,JournalHeaderSize) == JournalHeaderSize && header[0] == JournalMagic){
+			uint32_t offset= ((uint32_t)header[1] << 24) | ((uint32_t)header[2] << 16) | (header[3] << 8) | header[4];
+			size_t len= (header[5] << 8) | header[6];
+			if(len + 2 > LogBufferSize) break;
+			if(journal.read(data,len+2) != len+2) break;
+			uint16_t sum=checksum(data,len,checksum(header,JournalHeaderSize));
+			if(sum != ((data[len] << 8) | data[len+1])) break; // torn write
+			if(offset > fsize) break; // gap
+			if(offset + len > fsize){
+				size_t skip= fsize - offset;
+				fsize += logFile.write(data + skip,len - skip);
+			}
+		}
+		DBG_PRINTF("journal replayed, size:%d\n",fsize);
+		logFile.close();
+		journal.close();
+		SPIFFS.remove(buff);
+	}
 
+	// period record of the log, false if the log is stopped for no space
+	bool logPeriodRecord(const uint16_t *lastTemp,uint8_t changeMask)
+	{
+		// delta record, or a keyframe of all temperatures for readers to resync
+		bool delta=(_logVersion >= DeltaLogVersion) && _periodsToKeyframe !=0;
+		if(_logVersion >= DeltaLogVersion && !delta) changeMask |= 0x1F;
 
-		int wlen;
-		if(idx + len <= LogBufferSize){
-			// continues block
-			wlen=_logFile.write((const uint8_t*)buf,len);
-		}else{
-			wlen=_logFile.write((const uint8_t*)buf,LogBufferSize - idx);
-			buf = _logBuffer;
-			int nlen = len  + idx -LogBufferSize;
-			wlen += _logFile.write((const uint8_t*)buf,nlen);
+		if( _extTemp != INVALID_TEMP_INT){
+				changeMask |= (1 << OrderExtTemp);
 		}
-		/*
-		if(len !=(wlen=_logFile.write((const uint8_t*)buf,len))){
 
-			DBG_PRINTF("!!!write failed @ %d\n",_logIndex);
-			_logFile.close();
-			char buff[36];
-			sprintf(buff,"%s/%s",LOG_PATH,_fileInfo.logname);
+		if( _extGravity != INVALID_GRAVITY_INT){
+				changeMask |= (1 << OrderGravity);
+		}
 
-			_logFile=SPIFFS.open(buff,"a+");
-			_logFile.write((const uint8_t*)buf+wlen,len-wlen);
-		}*/
-		_logFile.flush();
+		uint8_t record[LogMaxRecordSize];
+		int len=0;
+		record[len++]= delta? DeltaPeriodTag:PeriodTag;
+		record[len++]= changeMask;
+
+		for(int i=0;i<5;i++){
+			if(changeMask & (1<<i)){
+				if(delta){
+					len += encodeVarint(record+len,zigzag((int)_iTempData[i] - (int)lastTemp[i]));
+				}else{
+					record[len++] = (_iTempData[i]>> 8) & 0x7F;
+					record[len++] = _iTempData[i] & 0xFF;
+				}
+			}
+		}
+
+		if( _extTemp != INVALID_TEMP_INT){
+			record[len++] = (_extTemp >>8) & 0x7F;
+			record[len++] = _extTemp & 0xFF;
+		}
+
+		if( _extGravity != INVALID_GRAVITY_INT){
+			record[len++] = (_extGravity >>8) & 0x7F;
+			record[len++] = _extGravity & 0xFF;
+			//DBG_PRINTF("gravity %d: %d %d\n",_extGravity,(_extGravity >>8) & 0x7F,_extGravity & 0xFF);
+		}
+
+		int startIdx = allocByte(len);
+		if(startIdx < 0) return false;
+		bool indexing = (_periodsToIndex == 0);
+		LogIndexEntry entry;
+		if(indexing){
+			entry.time = _logTime;
+			entry.offset = _savedLength + startIdx + len;
+			for(int i=0;i<5;i++) entry.data[i]=_iTempData[i];
+			entry.data[OrderExtTemp] = _extTemp;
+			entry.data[OrderGravity] = _extGravity;
+			entry.mode = _mode;
+			entry.state = _state;
+		}
+		for(int i=0;i<len;i++) writeBuffer(startIdx+i,record[i]);
+		commitData(startIdx,len);
+
+		uint16_t values[7];
+		for(int i=0;i<5;i++) values[i]=_iTempData[i];
+		values[OrderExtTemp]=_extTemp;
+		values[OrderGravity]=_extGravity;
+		rollupAdd(_logTime,values);
+
+		if(_logVersion >= DeltaLogVersion){
+			if(!delta) _periodsToKeyframe = LogKeyframeInterval;
+			if(_periodsToKeyframe) _periodsToKeyframe --;
+		}
+
+		if(indexing){
+			addIndexEntry(entry);
+			saveCheckpoint();
+			_periodsToIndex = LogIndexInterval;
+		}
+		_periodsToIndex --;
+		_logTime += _tempLogPeriod/1000;
+		return true;
 	}
 
 	void addOG(uint16_t og){
+		if(!_recording){
+			addVolatileEvent(OriginGravityTag,og);
+			return;
+		}
 		int idx = allocByte(4);
 		if(idx < 0) return;
 		writeBuffer(idx,OriginGravityTag);
@@ -864,6 +1445,10 @@ private:
 
 
 	void addMode(char mode){
+		if(!_recording){
+			addVolatileEvent(ModeTag,mode);
+			return;
+		}
 		int idx = allocByte(2);
 		if(idx < 0) return;
 		writeBuffer(idx,ModeTag); //*ptr = ModeTag;
@@ -872,6 +1457,10 @@ private:
 	}
 
 	void addState(char state){
+		if(!_recording){
+			addVolatileEvent(StageTag,state);
+			return;
+		}
 		int idx = allocByte(2);
 		if(idx <0) return;
 		writeBuffer(idx,StageTag); //*ptr = StageTag;
@@ -907,6 +1496,202 @@ private:
 		writeBuffer(idx+2,(uint8_t) (gap>>8)&0xFF );
 		writeBuffer(idx+3,(uint8_t) (gap)&0xFF);
 		commitData(idx,4);
+		_logTime = rtime;
+	}
+
+	void indexFilePath(char *buf,const char *logname)
+	{
+		sprintf(buf,"%s/%s%s",LOG_PATH,logname,LOG_INDEX_EXT);
+	}
+
+	void addIndexEntry(LogIndexEntry& entry)
+	{
+		char buff[36];
+		indexFilePath(buff,_fileInfo.logname);
+		File idxFile=SPIFFS.open(buff,"a");
+		if(!idxFile){
+			DBG_PRINTF("error open index file\n");
+			return;
+		}
+		_bytesWritten += idxFile.write((const uint8_t*)&entry,sizeof(LogIndexEntry));
+		_writeCount ++;
+		idxFile.close();
+		if(_fsspace > sizeof(LogIndexEntry)) _fsspace -= sizeof(LogIndexEntry);
+	}
+
+	void checkpointFilePath(char *buf,const char *logname)
+	{
+		sprintf(buf,"%s/%s%s",LOG_PATH,logname,LOG_CHECKPOINT_EXT);
+	}
+
+	// called right after a period record, so that the next record
+	// starts at the end of the log, at _logTime.
+	void saveCheckpoint(void)
+	{
+		LogCheckpoint cp;
+		memset(&cp,0,sizeof(cp));
+		cp.magic = LogCheckpointMagic;
+		cp.starttime = _fileInfo.starttime;
+		cp.length = _savedLength + _logIndex;
+		cp.time = _logTime;
+		for(int i=0;i<5;i++) cp.data[i]=_iTempData[i];
+		cp.version = _logVersion;
+		gravityTracker.getState(cp.gravity);
+		memcpy(cp.rollup,_rollup,sizeof(_rollup));
+		cp.checksum=checksum((const uint8_t*)&cp,sizeof(cp) - sizeof(cp.checksum));
+
+		char buff[36];
+		checkpointFilePath(buff,_fileInfo.logname);
+		File cpFile=SPIFFS.open(buff,"w");
+		if(!cpFile){
+			DBG_PRINTF("error open checkpoint\n");
+			return;
+		}
+		_bytesWritten += cpFile.write((const uint8_t*)&cp,sizeof(cp));
+		_writeCount ++;
+		cpFile.close();
+	}
+
+	// restore the state at the checkpoint, returns the offset to resume scanning from.
+	// 0, to scan the whole log, if the checkpoint is missing or invalid.
+	size_t loadCheckpoint(size_t fsize)
+	{
+		char buff[36];
+		checkpointFilePath(buff,_fileInfo.logname);
+		File cpFile=SPIFFS.open(buff,"r");
+		if(!cpFile) return 0;
+		LogCheckpoint cp;
+		size_t len=cpFile.read((uint8_t*)&cp,sizeof(cp));
+		cpFile.close();
+		if(len != sizeof(cp)
+			|| cp.magic != LogCheckpointMagic
+			|| cp.checksum != checksum((const uint8_t*)&cp,sizeof(cp) - sizeof(cp.checksum))
+			|| cp.starttime != _fileInfo.starttime
+			|| cp.length > fsize){
+			DBG_PRINTF("invalid checkpoint\n");
+			return 0;
+		}
+		_resumeLastLogTime = cp.time;
+		for(int i=0;i<5;i++) _iTempData[i]=cp.data[i];
+		_logVersion = cp.version;
+		gravityTracker.setState(cp.gravity);
+		memcpy(_rollup,cp.rollup,sizeof(_rollup));
+		DBG_PRINTF("checkpoint @%d, time:%ld\n",cp.length,cp.time);
+		return cp.length;
+	}
+
+	void rollupFilePath(char *buf,const char *logname,int rollup)
+	{
+		sprintf(buf,"%s/%s%s",LOG_PATH,logname,(rollup == RollupDay)? LOG_DAY_ROLLUP_EXT:LOG_HOUR_ROLLUP_EXT);
+	}
+
+	void resetRollups(void)
+	{
+		memset(_rollup,0,sizeof(_rollup));
+	}
+
+	// add a period record of time to the hour and the day it belongs to
+	void rollupAdd(uint32_t time,const uint16_t *values)
+	{
+		const uint8_t channels[RollupChannelNumber]={OrderBeerTemp,OrderFridgeTemp,OrderRoomTemp,OrderExtTemp,OrderGravity};
+		for(int r=0;r<2;r++){
+			uint32_t span=(r == RollupDay)? 86400:3600;
+			RollupAccumulator& acc=_rollup[r];
+			if(acc.time != time - time % span){
+				flushRollup(r);
+				memset(&acc,0,sizeof(acc));
+				acc.time = time - time % span;
+			}
+			for(int i=0;i<RollupChannelNumber;i++){
+				uint16_t v=values[channels[i]];
+				if(v == INVALID_TEMP_INT) continue;
+				// temperature: 0 ~ 225 as it is, -100 ~ 0 as 22500 - t
+				int16_t dv=(channels[i] == OrderGravity || v < 22500)? (int16_t)v:(int16_t)(22500 - (int)v);
+				if(acc.count[i] ==0 || dv < acc.min[i]) acc.min[i]=dv;
+				if(acc.count[i] ==0 || dv > acc.max[i]) acc.max[i]=dv;
+				acc.sum[i] += dv;
+				acc.count[i] ++;
+			}
+		}
+	}
+
+	// false if there is no data
+	bool makeRollupEntry(int rollup,RollupEntry& entry)
+	{
+		const RollupAccumulator& acc=_rollup[rollup];
+		bool data=false;
+		entry.time = acc.time;
+		for(int i=0;i<RollupChannelNumber;i++){
+			entry.count[i]=acc.count[i];
+			if(acc.count[i]){
+				data=true;
+				entry.min[i]=acc.min[i];
+				entry.max[i]=acc.max[i];
+				entry.mean[i]=(int16_t)(acc.sum[i] / (int32_t)acc.count[i]);
+			}else{
+				entry.min[i]=entry.max[i]=entry.mean[i]=0;
+			}
+		}
+		return data;
+	}
+
+	void flushRollup(int rollup)
+	{
+		RollupEntry entry;
+		if(!makeRollupEntry(rollup,entry)) return;
+		char buff[36];
+		rollupFilePath(buff,_fileInfo.logname,rollup);
+		File f=SPIFFS.open(buff,"a+");
+		if(!f){
+			DBG_PRINTF("error open rollup file\n");
+			return;
+		}
+		// written before, when resuming from a checkpoint or a full scan.
+		size_t size=f.size();
+		if(size >= sizeof(entry)){
+			RollupEntry last;
+			f.seek(size - sizeof(entry),SeekSet);
+			if(f.read((uint8_t*)&last,sizeof(last)) == sizeof(last) && last.time >= entry.time){
+				f.close();
+				return;
+			}
+			f.seek(0,SeekEnd);
+		}
+		_bytesWritten += f.write((const uint8_t*)&entry,sizeof(entry));
+		_writeCount ++;
+		f.close();
+		if(_fsspace > sizeof(entry)) _fsspace -= sizeof(entry);
+	}
+
+	// binary search of the time index.
+	// after==false: the last entry at or before time.
+	// after==true: the first entry after time.
+	bool findIndexEntry(uint32_t time,bool after,LogIndexEntry& entry)
+	{
+		char buff[36];
+		indexFilePath(buff,_fileInfo.logname);
+		File idxFile=SPIFFS.open(buff,"r");
+		if(!idxFile) return false;
+
+		int low=0;
+		int high= idxFile.size() / sizeof(LogIndexEntry);
+		// first entry with entry.time > time
+		while(low < high){
+			int mid = (low + high)/2;
+			idxFile.seek(mid * sizeof(LogIndexEntry),SeekSet);
+			idxFile.read((uint8_t*)&entry,sizeof(LogIndexEntry));
+			if(entry.time <= time) low = mid +1;
+			else high = mid;
+		}
+		int found= after? low:(low -1);
+		int count= idxFile.size() / sizeof(LogIndexEntry);
+		bool ret=false;
+		if(found >=0 && found < count){
+			idxFile.seek(found * sizeof(LogIndexEntry),SeekSet);
+			ret = (idxFile.read((uint8_t*)&entry,sizeof(LogIndexEntry)) == sizeof(LogIndexEntry));
+		}
+		idxFile.close();
+		return ret;
 	}
 
 	FileIndexes _fileInfo;
@@ -930,7 +1715,7 @@ private:
 
 	void saveIdxFile(void)
 	{
-		File idxFile= SPIFFS.open(LOG_RECORD_FILE,"w+");
+		File idxFile= FileCache.openToWrite(LOG_RECORD_FILE,"w+");
 		if(idxFile){
 			idxFile.write((uint8_t*)&_fileInfo,sizeof(_fileInfo));
 			idxFile.close();
@@ -53,6 +53,16 @@ extern "C" {
 #include "BrewPiProxy.h"
 
 #include "BrewLogger.h"
+#include "LogReader.h"
+#include "LogDownsampler.h"
+#include "ProgmemResponse.h"
+#include "RangeResponse.h"
+#include "FileCache.h"
+#include "JsonWriter.h"
+#include "TaskScheduler.h"
+#include "BrewPiTcpServer.h"
+#include "Metrics.h"
+#include "WebRoutes.h"
 
 #include "ExternalData.h"
 
@@ -97,30 +107,20 @@ R"END(
 #define WS_PATH 		"/websocket"
 #define SSE_PATH 		"/getline"
 
-#define POLLING_PATH 	"/getline_p"
-#define PUTLINE_PATH	"/putline"
-#define CONTROL_CC_PATH	"/tcc"
-
-#ifdef ENABLE_LOGGING
-#define LOGGING_PATH	"/log"
-#endif
-
 #define LOGLIST_PATH  "/loglist.php"
 #define CHART_DATA_PATH "/chart.php"
 
-#define CONFIG_PATH		"/config"
-#define TIME_PATH       "/time"
-#define RESETWIFI_PATH       "/erasewifisetting"
-
-#define FPUTS_PATH       "/fputs"
-#define FLIST_PATH       "/list"
-#define DELETE_PATH       "/rm"
-
 #define CHART_LIB_PATH       "/dygraph-combined.js"
 
 #define GRAVITY_PATH       "/gravity"
 
-#define GETSTATUS_PATH "/getstatus"
+#define SnapshotStatus 0x01
+#define SnapshotTemperatureSetting 0x02
+#define SnapshotTime 0x04
+#define SnapshotLine 0x08
+#define SnapshotGravity 0x10
+#define SnapshotLog 0x20
+#define SnapshotAll 0x3F
 
 #define DEFAULT_INDEX_FILE     "index.htm"
 
@@ -145,7 +145,7 @@ char password[32];
 char hostnetworkname[32];
 AsyncWebServer server(80);
 BrewPiProxy brewPi;
-BrewKeeper brewKeeper([](const char* str){ brewPi.putLine(str);});
+BrewKeeper brewKeeper;
 #ifdef ENABLE_LOGGING
 DataLogger dataLogger;
 #endif
@@ -177,6 +177,10 @@ Configuration Saved. Wait for restart...
 </body></html>)END";
 
 extern const uint8_t* getEmbeddedFile(const char* filename,bool &gzip, unsigned int &size);
+extern uint32_t getEmbeddedFileHash(const char* filename);
+
+#define EmbeddedFileCacheControl "no-cache"
+#define EmbeddedFileVersionedCacheControl "public, max-age=31536000, immutable"
 
 void requestRestart(bool disc);
 
@@ -219,6 +223,7 @@ class BrewPiWebHandler: public AsyncWebHandler
 	void handleFileDelete(AsyncWebServerRequest *request){
 		if(request->hasParam("path", true)){
         	ESP.wdtDisable(); SPIFFS.remove(request->getParam("path", true)->value()); ESP.wdtEnable(10);
+        	FileCache.invalidate(request->getParam("path", true)->value().c_str());
             request->send(200, "", "DELETE: "+request->getParam("path", true)->value());
         } else
           request->send(404);
@@ -229,7 +234,7 @@ class BrewPiWebHandler: public AsyncWebHandler
 			&& request->hasParam("content", true)){
         	ESP.wdtDisable();
     		String file=request->getParam("path", true)->value();
-    		File fh= SPIFFS.open(file, "w");
+    		File fh= FileCache.openToWrite(file.c_str());
     		if(!fh){
     			request->send(500);
     			return;
@@ -250,35 +255,21 @@ class BrewPiWebHandler: public AsyncWebHandler
 
     bool fileExists(String path)
     {
-	    if(SPIFFS.exists(path)) return true;
-	    bool dum;
-	    unsigned int dum2;
-
-	    if(getEmbeddedFile(path.c_str(),dum,dum2)) return true;
-	    if(path.endsWith(CHART_LIB_PATH) && SPIFFS.exists(CHART_LIB_PATH)) return true;
-	    return false;
+	    if(path.endsWith(CHART_LIB_PATH)) path = CHART_LIB_PATH;
+	    return FileCache.exists(path.c_str());
     }
 
 	void sendProgmem(AsyncWebServerRequest *request,const char* html)
 	{
-		AsyncWebServerResponse *response = request->beginResponse(String("text/html"),
-  			strlen_P(html),
-  			[=](uint8_t *buffer, size_t maxLen, size_t alreadySent) -> size_t {
-    			if (strlen_P(html+alreadySent)>maxLen) {
-	      		memcpy_P((char*)buffer, html+alreadySent, maxLen);
-    	  		return maxLen;
-    		}
-    		// Ok, last chunk
-    		memcpy_P((char*)buffer, html+alreadySent, strlen_P(html+alreadySent));
-    		return strlen_P(html+alreadySent); // Return from here to end of indexhtml
- 	 	});
+		AsyncWebServerResponse *response = new ProgmemResponse("text/html",html);
  	 	response->addHeader("Cache-Control","max-age=2592000");
 		request->send(response);
 	}
 
 	void sendFile(AsyncWebServerRequest *request,String path)
 	{
-		if(SPIFFS.exists(path)){
+		const FileCacheEntry *entry=FileCache.lookup(path.c_str());
+		if(entry->flags & (FileCacheInSpiffs | FileCacheGzipInSpiffs)){
 			//request->send(SPIFFS, path);
 			bool nocache=false;
 			for(byte i=0;i< sizeof(nocache_list)/sizeof(const char*);i++){
@@ -288,8 +279,15 @@ class BrewPiWebHandler: public AsyncWebHandler
 					}
 			}
 
-
-			AsyncWebServerResponse *response = request->beginResponse(SPIFFS, path);
+			// opened here, beginResponse(SPIFFS,path) would check the existence of the file and its .gz again
+			File file=SPIFFS.open((entry->flags & FileCacheInSpiffs)? path:(path + ".gz"),"r");
+			AsyncWebServerResponse *response = request->beginResponse(file, path);
+			if(!response){
+				// removed behind our back
+				FileCache.invalidate(path.c_str());
+				request->send(404);
+				return;
+			}
 			if(nocache)
 				response->addHeader("Cache-Control","no-cache");
 			else
@@ -298,230 +296,356 @@ class BrewPiWebHandler: public AsyncWebHandler
 			return;
 		}
 		//else
+		if(entry->flags & FileCacheEmbedded){
+			sendEmbeddedFile(request,path);
+		}
+	}
+
+	// embedded files change only with the firmware, the content hash is the ETag.
+	// Versioned urls, "?v=<etag>", are cached for good; others are revalidated.
+	void sendEmbeddedFile(AsyncWebServerRequest *request,const String& path)
+	{
+		char etag[12];
+		sprintf(etag,"\"%08x\"",(unsigned int)getEmbeddedFileHash(path.c_str()));
+		const char *cacheControl=EmbeddedFileCacheControl;
+		if(request->hasParam("v")){
+			// etag without quotes
+			if(strncmp(request->getParam("v")->value().c_str(),etag+1,8) ==0)
+				cacheControl=EmbeddedFileVersionedCacheControl;
+		}
+
+		if(request->hasHeader("If-None-Match")
+			&& request->getHeader("If-None-Match")->value().indexOf(etag) >=0){
+			AsyncWebServerResponse *response = request->beginResponse(304);
+			response->addHeader("ETag",etag);
+			response->addHeader("Cache-Control",cacheControl);
+			request->send(response);
+			return;
+		}
+
 		bool gzip;
 		uint32_t size;
 		const uint8_t* file=getEmbeddedFile(path.c_str(),gzip,size);
-		if(file){
-			DBG_PRINTF("using embedded file:%s\n",path.c_str());
-			if(gzip){
-                AsyncWebServerResponse *response = request->beginResponse_P(200, "text/html", file, size);
-                response->addHeader("Content-Encoding", "gzip");
-                request->send(response);
-			}else sendProgmem(request,(const char*)file);
-		}
+		DBG_PRINTF("using embedded file:%s\n",path.c_str());
+		AsyncWebServerResponse *response;
+		if(gzip) response= new ProgmemResponse("text/html",file,size,true);
+		else response= new ProgmemResponse("text/html",file);
+		response->addHeader("ETag",etag);
+		response->addHeader("Cache-Control",cacheControl);
+		request->send(response);
 	}
 
-public:
-	BrewPiWebHandler(void){}
+	void handlePolling(AsyncWebServerRequest *request){
+ 		const char *line=brewPi.getLastLine();
+ 		if(line[0]!=0) request->send(200, "text/plain", line);
+ 		else request->send(200, "text/plain;", "");
+	}
 
-	void handleRequest(AsyncWebServerRequest *request){
-	 	if(request->method() == HTTP_GET && request->url() == POLLING_PATH) {
-	 		char *line=brewPi.getLastLine();
-	 		if(line[0]!=0) request->send(200, "text/plain", line);
-	 		else request->send(200, "text/plain;", "");
-	 	}else if(request->method() == HTTP_POST && request->url() == PUTLINE_PATH){
-	 		String data=request->getParam("data", true, false)->value();
-	 		//DBG_PRINTF("putline:%s\n",data.c_str());
-
-			if(data.startsWith("j") && !request->authenticate(username, password))
-		        return request->requestAuthentication();
-
-	 		brewPi.putLine(data.c_str());
-	 		request->send(200);
-	 	}else if(request->method() == HTTP_GET && request->url() == CONTROL_CC_PATH){
-	 		char unit;
-	 		float minTemp,maxTemp;
-	 		brewPi.getTemperatureSetting(&unit,&minTemp,&maxTemp);
-	 		String json=String("{\"tempSetMin\":") + String(minTemp)
-	 			+ String(",\"tempSetMax\":") + String(maxTemp)
-	 			+ String(",\"tempFormat\":\"") + String(unit)  +String("\"}");
-	 		request->send(200,"application/json",json);
-
-	 	}else if(request->method() == HTTP_GET && request->url() == CONFIG_PATH){
-	 	    if(!request->authenticate(username, password))
+	void handlePutLine(AsyncWebServerRequest *request){
+ 		String data=request->getParam("data", true, false)->value();
+ 		//DBG_PRINTF("putline:%s\n",data.c_str());
+
+		if(data.startsWith("j") && !request->authenticate(username, password))
 	        return request->requestAuthentication();
 
-			AsyncResponseStream *response = request->beginResponseStream("text/html");
+ 		brewPi.putLine(data.c_str());
+ 		request->send(200);
+	}
+
+	void temperatureSettingJson(JsonWriter& json){
+ 		char unit;
+ 		float minTemp,maxTemp;
+ 		brewPi.getTemperatureSetting(&unit,&minTemp,&maxTemp);
+ 		char format[2]={unit,'\0'};
+ 		json.beginObject();
+ 		json.add("tempSetMin",minTemp,2);
+ 		json.add("tempSetMax",maxTemp,2);
+ 		json.add("tempFormat",format);
+ 		json.endObject();
+	}
+
+	void handleControlConstant(AsyncWebServerRequest *request){
+ 		char buf[80];
+ 		BufferPrint out(buf,sizeof(buf));
+ 		JsonWriter json(out);
+ 		temperatureSettingJson(json);
+ 		request->send(200,"application/json",buf);
+	}
+
+	void handleGetConfig(AsyncWebServerRequest *request){
+		AsyncResponseStream *response = request->beginResponseStream("text/html");
+
+	  	int size=strlen_P(confightml);
+		char *fmt=(char*) malloc(size +1);
+			if(!fmt){
+				request->send(500);
+				DBG_PRINTF("!!Alloc error\n");
+				return;
+			}
+
+		strcpy_P(fmt,confightml);
+
+		response->printf(fmt,hostnetworkname,username,password,(passwordLcd? "checked=\"checked\"":""),(stationApMode? "checked=\"checked\"":""));
+		free(fmt);
+		request->send(response);
+	}
+
+	void handleSetConfig(AsyncWebServerRequest *request){
+		if(request->hasParam("name", true)
+				&& request->hasParam("user", true)
+				&& request->hasParam("pass", true)){
+			AsyncWebParameter* name = request->getParam("name", true);
+			AsyncWebParameter* user = request->getParam("user", true);
+			AsyncWebParameter* pass = request->getParam("pass", true);
+
+			File config=FileCache.openToWrite(CONFIG_FILENAME,"w+");
+
+			if(!config){
+				request->send(500);
+				return;
+			}
 
-		  	int size=strlen_P(confightml);
-  			char *fmt=(char*) malloc(size +1);
-  				if(!fmt){
-  					request->send(500);
-					DBG_PRINTF("!!Alloc error\n");
-  					return;
-  				}
+			int protect =(request->hasParam("protect", true))? 1:0;
+			int ap = (request->hasParam("ap", true))? 1:0;
+			DBG_PRINTF("STA_AP mode? %d\n",ap);
 
-  			strcpy_P(fmt,confightml);
+			int size=strlen_P(configFormat);
+			char *fmt=(char*) malloc(size +1);
+			if(!fmt){
+				request->send(500);
+				DBG_PRINTF("!!Alloc error\n");
+				return;
+			}
+			strcpy_P(fmt,configFormat);
 
-			response->printf(fmt,hostnetworkname,username,password,(passwordLcd? "checked=\"checked\"":""),(stationApMode? "checked=\"checked\"":""));
+			config.printf(fmt,name->value().c_str(),
+										user->value().c_str(),
+										pass->value().c_str(),
+										protect,ap);
 			free(fmt);
-			request->send(response);
-	 	}else if(request->method() == HTTP_POST && request->url() == CONFIG_PATH){
-	 	    if(!request->authenticate(username, password))
-	        return request->requestAuthentication();
+			config.flush();
+			config.close();
+			sendProgmem(request,saveconfightml); //request->send(200,"text/html",saveconfightml);
+			requestRestart(false);
+		}else{
+  			request->send(400);
+		}
+	}
 
-			if(request->hasParam("name", true)
-					&& request->hasParam("user", true)
-  					&& request->hasParam("pass", true)){
-  				AsyncWebParameter* name = request->getParam("name", true);
-  				AsyncWebParameter* user = request->getParam("user", true);
-  				AsyncWebParameter* pass = request->getParam("pass", true);
-
-  				File config=SPIFFS.open(CONFIG_FILENAME,"w+");
-
-  				if(!config){
-  					request->send(500);
-  					return;
-  				}
-
-  				int protect =(request->hasParam("protect", true))? 1:0;
-  				int ap = (request->hasParam("ap", true))? 1:0;
-  				DBG_PRINTF("STA_AP mode? %d\n",ap);
-
-  				int size=strlen_P(configFormat);
-  				char *fmt=(char*) malloc(size +1);
-  				if(!fmt){
-  					request->send(500);
-					DBG_PRINTF("!!Alloc error\n");
-  					return;
-  				}
-  				strcpy_P(fmt,configFormat);
-
-  				config.printf(fmt,name->value().c_str(),
-  											user->value().c_str(),
-  											pass->value().c_str(),
-  											protect,ap);
-  				free(fmt);
-  				config.flush();
-  				config.close();
-				sendProgmem(request,saveconfightml); //request->send(200,"text/html",saveconfightml);
-				requestRestart(false);
-  			}else{
-	  			request->send(400);
-  			}
-	 	}else if(request->method() == HTTP_GET &&  request->url() == TIME_PATH){
-			AsyncResponseStream *response = request->beginResponseStream("application/json");
-			response->printf("{\"t\":\"%s\",\"e\":%ld}",TimeKeeper.getDateTimeStr(),TimeKeeper.getTimeSeconds());
-			request->send(response);
-		}else if(request->method() == HTTP_POST &&  request->url() == TIME_PATH){
-			if(request->hasParam("time", true)){
-  				AsyncWebParameter* tvalue = request->getParam("time", true);
-  				DBG_PRINTF("Set Time:%ld\n",tvalue->value().toInt());
-	 			TimeKeeper.setCurrentTime(tvalue->value().toInt());
-	 			request->send(200, "text/plain;", "");
-	 		}else{
-	 			request->send(400);
-	 		}
-	 	}else if(request->method() == HTTP_GET &&  request->url() == RESETWIFI_PATH){
-	 	    if(!request->authenticate(username, password))
-	        return request->requestAuthentication();
-		 	request->send(200,"text/html","Done, restarting..");
-			requestRestart(true);
-	 	}else if(request->method() == HTTP_POST &&  request->url() == FLIST_PATH){
-	 	    if(!request->authenticate(username, password))
-	        return request->requestAuthentication();
+	void timeJson(JsonWriter& json){
+		json.beginObject();
+		json.add("t",TimeKeeper.getDateTimeStr());
+		json.add("e",(uint32_t)TimeKeeper.getTimeSeconds());
+		json.endObject();
+	}
 
-			handleFileList(request);
-	 	}else if(request->method() == HTTP_DELETE &&  request->url() == DELETE_PATH){
-	 	    if(!request->authenticate(username, password))
-	        return request->requestAuthentication();
+	void handleGetTime(AsyncWebServerRequest *request){
+		char buf[64];
+		BufferPrint out(buf,sizeof(buf));
+		JsonWriter json(out);
+		timeJson(json);
+		request->send(200,"application/json",buf);
+	}
 
-			handleFileDelete(request);
-	 	}else if(request->method() == HTTP_POST &&  request->url() == FPUTS_PATH){
-	 	    if(!request->authenticate(username, password))
-	        return request->requestAuthentication();
+	void handleSetTime(AsyncWebServerRequest *request){
+		if(request->hasParam("time", true)){
+			AsyncWebParameter* tvalue = request->getParam("time", true);
+			DBG_PRINTF("Set Time:%ld\n",tvalue->value().toInt());
+ 			TimeKeeper.setCurrentTime(tvalue->value().toInt());
+ 			request->send(200, "text/plain;", "");
+ 		}else{
+ 			request->send(400);
+ 		}
+	}
 
-			handleFilePuts(request);
-		}else if(request->method() == HTTP_GET && request->url() == GETSTATUS_PATH){
-			uint8_t mode, state;
-			float beerSet, beerTemp, fridgeTemp, fridgeSet, roomTemp;
-			brewPi.getAllStatus(&state, &mode, &beerTemp, &beerSet, &fridgeTemp, &fridgeSet, &roomTemp);
-			#define TEMPorNull(a) (IS_FLOAT_TEMP_VALID(a)?  String(a):String("null"))
-			String json=String("{\"mode\":\"") + String((char) mode)
-			+ String("\",\"state\":") + String(state)
-			+ String(",\"beerSet\":") + TEMPorNull(beerSet)
-			+ String(",\"beerTemp\":") + TEMPorNull(beerTemp)
-			+ String(",\"fridgeSet\":") + TEMPorNull(fridgeSet)
-			+ String(",\"fridgeTemp\":") + TEMPorNull(fridgeTemp)
-			+ String(",\"roomTemp\":") + TEMPorNull(roomTemp)
-			+String("}");
-			request->send(200,"application/json",json);
-
-	 	#ifdef ENABLE_LOGGING
-	 	}else if (request->url() == LOGGING_PATH){
-	 		if(request->method() == HTTP_POST){
-		 		dataLogger.updateSetting(request);
-	 		}else{
-	 			dataLogger.getSettings(request);
-	 		}
-	 	#endif
-	 	}else if(request->method() == HTTP_GET){
+	void handleResetWiFi(AsyncWebServerRequest *request){
+	 	request->send(200,"text/html","Done, restarting..");
+		requestRestart(true);
+	}
 
-			String path=request->url();
-	 		if(path.endsWith("/")) path +=DEFAULT_INDEX_FILE;
-	 		else if(path.endsWith(CHART_LIB_PATH)) path = CHART_LIB_PATH;
-
-	 		if(request->url().equals("/")){
-		 		if(!passwordLcd){
-		 			sendFile(request,path); //request->send(SPIFFS, path);
-		 			return;
-		 		}
-		 	}
-			bool auth=true;
-
-			for(byte i=0;i< sizeof(public_list)/sizeof(const char*);i++){
-				if(path.equals(public_list[i])){
-						auth=false;
-						break;
-					}
+	void statusJson(JsonWriter& json){
+		uint8_t mode, state;
+		float beerSet, beerTemp, fridgeTemp, fridgeSet, roomTemp;
+		brewPi.getAllStatus(&state, &mode, &beerTemp, &beerSet, &fridgeTemp, &fridgeSet, &roomTemp);
+		#define TEMPorNull(a) (IS_FLOAT_TEMP_VALID(a)? (a):NAN)
+		char modeStr[2]={(char)mode,'\0'};
+		json.beginObject();
+		json.add("mode",modeStr);
+		json.add("state",(uint32_t)state);
+		json.add("beerSet",TEMPorNull(beerSet),2);
+		json.add("beerTemp",TEMPorNull(beerTemp),2);
+		json.add("fridgeSet",TEMPorNull(fridgeSet),2);
+		json.add("fridgeTemp",TEMPorNull(fridgeTemp),2);
+		json.add("roomTemp",TEMPorNull(roomTemp),2);
+		json.endObject();
+	}
+
+	void handleGetStatus(AsyncWebServerRequest *request){
+		char buf[160];
+		BufferPrint out(buf,sizeof(buf));
+		JsonWriter json(out);
+		statusJson(json);
+		request->send(200,"application/json",buf);
+	}
+
+	// everything the main page asks for on load, in one response.
+	// "m" selects the parts, a hex mask of Snapshot* bits, all by default.
+	void handleSnapshot(AsyncWebServerRequest *request){
+		uint8_t mask=SnapshotAll;
+		if(request->hasParam("m")) mask = strtoul(request->getParam("m")->value().c_str(),NULL,16);
+
+		AsyncResponseStream *response = request->beginResponseStream("application/json");
+		JsonWriter json(*response);
+		json.beginObject();
+		if(mask & SnapshotStatus){
+			json.key("status");
+			statusJson(json);
+		}
+		if(mask & SnapshotTemperatureSetting){
+			json.key("tcc");
+			temperatureSettingJson(json);
+		}
+		if(mask & SnapshotTime){
+			json.key("time");
+			timeJson(json);
+		}
+		if(mask & SnapshotLine){
+			json.add("line",brewPi.getLastLine());
+		}
+		if(mask & SnapshotGravity){
+			json.key("gravity");
+			if(externalData.iSpindelEnabled()){
+				char buf[128];
+				externalData.sseNotify(buf);
+				// skip "G:"
+				json.raw(buf + 2);
+			}else{
+				json.null();
 			}
+		}
+		#ifdef ENABLE_LOGGING
+		if(mask & SnapshotLog){
+			json.key("log");
+			brewLogger.loggingStatus(json);
+		}
+		#endif
+		json.endObject();
+		request->send(response);
+	}
 
-	 	    if(auth && !request->authenticate(username, password))
-	        return request->requestAuthentication();
+	#ifdef ENABLE_LOGGING
+	void handleGetLogging(AsyncWebServerRequest *request){
+		dataLogger.getSettings(request);
+	}
 
-	 		sendFile(request,path); //request->send(SPIFFS, path);
+	void handleSetLogging(AsyncWebServerRequest *request){
+		dataLogger.updateSetting(request);
+	}
+	#endif
+
+	void handleGetFile(AsyncWebServerRequest *request){
+		String path=request->url();
+ 		if(path.endsWith("/")) path +=DEFAULT_INDEX_FILE;
+ 		else if(path.endsWith(CHART_LIB_PATH)) path = CHART_LIB_PATH;
+
+ 		if(request->url().equals("/")){
+	 		if(!passwordLcd){
+	 			sendFile(request,path); //request->send(SPIFFS, path);
+	 			return;
+	 		}
+	 	}
+		bool auth=true;
+
+		for(byte i=0;i< sizeof(public_list)/sizeof(const char*);i++){
+			if(path.equals(public_list[i])){
+					auth=false;
+					break;
+				}
+		}
+
+ 	    if(auth && !request->authenticate(username, password))
+        return request->requestAuthentication();
+
+ 		sendFile(request,path); //request->send(SPIFFS, path);
+	}
+
+	// fixed paths, in WebRoutes.h
+	typedef void (BrewPiWebHandler::*RouteHandler)(AsyncWebServerRequest *request);
+	typedef WebRoute<RouteHandler> Route;
+
+	static const Route _routes[];
+	static const uint8_t _routeNumber;
+#if EnableMetrics == true
+	// one for each route. Only the handler is timed, not the sending
+	static MetricsProbe _routeProbes[];
+	static MetricsProbe _fileProbe;
+
+	void handleMetrics(AsyncWebServerRequest *request){
+		AsyncResponseStream *response = request->beginResponseStream("text/plain; version=0.0.4");
+		Metrics.printPrometheus(*response);
+		request->send(response);
+	}
+#endif
+
+	const Route* findRoute(AsyncWebServerRequest *request){
+		return ::findRoute(_routes,_routeNumber,request->method(),request->url().c_str());
+	}
+
+public:
+	BrewPiWebHandler(void){
+#if EnableMetrics == true
+		for(uint8_t i=0;i< _routeNumber;i++) _routeProbes[i].begin("web",_routes[i].path);
+#endif
+	}
+
+	void handleRequest(AsyncWebServerRequest *request){
+		const Route *route=findRoute(request);
+		if(route){
+			if(route->auth && !request->authenticate(username, password))
+				return request->requestAuthentication();
+			METRICS_SCOPE(_routeProbes[route - _routes]);
+			(this->*(route->handler))(request);
+		}else if(request->method() == HTTP_GET){
+			METRICS_SCOPE(_fileProbe);
+			handleGetFile(request);
 		}
 	 }
 
 	bool canHandle(AsyncWebServerRequest *request){
+		if(findRoute(request)) return true;
 	 	if(request->method() == HTTP_GET){
-	 		if(request->url() == POLLING_PATH || request->url() == CONFIG_PATH || request->url() == TIME_PATH
-			 || request->url() == RESETWIFI_PATH || request->url() == CONTROL_CC_PATH
-			 || request->url() == GETSTATUS_PATH
-	 		#ifdef ENABLE_LOGGING
-	 		|| request->url() == LOGGING_PATH
-	 		#endif
-	 		){
-	 			return true;
-			}else{
-				// get file
-				String path=request->url();
-	 			if(path.endsWith("/")) path +=DEFAULT_INDEX_FILE;
-	 			//DBG_PRINTF("request:%s\n",path.c_str());
-				if(fileExists(path)) return true; //if(SPIFFS.exists(path)) return true;
+			request->addInterestingHeader("If-None-Match");
+			// get file
+			String path=request->url();
+ 			if(path.endsWith("/")) path +=DEFAULT_INDEX_FILE;
+ 			//DBG_PRINTF("request:%s\n",path.c_str());
+			if(fileExists(path)) return true; //if(SPIFFS.exists(path)) return true;
 
-				//DBG_PRINTF("request:%s not found\n",path.c_str());
-			}
-	 	}else if(request->method() == HTTP_DELETE && request->url() == DELETE_PATH){
-				return true;
-	 	}else if(request->method() == HTTP_POST){
-	 		if(request->url() == PUTLINE_PATH || request->url() == CONFIG_PATH
-	 			|| request->url() ==  FPUTS_PATH || request->url() == FLIST_PATH
-	 			|| request->url() == TIME_PATH
-	 			#ifdef ENABLE_LOGGING
-	 			|| request->url() == LOGGING_PATH
-	 			#endif
-	 			)
-	 			return true;
-		}
+			//DBG_PRINTF("request:%s not found\n",path.c_str());
+	 	}
 		return false;
 	 }
 };
 
+#define ROUTE(m,p,a,h) {pathHash(p),m,a,&BrewPiWebHandler::h,p},
+
+const BrewPiWebHandler::Route BrewPiWebHandler::_routes[]={
+	WEB_ROUTES(ROUTE)
+};
+
+const uint8_t BrewPiWebHandler::_routeNumber=sizeof(BrewPiWebHandler::_routes)/sizeof(BrewPiWebHandler::Route);
+
+#if EnableMetrics == true
+MetricsProbe BrewPiWebHandler::_routeProbes[sizeof(BrewPiWebHandler::_routes)/sizeof(BrewPiWebHandler::Route)];
+MetricsProbe BrewPiWebHandler::_fileProbe("web_file");
+#endif
+
 BrewPiWebHandler brewPiWebHandler;
 
 #if ResponseAppleCNA == true
 
+static const char *cna_hosts[]={"apple","itools","ibook","airport","thinkdifferent","akamai"};
+
 class AppleCNAHandler: public AsyncWebHandler
 {
 public:
@@ -530,18 +654,13 @@ public:
 		request->send(200, "text/html", "<HTML><HEAD><TITLE>Success</TITLE></HEAD><BODY>Success</BODY></HTML>");
 	}
 	bool canHandle(AsyncWebServerRequest *request){
-		String host=request->host();
-		//DBG_PRINTF("Request host:");
-		//DBG_PRINTF(host.c_str());
-		//DBG_PRINTF("\n");
-  		if(host.indexOf(String("apple")) >=0
-  		|| host.indexOf(String("itools")) >=0
-  		|| host.indexOf(String("ibook")) >=0
-  		|| host.indexOf(String("airport")) >=0
-  		|| host.indexOf(String("thinkdifferent")) >=0
-  		|| host.indexOf(String("akamai")) >=0 ){
-  			return true;
-  		}
+		// the captive portal is only there in AP mode
+		if(!(WiFi.getMode() & WIFI_AP)) return false;
+		const String& host=request->host();
+		//DBG_PRINTF("Request host:%s\n",host.c_str());
+		for(byte i=0;i< sizeof(cna_hosts)/sizeof(const char*);i++){
+			if(strstr(host.c_str(),cna_hosts[i])) return true;
+		}
   		return false;
 	}
 };
@@ -627,10 +746,32 @@ void notifyLogStatus(void)
 void reportRssi(void)
 {
 	char buf[32];
-	sprintf(buf,"V:{\"rssi\":%d}",WiFi.RSSI());
+	BufferPrint out(buf,sizeof(buf));
+	out.print("V:");
+	JsonWriter json(out);
+	json.beginObject();
+	json.add("rssi",(int32_t)WiFi.RSSI());
+	json.endObject();
 	stringAvailable(buf);
 }
 
+#if EnableMetrics == true
+// the "metrics" event, which the pages don't listen to
+void reportMetrics(void)
+{
+#if UseServerSideEvent == true
+	if(sse.count() ==0) return;
+	char *buffer=(char*)malloc(MetricsJsonSize);
+	if(!buffer) return;
+	BufferPrint out(buffer,MetricsJsonSize);
+	Metrics.printJson(out);
+	if(out.overflow()) DBG_PRINTF("metrics too long\n");
+	else sse.send(buffer,"metrics");
+	free(buffer);
+#endif
+}
+#endif
+
 void onClientConnected(AsyncEventSourceClient *client){
 	DBG_PRINTF("SSE Connect\n");
 	char buf[128];
@@ -646,27 +787,221 @@ void onClientConnected(AsyncEventSourceClient *client){
 
 #define MAX_DATA_SIZE 256
 
+class DownsampledLogResponse: public AsyncAbstractResponse
+{
+	LogDownsampler *_sampler;
+public:
+	// the length is not known. HTTP/1.0 has no chunks, the close ends the body.
+	DownsampledLogResponse(LogDownsampler *sampler,uint8_t version):_sampler(sampler){
+		_code = 200;
+		_contentType = "application/octet-stream";
+		_contentLength = 0;
+		_sendContentLength = false;
+		_chunked = version !=0;
+	}
+	~DownsampledLogResponse(){ delete _sampler; }
+	bool _sourceValid(){ return _sampler != NULL; }
+	size_t _fillBuffer(uint8_t *buf, size_t maxLen){ return _sampler->read(buf,maxLen); }
+};
+
+class LogReaderResponse: public RangeResponse
+{
+	LogReader *_reader;
+public:
+	LogReaderResponse(LogReader *reader,size_t size,int code=200):_reader(reader){
+		_code = code;
+		_contentType = "application/octet-stream";
+		_contentLength = size;
+	}
+	~LogReaderResponse(){ delete _reader; }
+	bool _sourceValid(){ return _reader != NULL; }
+	size_t _fillBuffer(uint8_t *buf, size_t maxLen){ return _reader->read(buf,maxLen); }
+};
+
+// part of a log file, for Range requests
+class LogFileResponse: public RangeResponse
+{
+	File _file;
+public:
+	LogFileResponse(File file,size_t start,size_t size,int code):_file(file){
+		_code = code;
+		_contentType = "application/octet-stream";
+		_contentLength = size;
+		if(start) _file.seek(start,SeekSet);
+	}
+	~LogFileResponse(){ if(_file) _file.close(); }
+	bool _sourceValid(){ return !!(_file); }
+	size_t _fillBuffer(uint8_t *buf, size_t maxLen){ return _file.read(buf,maxLen); }
+};
+
+// archived logs don't change. Cached for a year when the URL carries the start time, "t".
+#define ArchivedLogCacheControl "public, max-age=31536000, immutable"
+
 class LogHandler:public AsyncWebHandler
 {
+	// strong validator: start time and length of the log
+	static String logETag(unsigned long starttime,size_t size)
+	{
+		char buf[24];
+		sprintf(buf,"\"%lx-%x\"",starttime,size);
+		return String(buf);
+	}
+
+	static bool notModified(AsyncWebServerRequest *request,const String& etag)
+	{
+		if(!request->hasHeader("If-None-Match")) return false;
+		String tags=request->getHeader("If-None-Match")->value();
+		return tags == "*" || tags.indexOf(etag) >=0;
+	}
+
+	// single range only: "bytes=first-last", "bytes=first-", or "bytes=-suffix".
+	// returns 1 for [start,end), 0 to send the whole content, -1 if not satisfiable.
+	static int byteRange(AsyncWebServerRequest *request,const String& etag,size_t size,size_t& start,size_t& end)
+	{
+		start=0;
+		end=size;
+		if(!request->hasHeader("Range")) return 0;
+		// If-Range: the part only if the log is the same
+		if(request->hasHeader("If-Range") && request->getHeader("If-Range")->value() != etag) return 0;
+		String range=request->getHeader("Range")->value();
+		int dash=range.indexOf('-');
+		if(!range.startsWith("bytes=") || dash <0 || range.indexOf(',') >=0) return 0;
+		String first=range.substring(6,dash);
+		String last=range.substring(dash+1);
+		if(first.length() ==0){
+			size_t suffix=last.toInt();
+			if(suffix ==0) return -1;
+			if(suffix < size) start = size - suffix;
+		}else{
+			start=first.toInt();
+			if(last.length() >0){
+				size_t lastByte=last.toInt();
+				if(lastByte < start){
+					start=0;
+					return 0;
+				}
+				if(lastByte +1 < size) end = lastByte +1;
+			}
+		}
+		return (start < size)? 1:-1;
+	}
+
+	static void sendRangeError(AsyncWebServerRequest *request,size_t size)
+	{
+		AsyncWebServerResponse *response = request->beginResponse(416);
+		response->addHeader("Content-Range","bytes */" + String(size));
+		request->send(response);
+	}
+
+	static void sendNotModified(AsyncWebServerRequest *request,const String& etag,const char *cacheControl)
+	{
+		AsyncWebServerResponse *response = request->beginResponse(304);
+		response->addHeader("ETag",etag);
+		response->addHeader("Cache-Control",cacheControl);
+		request->send(response);
+	}
+
+	void sendArchivedLog(AsyncWebServerRequest *request,int index)
+	{
+		char buf[36];
+		if(request->hasParam("rollup"))
+			brewLogger.getRollupPath(buf,index,(request->getParam("rollup")->value() == "day")? RollupDay:RollupHour);
+		else
+			brewLogger.getFilePath(buf,index);
+		unsigned long starttime=brewLogger.getFileStartTime(index);
+		// the log of index changed after a deletion
+		if(request->hasParam("t") && (unsigned long)request->getParam("t")->value().toInt() != starttime){
+			request->send(404);
+			return;
+		}
+		const char *cacheControl=request->hasParam("t")? ArchivedLogCacheControl:"no-cache";
+
+		File file=SPIFFS.open(buf,"r");
+		if(!file){
+			request->send(404);
+			return;
+		}
+		size_t size=file.size();
+		String etag=logETag(starttime,size);
+		if(notModified(request,etag)){
+			file.close();
+			sendNotModified(request,etag,cacheControl);
+			return;
+		}
+		size_t start,end;
+		int range=byteRange(request,etag,size,start,end);
+		if(range <0){
+			file.close();
+			sendRangeError(request,size);
+			return;
+		}
+		RangeResponse *response=new LogFileResponse(file,start,end - start,(range >0)? 206:200);
+		response->addRangeHeaders(range,start,end,size);
+		response->addHeader("ETag",etag);
+		response->addHeader("Cache-Control",cacheControl);
+		request->send(response);
+	}
+
+	// whole current log, or a part of it by Range
+	void sendCurrentLog(AsyncWebServerRequest *request)
+	{
+		size_t size=brewLogger.currentLogLength();
+		String etag=logETag(brewLogger.currentStartTime(),size);
+		if(notModified(request,etag)){
+			sendNotModified(request,etag,"no-cache");
+			return;
+		}
+		size_t start,end;
+		int range=byteRange(request,etag,size,start,end);
+		if(range <0){
+			sendRangeError(request,size);
+			return;
+		}
+		LogReader *reader=new LogReader();
+		if(reader->beginBytes(start,end) ==0){
+			delete reader;
+			request->send(204);
+			return;
+		}
+		RangeResponse *response=new LogReaderResponse(reader,end - start,(range >0)? 206:200);
+		response->addRangeHeaders(range,start,end,size);
+		response->addHeader("ETag",etag);
+		response->addHeader("Cache-Control","no-cache");
+		request->send(response);
+	}
+
+	bool sendDownsampledLog(AsyncWebServerRequest *request,uint32_t points)
+	{
+		uint32_t bucket=LogDownsampler::bucketSize(brewLogger.periodRecordNumber(),points);
+		if(bucket ==0) return false;
+
+		LogReader *reader=new LogReader();
+		if(reader->beginAfter(0) ==0){
+			delete reader;
+			return false;
+		}
+		DBG_PRINTF("downsample %d points, bucket:%d\n",points,bucket);
+		request->send(new DownsampledLogResponse(new LogDownsampler(reader,bucket),request->version()));
+		return true;
+	}
 public:
 
 	void handleRequest(AsyncWebServerRequest *request){
+		METRICS_PROBE("web_log");
 		if( request->url() == LOGLIST_PATH){
 			if(request->hasParam("dl")){
 				int index=request->getParam("dl")->value().toInt();
-				char buf[36];
-				brewLogger.getFilePath(buf,index);
-				if(SPIFFS.exists(buf)){
-					request->send(SPIFFS,buf,"application/octet-stream");
-				}else{
-					request->send(404);
-				}
+				sendArchivedLog(request,index);
 			}else if(request->hasParam("rm")){
 				int index=request->getParam("rm")->value().toInt();
 				DBG_PRINTF("Delete log file %d\n",index);
 				brewLogger.rmLog(index);
 
-				request->send(200,"application/json",brewLogger.fsinfo());
+				char buf[96];
+				BufferPrint out(buf,sizeof(buf));
+				JsonWriter json(out);
+				brewLogger.fsinfo(json);
+				request->send(200,"application/json",buf);
 			}else if(request->hasParam("start")){
 				String filename=request->getParam("start")->value();
 				DBG_PRINTF("start logging:%s\n",filename.c_str());
@@ -682,8 +1017,10 @@ public:
 				notifyLogStatus();
 			}else{
 				// default. list information
-				String status=brewLogger.loggingStatus();
-				request->send(200,"application/json",status);
+				AsyncResponseStream *response = request->beginResponseStream("application/json");
+				JsonWriter json(*response);
+				brewLogger.loggingStatus(json);
+				request->send(response);
 			}
 			return;
 		} // end of logist path
@@ -707,6 +1044,21 @@ public:
 			indexValid=false;
 		}
 
+		if(request->hasParam("rollup")){
+			// hourly or daily summary, RollupEntry array
+			int rollup=(request->getParam("rollup")->value() == "day")? RollupDay:RollupHour;
+			size_t size=brewLogger.rollupSize(rollup);
+			if(size >0){
+				request->send("application/octet-stream", size,
+						[rollup](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+					return brewLogger.readRollup(rollup,buffer,maxLen,index);
+				});
+			}else{
+				request->send(204);
+			}
+			return;
+		}
+
 		if(!brewLogger.isLogging()){
 			// volatile logging
 			if(!indexValid){
@@ -714,13 +1066,14 @@ public:
 				offset=0;
 				index =0;
 			}
-			size_t size=brewLogger.volatileDataAvailable(index,offset);
+			VolatileCursor cursor;
+			size_t size=brewLogger.volatileDataAvailable(index,offset,cursor);
 			size_t logoffset=brewLogger.volatileDataOffset();
 
 			if(size >0){
 				AsyncWebServerResponse *response = request->beginResponse("application/octet-stream", size,
-						[](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
-					return brewLogger.readVolatileData(buffer, maxLen,index);
+						[cursor](uint8_t *buffer, size_t maxLen, size_t index) mutable -> size_t {
+					return brewLogger.readVolatileData(buffer, maxLen,cursor);
 				});
 				response->addHeader("LogOffset",String(logoffset));
 				request->send(response);
@@ -733,12 +1086,41 @@ public:
 				offset=0;
 			}
 
-			size_t size=brewLogger.beginCopyAfter(offset);
+			if(!LogReader::available()){
+				// too many concurrent readers, let the client retry
+				AsyncWebServerResponse *response = request->beginResponse(503);
+				response->addHeader("Retry-After",LogReaderRetryAfter);
+				request->send(response);
+				return;
+			}
+
+			if(request->hasParam("points")){
+				// whole log, reduced to about points records. Each resume adds
+				// a partial bucket, two records over the count.
+				int points=request->getParam("points")->value().toInt();
+				if(points >0 && sendDownsampledLog(request,points)) return;
+			}
+
+			if(!request->hasParam("from") && !request->hasParam("offset")){
+				// plain download of the log, by Range and ETag
+				sendCurrentLog(request);
+				return;
+			}
+
+			LogReader *reader=new LogReader();
+			size_t size;
+			if(request->hasParam("from")){
+				// time range, seek by time index
+				uint32_t from=request->getParam("from")->value().toInt();
+				uint32_t to=(request->hasParam("to"))? request->getParam("to")->value().toInt():0;
+				size=reader->beginRange(from,to);
+			}else{
+				size=reader->beginAfter(offset);
+			}
 			if(size >0){
-				request->send("application/octet-stream", size, [](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
-					return brewLogger.read(buffer, maxLen,index);
-				});
+				request->send(new LogReaderResponse(reader,size));
 			}else{
+				delete reader;
 				request->send(204);
 			}
 		}
@@ -746,7 +1128,12 @@ public:
 
 	LogHandler(){}
 	bool canHandle(AsyncWebServerRequest *request){
-	 	if(request->url() == CHART_DATA_PATH || request->url() ==LOGLIST_PATH) return true;
+	 	if(request->url() == CHART_DATA_PATH || request->url() ==LOGLIST_PATH){
+			request->addInterestingHeader("Range");
+			request->addInterestingHeader("If-Range");
+			request->addInterestingHeader("If-None-Match");
+			return true;
+		}
 	 	return false;
 	}
 };
@@ -804,6 +1191,7 @@ public:
 	}
 
 	void handleRequest(AsyncWebServerRequest *request){
+		METRICS_PROBE("web_gravity");
 		if(request->url() == GRAVITY_PATH){
 			if(request->method() != HTTP_POST){
 				request->send(400);
@@ -820,7 +1208,7 @@ public:
 		if(request->method() == HTTP_POST){
 			// post
 
-  			File config=SPIFFS.open(GavityDeviceConfigFilename,"w+");
+  			File config=FileCache.openToWrite(GavityDeviceConfigFilename,"w+");
   			if(!config){
   				request->send(500);
   				return;
@@ -837,7 +1225,7 @@ public:
 		    request->send(SPIFFS,GavityDeviceConfigFilename, "application/json");
 		}else{
 		    // get the HTML
-		    request->send_P(200, "text/html", externalData.html());
+		    request->send(new ProgmemResponse("text/html",externalData.html()));
 		}
 	}
 
@@ -937,43 +1325,45 @@ void brewpi_setup()
 	logDebug("init complete");
 }
 
-void brewpiLoop(void)
+// the control tick, run every second by the scheduler
+void brewpiControl(void)
 {
-	static unsigned long lastUpdate = 0;
+	METRICS_CONTROL_TICK();
+	METRICS_PROBE("brewpi_control");
 	uint8_t oldState;
 
-	if (ticks.millis() - lastUpdate >= (1000)) { //update settings every second
-		lastUpdate = ticks.millis();
-
 #if BREWPI_BUZZER
-		buzzer.setActive(alarm.isActive() && !buzzer.isActive());
+	buzzer.setActive(alarm.isActive() && !buzzer.isActive());
 #endif
 
-		tempControl.updateTemperatures();
-		tempControl.detectPeaks();
-		tempControl.updatePID();
-		oldState = tempControl.getState();
-		tempControl.updateState();
-		if (oldState != tempControl.getState()) {
-			piLink.printTemperatures(); // add a data point at every state transition
-		}
-		tempControl.updateOutputs();
+	tempControl.updateTemperatures();
+	tempControl.detectPeaks();
+	tempControl.updatePID();
+	oldState = tempControl.getState();
+	tempControl.updateState();
+	if (oldState != tempControl.getState()) {
+		piLink.printTemperatures(); // add a data point at every state transition
+	}
+	tempControl.updateOutputs();
 
 #if BREWPI_MENU
-		if (rotaryEncoder.pushed()) {
-			rotaryEncoder.resetPushed();
-			display.updateBacklight();
-			menu.pickSettingToChange();
-		}
-#endif
-
-		// update the lcd for the chamber being displayed
-		display.printState();
-		display.printAllTemperatures();
-		display.printMode();
+	if (rotaryEncoder.pushed()) {
+		rotaryEncoder.resetPushed();
 		display.updateBacklight();
+		menu.pickSettingToChange();
 	}
+#endif
 
+	// update the lcd for the chamber being displayed
+	display.printState();
+	display.printAllTemperatures();
+	display.printMode();
+	display.updateBacklight();
+}
+
+void brewpiLoop(void)
+{
+	METRICS_PROBE("brewpi_loop");
 	//listen for incoming serial connections while waiting to update
 #ifdef ESP8266_WiFi
 	yield();
@@ -1020,7 +1410,6 @@ void initWakeupButton(void){
 #endif //#ifdef WAKEUP_BUTTON
 
 #ifdef EMIWorkaround
-uint32_t _lcdReinitTime;
 #define LCDReInitPeriod (10*60*1000)
 #endif
 
@@ -1155,6 +1544,9 @@ void setup(void){
 		request->send(200,"","totalBytes:" +String(fs_info.totalBytes) +
 		" usedBytes:" + String(fs_info.usedBytes)+" blockSize:" + String(fs_info.blockSize)
 		+" pageSize:" + String(fs_info.pageSize)
+		+" logged:" + String(brewLogger.bytesLogged())
+		+" written:" + String(brewLogger.bytesWritten())
+		+" writes:" + String(brewLogger.writeCount())
 		+" heap:"+String(ESP.getFreeHeap()));
 		//testSPIFFS();
 	});
@@ -1169,6 +1561,10 @@ void setup(void){
 	server.begin();
 	DBG_PRINTF("HTTP server started\n");
 
+#if EnableBrewPiTcpServer == true
+	brewPiTcpServer.begin();
+#endif
+
 
 	// 5. try to connnect Arduino
 	brewpi_setup();
@@ -1190,35 +1586,22 @@ void setup(void){
 	display.printStatus(buf);
 	_displayTime = TimeKeeper.getTimeSeconds() + 20;
 #endif
-#ifdef EMIWorkaround
-	_lcdReinitTime = millis();
-#endif
+	setupTasks();
 }
 
-uint32_t _rssiReportTime;
 #define RssiReportPeriod 10
 
-void loop(void){
-//{brewpi
-#if BREWPI_SIMULATE
-	simulateLoop();
-#else
-	brewpiLoop();
-#endif
-//}brewpi
-#if (DEVELOPMENT_OTA == true) || (DEVELOPMENT_FILEMANAGER == true)
-	ESPUpdateServer_loop();
-#endif
-	time_t now=TimeKeeper.getTimeSeconds();
-
-#ifdef EMIWorkAround
-	if( (millis() - _lcdReinitTime) > LCDReInitPeriod){
-		_lcdReinitTime=millis();
-		display.fresh();
-	}
+#ifdef EMIWorkaround
+void lcdReinitTask(void)
+{
+	display.refresh();
+}
 #endif
 
 #ifdef STATUS_LINE
+void statusLineTask(void)
+{
+	time_t now=TimeKeeper.getTimeSeconds();
 	if(_displayTime < now){
 		_displayTime=now;
 
@@ -1228,27 +1611,53 @@ void loop(void){
 		sprintf(buf,"%d/%02d/%02d %02d:%02d:%02d",t.tm_year,t.tm_mon,t.tm_mday,t.tm_hour,t.tm_min,t.tm_sec);
 		display.printStatus(buf);
 	}
+}
 #endif
-	if( (now - _rssiReportTime) > RssiReportPeriod){
-		_rssiReportTime =now;
-		reportRssi();
-	}
-
-  	brewKeeper.keep(now);
-
-  	brewPi.loop();
-
- 	brewLogger.loop();
-
- 	#ifdef ENABLE_LOGGING
-
- 	dataLogger.loop(now);
- 	#endif
 
+void wifiTask(void)
+{
 	if(!IS_RESTARTING){
 		WiFiSetup.stayConnected();
 		if(WiFiSetup.isApMode()) TimeKeeper.setInternetAccessibility(false);
 	}
+}
+
+// name, function, period and budget in ms. Period 0: every pass
+void setupTasks(void)
+{
+//{brewpi
+#if BREWPI_SIMULATE
+	TaskScheduler.add("simulator",simulateLoop,0,100);
+#else
+	TaskScheduler.add("control",brewpiControl,1000,100);
+	TaskScheduler.add("command",brewpiLoop,0,50);
+#endif
+//}brewpi
+	TaskScheduler.add("output",[](){ brewPi.loop(); },0,20);
+#if (DEVELOPMENT_OTA == true) || (DEVELOPMENT_FILEMANAGER == true)
+	TaskScheduler.add("update",ESPUpdateServer_loop,0,50);
+#endif
+#ifdef EMIWorkaround
+	TaskScheduler.add("lcd",lcdReinitTask,LCDReInitPeriod,50);
+#endif
+#ifdef STATUS_LINE
+	TaskScheduler.add("status",statusLineTask,1000,20);
+#endif
+	TaskScheduler.add("rssi",reportRssi,RssiReportPeriod * 1000,20);
+	TaskScheduler.add("profile",[](){ brewKeeper.keep(TimeKeeper.getTimeSeconds()); },1000,100);
+	TaskScheduler.add("log",[](){ brewLogger.loop(); },1000,100);
+#ifdef ENABLE_LOGGING
+	// remote logging posts synchronously
+	TaskScheduler.add("remotelog",[](){ dataLogger.loop(TimeKeeper.getTimeSeconds()); },1000,1000);
+#endif
+	TaskScheduler.add("wifi",wifiTask,0,20);
+#if EnableMetrics == true
+	TaskScheduler.add("metrics",reportMetrics,MetricsReportPeriod * 1000,50);
+#endif
+}
+
+void loop(void){
+	TaskScheduler.run();
 
   	if(_systemState ==SystemStateRestartPending){
 	  	_time=millis();
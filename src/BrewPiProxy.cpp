@@ -1,5 +1,6 @@
 #include "BrewPiProxy.h"
 #include "VirtualSerial.h"
+#include "BrewPiTcpServer.h"
 
 #include "Brewpi.h"
 #include <stdarg.h>
@@ -20,8 +21,10 @@
 #include "Buzzer.h"
 #include "Display.h"
 
-QueueBuffer brewPiRxBuffer(2048);
-QueueBuffer brewPiTxBuffer(2048);
+// commands are parsed in place, a line at a time
+LineRing brewPiRxBuffer(2048,LineRingContiguous);
+// the last line is kept in the ring, no copy of it is made
+LineRing brewPiTxBuffer(2048,LineRingContiguous | LineRingUtf8Degree);
 
 
 void BrewPiProxy::write(char ch)
@@ -31,8 +34,45 @@ void BrewPiProxy::write(char ch)
 
 void BrewPiProxy::putLine(const char* str)
 {
-	brewPiRxBuffer.print(str);
-	brewPiRxBuffer.print('\n');
+	if(!brewPiRxBuffer.writeLine(str,strlen(str)))
+		DBG_PRINTF("RX full, line dropped:%d\n",brewPiRxBuffer.overflows());
+}
+
+void BrewPiProxy::setMode(char mode)
+{
+	ControlCommand command;
+	command.mask = CommandMode;
+	command.mode = mode;
+	apply(command);
+}
+
+void BrewPiProxy::setBeerSetting(float temp)
+{
+	ControlCommand command;
+	command.mask = CommandBeerSetting;
+	command.beerSetting = floatToTemperature(temp);
+	apply(command);
+}
+
+void BrewPiProxy::setFridgeSetting(float temp)
+{
+	ControlCommand command;
+	command.mask = CommandFridgeSetting;
+	command.fridgeSetting = floatToTemperature(temp);
+	apply(command);
+}
+
+void BrewPiProxy::setConstants(const ControlConstants& cc)
+{
+	ControlCommand command;
+	command.mask = CommandConstants;
+	command.constants = &cc;
+	apply(command);
+}
+
+void BrewPiProxy::apply(const ControlCommand& command)
+{
+	piLink.applyCommand(command);
 }
 
 void BrewPiProxy::begin(void (*readString)(const char*))
@@ -42,28 +82,22 @@ void BrewPiProxy::begin(void (*readString)(const char*))
 
 void BrewPiProxy::loop(void)
 {
-	while(brewPiTxBuffer.available()){
-		char ch=brewPiTxBuffer.read();
-		 if(ch == '\n'){
-			_lastLineBuff[_readPtr]='\0';
-			memcpy(_lastLineBuff,_buff,_readPtr);
-			_readPtr=0;
-			(*_readString)(_lastLineBuff);
-		}
-		else
-		if(ch == 0xB0){
-			//for safty
-			if(_readPtr < (BUFF_SIZE-2)){
-				_buff[_readPtr++]=0xC2;
-				_buff[_readPtr++]=0xB0;
-			}
-		 }
-		 else
-			 _buff[_readPtr++]=ch;
-		if( _readPtr >= BUFF_SIZE) _readPtr=0; // just drop.
+	const char *line;
+	size_t len;
+	while((line=brewPiTxBuffer.nextLine(len)) != NULL){
+		(*_readString)(line);
+#if EnableBrewPiTcpServer == true
+		// controller output only, not the web notifications
+		brewPiTcpServer.send(line,len);
+#endif
 	}
 }
 
+const char* BrewPiProxy::getLastLine(void)
+{
+	return brewPiTxBuffer.currentLine();
+}
+
 void BrewPiProxy::getTemperature(float *pBeerTemp,float *pBeerSet,float *pFridgeTemp, float *pFridgeSet)
 {
 	*pBeerTemp=temperatureFloatValue(tempControl.getBeerTemp());
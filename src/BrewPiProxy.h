@@ -4,14 +4,15 @@
 #include <Arduino.h>
 #include "espconfig.h"
 
-#define BUFF_SIZE 1024
-
 #define LCD_CMD 'l'
 
+struct ControlConstants;
+struct ControlCommand;
+
 
 class BrewPiProxy{
 public:
-	BrewPiProxy(void):_lastLineLength(0),_readPtr(0),_unit('C'){_lastLineBuff[0]='\0';}
+	BrewPiProxy(void):_unit('C'){}
 	void begin(void (*readString)(const char*));
 
 	void loop(void);
@@ -19,7 +20,15 @@ public:
 
 	void putLine(const char* str);
 
-	char* getLastLine(void){return _lastLineBuff;}
+	// typed commands, applied right away: only from loop(), not from web callbacks
+	void setMode(char mode);
+	void setBeerSetting(float temp);
+	void setFridgeSetting(float temp);
+	void setConstants(const ControlConstants& cc);
+	void apply(const ControlCommand& command);
+
+	// valid until the next loop()
+	const char* getLastLine(void);
 
 	void getTemperature(float *pBeerTemp,float *pBeerSet,float *pFridgeTemp, float *pFridgeSet);
 	void getTemperatureSetting(char *pUnit,float *pMinSetTemp,float *pMaxSetTemp);
@@ -31,10 +40,6 @@ public:
 
 protected:
 	char _unit;
-	char _lastLineBuff[BUFF_SIZE];
-	int  _lastLineLength;
-	char _buff[BUFF_SIZE];
-	int   _readPtr;
 
 	void (*_readString)(const char*);
 };
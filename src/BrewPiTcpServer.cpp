@@ -0,0 +1,179 @@
+#include "BrewPiTcpServer.h"
+
+#if EnableBrewPiTcpServer == true
+#include "BrewPiProxy.h"
+
+#define TelnetIAC 255
+#define TelnetWILL 251
+#define TelnetDONT 254
+
+BrewPiTcpServer brewPiTcpServer(BREWPI_TCP_SERVER_PORT);
+
+BrewPiTcpServer::BrewPiTcpServer(uint16_t port):_server(port),_clients(NULL),_count(0)
+{
+}
+
+void BrewPiTcpServer::begin(void)
+{
+	_server.onClient([](void *r,AsyncClient *c){ ((BrewPiTcpServer*)(r))->_onClient(c); },this);
+	_server.setNoDelay(true);
+	_server.begin();
+	DBG_PRINTF("BrewPi TCP server on port %d\n",BREWPI_TCP_SERVER_PORT);
+}
+
+void BrewPiTcpServer::_onClient(AsyncClient *client)
+{
+	if(_count >= BrewPiTcpMaxClients){
+		DBG_PRINTF("BrewPi TCP: too many clients\n");
+		client->close(true);
+		return;
+	}
+	BrewPiTcpClient *c=new BrewPiTcpClient(client,this);
+	c->next=_clients;
+	_clients=c;
+	_count++;
+	DBG_PRINTF("BrewPi TCP: client connected, %d\n",_count);
+}
+
+void BrewPiTcpServer::_handleDisconnect(BrewPiTcpClient *client)
+{
+	if(_clients == client){
+		_clients=client->next;
+	}else{
+		BrewPiTcpClient *c=_clients;
+		while(c != NULL && c->next != client) c=c->next;
+		if(c == NULL) return;
+		c->next=client->next;
+	}
+	_count--;
+	DBG_PRINTF("BrewPi TCP: client disconnected, dropped lines:%d\n",client->dropped());
+	delete client;
+}
+
+void BrewPiTcpServer::send(const char *line,size_t len)
+{
+	for(BrewPiTcpClient *c=_clients;c != NULL;c=c->next)
+		c->queue(line,len);
+}
+
+/*
+*  a connected client
+*/
+
+BrewPiTcpClient::BrewPiTcpClient(AsyncClient *client,BrewPiTcpServer *server)
+	:next(NULL),_client(client),_server(server),_head(0),_tail(0),_inFlight(0),_dropped(0),
+	_lineLength(0),_lineOverflow(false),_telnetSkip(0)
+{
+	_client->onAck([](void *r,AsyncClient *c,size_t len,uint32_t time){ ((BrewPiTcpClient*)(r))->_onAck(len,time); },this);
+	_client->onDisconnect([](void *r,AsyncClient *c){ ((BrewPiTcpClient*)(r))->_onDisconnect(); },this);
+	_client->onTimeout([](void *r,AsyncClient *c,uint32_t time){ ((BrewPiTcpClient*)(r))->_onTimeout(time); },this);
+	_client->onData([](void *r,AsyncClient *c,void *buf,size_t len){ ((BrewPiTcpClient*)(r))->_onData(buf,len); },this);
+	_client->onPoll([](void *r,AsyncClient *c){ ((BrewPiTcpClient*)(r))->_onPoll(); },this);
+}
+
+bool BrewPiTcpClient::queue(const char *line,size_t len)
+{
+	if(len + 1 > (size_t)(BrewPiTcpQueueSize - 1 - _used())){
+		_dropped++;
+		return false;
+	}
+	_copy(line,len);
+	_copy("\n",1);
+	_send();
+	return true;
+}
+
+void BrewPiTcpClient::_copy(const char *data,size_t len)
+{
+	size_t first=BrewPiTcpQueueSize - _head;
+	if(first > len) first=len;
+	memcpy(_queue + _head,data,first);
+	if(len > first) memcpy(_queue,data + first,len - first);
+	_head += len;
+	if(_head >= BrewPiTcpQueueSize) _head -= BrewPiTcpQueueSize;
+}
+
+void BrewPiTcpClient::_send(void)
+{
+	// the data stays in the queue until it is acknowledged
+	if(!_client->canSend()) return;
+	uint16_t pending=_used() - _inFlight;
+	uint16_t start=_tail + _inFlight;
+	if(start >= BrewPiTcpQueueSize) start -= BrewPiTcpQueueSize;
+	size_t added=0;
+	while(pending){
+		size_t chunk=(start + pending > BrewPiTcpQueueSize)? (BrewPiTcpQueueSize - start):pending;
+		size_t len=_client->add(_queue + start,chunk);
+		added += len;
+		pending -= len;
+		start += len;
+		if(start == BrewPiTcpQueueSize) start=0;
+		if(len < chunk) break;
+	}
+	if(added){
+		_inFlight += added;
+		_client->send();
+	}
+}
+
+void BrewPiTcpClient::_onAck(size_t len,uint32_t time)
+{
+	if(len > _inFlight) len=_inFlight;
+	_inFlight -= len;
+	_tail += len;
+	if(_tail >= BrewPiTcpQueueSize) _tail -= BrewPiTcpQueueSize;
+	_send();
+}
+
+void BrewPiTcpClient::_onPoll(void)
+{
+	_send();
+}
+
+void BrewPiTcpClient::_onTimeout(uint32_t time)
+{
+	_client->close();
+}
+
+void BrewPiTcpClient::_onDisconnect(void)
+{
+	_client->free();
+	delete _client;
+	_server->_handleDisconnect(this);
+}
+
+void BrewPiTcpClient::_endLine(void)
+{
+	if(_lineOverflow){
+		DBG_PRINTF("BrewPi TCP: line too long\n");
+	}else if(_lineLength){
+		_line[_lineLength]='\0';
+		brewPi.putLine(_line);
+	}
+	_lineLength=0;
+	_lineOverflow=false;
+}
+
+void BrewPiTcpClient::_onData(void *buf,size_t len)
+{
+	const uint8_t *data=(const uint8_t*)buf;
+	for(size_t i=0;i<len;i++){
+		uint8_t c=data[i];
+		if(_telnetSkip){
+			// option negotiation has one byte more, the option
+			_telnetSkip--;
+			if(_telnetSkip && (c < TelnetWILL || c > TelnetDONT)) _telnetSkip=0;
+			continue;
+		}
+		if(c == TelnetIAC){
+			_telnetSkip=2;
+		}else if(c == '\n' || c == '\r'){
+			_endLine();
+		}else if(c >= ' '){
+			if(_lineLength < BrewPiTcpLineSize - 1) _line[_lineLength++]=c;
+			else _lineOverflow=true;
+		}
+	}
+}
+
+#endif
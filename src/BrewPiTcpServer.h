@@ -0,0 +1,84 @@
+#ifndef BrewPiTcpServer_H
+#define BrewPiTcpServer_H
+#include <Arduino.h>
+#include <ESPAsyncTCP.h>
+#include "espconfig.h"
+
+#if EnableBrewPiTcpServer == true
+
+// the BrewPi serial protocol over TCP, for brewpi-script or a telnet session.
+// Command lines from a client go to the RX ring from the TCP callbacks, like
+// the web commands do. Response lines are queued for each client and sent
+// when the previous data is acknowledged, so a slow client never blocks the
+// loop. When its queue is full, whole lines are dropped.
+// There is no authentication, so it is not enabled by default.
+
+#define BrewPiTcpMaxClients 2
+#define BrewPiTcpQueueSize 2048
+// a longer command line is dropped
+#define BrewPiTcpLineSize 256
+
+class BrewPiTcpServer;
+
+class BrewPiTcpClient
+{
+public:
+	BrewPiTcpClient *next;
+
+	BrewPiTcpClient(AsyncClient *client,BrewPiTcpServer *server);
+	// a line, without '\n'. false if it was dropped
+	bool queue(const char *line,size_t len);
+	uint16_t dropped(void){ return _dropped; }
+
+	//system callbacks (do not call)
+	void _onAck(size_t len,uint32_t time);
+	void _onPoll(void);
+	void _onTimeout(uint32_t time);
+	void _onDisconnect(void);
+	void _onData(void *buf,size_t len);
+
+protected:
+	AsyncClient *_client;
+	BrewPiTcpServer *_server;
+
+	// _tail: oldest byte not acknowledged, _head: end of queued data.
+	// _inFlight bytes from _tail have been given to TCP.
+	char _queue[BrewPiTcpQueueSize];
+	uint16_t _head;
+	uint16_t _tail;
+	uint16_t _inFlight;
+	uint16_t _dropped;
+
+	char _line[BrewPiTcpLineSize];
+	uint16_t _lineLength;
+	bool _lineOverflow;
+	// bytes of a telnet command still to skip
+	uint8_t _telnetSkip;
+
+	uint16_t _used(void){ return (_head >= _tail)? (_head - _tail):(BrewPiTcpQueueSize + _head - _tail); }
+	void _copy(const char *data,size_t len);
+	void _send(void);
+	void _endLine(void);
+};
+
+class BrewPiTcpServer
+{
+public:
+	BrewPiTcpServer(uint16_t port);
+	void begin(void);
+	// a line, without '\n', to every client
+	void send(const char *line,size_t len);
+
+	void _handleDisconnect(BrewPiTcpClient *client);
+protected:
+	AsyncServer _server;
+	BrewPiTcpClient *_clients;
+	uint8_t _count;
+
+	void _onClient(AsyncClient *client);
+};
+
+extern BrewPiTcpServer brewPiTcpServer;
+
+#endif
+#endif
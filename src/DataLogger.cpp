@@ -7,9 +7,12 @@
 #include "mystrlib.h"
 #include "DataLogger.h"
 #include "espconfig.h"
+#include "ProgmemResponse.h"
 #include "TemperatureFormats.h"
 #include "BrewPiProxy.h"
 #include "ExternalData.h"
+#include "Metrics.h"
+#include "FileCache.h"
 extern BrewPiProxy brewPi;
 
 #define GSLOG_JSON_BUFFER_SIZE 256
@@ -121,6 +124,7 @@ int copyTemp(char* buf,char* name,float value, bool concate)
 
 void DataLogger::sendData(void)
 {
+	METRICS_PROBE("send_data");
 	char data[512];
 	int len=0;
 
@@ -241,7 +245,7 @@ void DataLogger::updateSetting(AsyncWebServerRequest *request)
 		    free(tbuf);
 
         	ESP.wdtDisable();
-    		File fh= SPIFFS.open(GSLogConfigFile, "w");
+    		File fh= FileCache.openToWrite(GSLogConfigFile);
     		if(!fh){
     			request->send(500);
     			return;
@@ -321,19 +325,6 @@ void DataLogger::getSettings(AsyncWebServerRequest *request)
 		else
 			request->send(200,"application/json","{}");
 	}else{
-		AsyncWebServerResponse *response = request->beginResponse(String("text/html"),
-  		strlen_P(LogConfigHtml),
-  		[=](uint8_t *buffer, size_t maxLen, size_t alreadySent) -> size_t {
-    		if (strlen_P(LogConfigHtml+alreadySent)>maxLen) {
-      		// We have more to read than fits in maxLen Buffer
-      		memcpy_P((char*)buffer, LogConfigHtml+alreadySent, maxLen);
-      		return maxLen;
-    	}
-    	// Ok, last chunk
-    	memcpy_P((char*)buffer, LogConfigHtml+alreadySent, strlen_P(LogConfigHtml+alreadySent));
-    	return strlen_P(LogConfigHtml+alreadySent); // Return from here to end of indexhtml
- 	 	}
-		);
-		request->send(response);
+		request->send(new ProgmemResponse("text/html",LogConfigHtml));
 	}
 }
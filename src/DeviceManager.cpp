@@ -384,7 +384,9 @@ void DeviceManager::parseDeviceDefinition()
 	static DeviceDefinition dev;
 	fill((int8_t*)&dev, sizeof(dev));
 
-	piLink.parseJson(&handleDeviceDefinition, &dev);
+	// a broken definition is not applied in part
+	if (piLink.parseJson(&handleDeviceDefinition, &dev) != JsonOk)
+		return;
 
 	if (!inRangeInt8(dev.id, 0, MAX_DEVICE_SLOT))			// no device id given, or it's out of range, can't do anything else.
 		return;
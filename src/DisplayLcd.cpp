@@ -71,6 +71,7 @@ void LcdDisplay::init(void){
 
 //print all temperatures on the LCD
 void LcdDisplay::printAllTemperatures(void){
+	METRICS_PROBE("print_all_temperatures");
 	// alternate between beer and room temp
 	if (flags & LCD_FLAG_ALTERNATE_ROOM) {
 		bool displayRoom = ((ticks.seconds()&0x08)==0) && !BREWPI_SIMULATE && tempControl.ambientSensor->isConnected();
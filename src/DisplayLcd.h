@@ -21,6 +21,7 @@
 
 #include "Brewpi.h"
 #include "DisplayBase.h"
+#include "Metrics.h"
 #include "SpiLcd.h"
 #include "NullLcdDriver.h"
 
@@ -63,6 +64,7 @@ class LcdDisplay DISPLAY_SUPERCLASS
 	}
 #endif
 	DISPLAY_METHOD void printAll() {
+		METRICS_PROBE("print_all");
 		printStationaryText();
 		printState();
 		printAllTemperatures();
@@ -7,6 +7,7 @@
 #include <ArduinoJson.h>
 #include "espconfig.h"
 #include "ExternalData.h"
+#include "FileCache.h"
 
 #define EXTERNALDATA_ON_SYNC_SERVER false
 
@@ -73,7 +74,7 @@ static void handleFileUpload(void){
     String filename = upload.filename;
     if(!filename.startsWith("/")) filename = "/"+filename;
     DBG_PRINT("handleFileUpload Name: "); DBG_PRINTLN(filename);
-    fsUploadFile = SPIFFS.open(filename, "w");
+    fsUploadFile = FileCache.openToWrite(filename.c_str());
     filename = String();
   } else if(upload.status == UPLOAD_FILE_WRITE){
     //DBG_PRINT("handleFileUpload Data: "); DBG_PRINTLN(upload.currentSize);
@@ -95,6 +96,7 @@ static void handleFileDelete(void){
   if(!SPIFFS.exists(path))
     return server.send(404, "text/plain", "FileNotFound");
   SPIFFS.remove(path);
+  FileCache.invalidate(path.c_str());
   server.send(200, "text/plain", "");
   path = String();
 }
@@ -108,7 +110,7 @@ static void handleFileCreate(void){
     return server.send(500, "text/plain", "BAD PATH");
   if(SPIFFS.exists(path))
     return server.send(500, "text/plain", "FILE EXISTS");
-  File file = SPIFFS.open(path, "w");
+  File file = FileCache.openToWrite(path.c_str());
   if(file)
     file.close();
   else
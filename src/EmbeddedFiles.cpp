@@ -12,6 +12,7 @@ typedef struct _EmbeddedFileMapEntry{
 	const uint8_t *content;
     unsigned int size;
 	bool  gzipped;
+	uint32_t hash; // of the content, 0 until first asked
 } EmbeddedFileMapEntry;
 
 #include "data_bwf_js.h"
@@ -33,12 +34,12 @@ const char file_lcd [] PROGMEM="/lcd";
 //const char file_viewlog_htm [] PROGMEM="/viewlog.htm";
 
 EmbeddedFileMapEntry fileMaps[]={
-{file_bwf_js,data_bwf_min_js_gz,data_bwf_min_js_gz_len,true},
-{file_index_htm,data_nindex_htm_gz,data_nindex_htm_gz_len,true},
-{file_lcd,data_lcd_min_htm_gz,data_lcd_min_htm_gz_len,true},
-{file_setup_htm,data_setup_min_htm_gz,data_setup_min_htm_gz_len,true},
-{file_testcmd_htm,(const uint8_t *)data_testcmd_htm,0,false}
-//{file_viewlog_htm,data_viewlog_min_htm_gz,data_viewlog_min_htm_gz_len,true}
+{file_bwf_js,data_bwf_min_js_gz,data_bwf_min_js_gz_len,true,0},
+{file_index_htm,data_nindex_htm_gz,data_nindex_htm_gz_len,true,0},
+{file_lcd,data_lcd_min_htm_gz,data_lcd_min_htm_gz_len,true,0},
+{file_setup_htm,data_setup_min_htm_gz,data_setup_min_htm_gz_len,true,0},
+{file_testcmd_htm,(const uint8_t *)data_testcmd_htm,0,false,0}
+//{file_viewlog_htm,data_viewlog_min_htm_gz,data_viewlog_min_htm_gz_len,true,0}
 };
 
 const uint8_t* getEmbeddedFile(const char* filename,bool &gzip, unsigned int &size)
@@ -53,3 +54,24 @@ const uint8_t* getEmbeddedFile(const char* filename,bool &gzip, unsigned int &si
 	}
 	return NULL;
 }
+
+// FNV-1a of the content, as ETag. Computed once from flash, so it always
+// changes with the firmware that changes the file.
+uint32_t getEmbeddedFileHash(const char* filename)
+{
+	for(int i=0;i<sizeof(fileMaps)/sizeof(EmbeddedFileMapEntry);i++)
+	{
+		if(strcmp_P(filename,fileMaps[i].filename) ==0){
+			if(fileMaps[i].hash ==0){
+				const uint8_t *p=fileMaps[i].content;
+				unsigned int len=(fileMaps[i].size)? fileMaps[i].size:strlen_P((PGM_P)p);
+				uint32_t hash=2166136261u;
+				for(unsigned int j=0;j<len;j++)
+					hash = (hash ^ pgm_read_byte(p + j)) * 16777619u;
+				fileMaps[i].hash = hash? hash:1;
+			}
+			return fileMaps[i].hash;
+		}
+	}
+	return 0;
+}
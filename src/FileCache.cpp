@@ -0,0 +1,72 @@
+#include <Arduino.h>
+#include <FS.h>
+#include "espconfig.h"
+#include "FileCache.h"
+
+extern const uint8_t* getEmbeddedFile(const char* filename,bool &gzip, unsigned int &size);
+
+FileCacheClass FileCache;
+
+const FileCacheEntry* FileCacheClass::lookup(const char* path)
+{
+	for(uint8_t i=0;i<FileCacheSize;i++){
+		if(_entries[i].path[0] && strcmp(_entries[i].path,path)==0) return & _entries[i];
+	}
+
+	// round robin replacement
+	FileCacheEntry *entry= & _entries[_next];
+	_next = (_next + 1) % FileCacheSize;
+
+	entry->flags=0;
+	entry->size=0;
+	entry->sequence=_sequence;
+
+	// open() instead of exists(): one scan, and the size comes with it
+	File f=SPIFFS.open(path,"r");
+	if(f){
+		entry->flags |= FileCacheInSpiffs;
+		entry->size = f.size();
+		f.close();
+	}else{
+		String gz=String(path) + ".gz";
+		f=SPIFFS.open(gz,"r");
+		if(f){
+			entry->flags |= FileCacheGzipInSpiffs;
+			entry->size = f.size();
+			f.close();
+		}
+	}
+	bool gzip;
+	unsigned int size;
+	if(getEmbeddedFile(path,gzip,size)){
+		entry->flags |= FileCacheEmbedded;
+		if(gzip) entry->flags |= FileCacheEmbeddedGzip;
+		if(!(entry->flags & (FileCacheInSpiffs|FileCacheGzipInSpiffs))) entry->size = size;
+	}
+
+	// too long to be a SPIFFS name, not kept
+	if(strlen(path) >= FileCachePathLength){
+		entry->path[0]='\0';
+	}else{
+		strcpy(entry->path,path);
+	}
+	//DBG_PRINTF("file cache %s:%x\n",path,entry->flags);
+	return entry;
+}
+
+void FileCacheClass::invalidate(const char* path)
+{
+	size_t len=strlen(path);
+	// the entry of a file also tells about its .gz
+	if(len > 3 && strcmp(path + len - 3,".gz")==0) len -= 3;
+	for(uint8_t i=0;i<FileCacheSize;i++){
+		if(_entries[i].path[0] && strncmp(_entries[i].path,path,len)==0) _entries[i].path[0]='\0';
+	}
+	_sequence++;
+}
+
+void FileCacheClass::invalidate(void)
+{
+	for(uint8_t i=0;i<FileCacheSize;i++) _entries[i].path[0]='\0';
+	_sequence++;
+}
@@ -0,0 +1,60 @@
+#ifndef FileCache_H
+#define FileCache_H
+#include <Arduino.h>
+#include <FS.h>
+
+// what is known about a path served by the web server.
+// SPIFFS.exists() scans the object lookup pages, and a page load asks for
+// several files at once, so results, including misses, are kept in RAM
+// until the file system is changed.
+
+#ifndef FileCacheSize
+#define FileCacheSize 12
+#endif
+// SPIFFS_OBJ_NAME_LEN
+#define FileCachePathLength 32
+
+#define FileCacheInSpiffs 0x01
+#define FileCacheGzipInSpiffs 0x02
+#define FileCacheEmbedded 0x04
+#define FileCacheEmbeddedGzip 0x08
+
+typedef struct _FileCacheEntry{
+	char     path[FileCachePathLength];
+	uint32_t size;
+	uint32_t sequence;
+	uint8_t  flags;
+} FileCacheEntry;
+
+class FileCacheClass
+{
+public:
+	FileCacheClass(void):_next(0),_sequence(1){ memset(_entries,0,sizeof(_entries)); }
+
+	// never NULL. The entry is valid until the next lookup or invalidate
+	const FileCacheEntry* lookup(const char* path);
+	bool exists(const char* path){ return lookup(path)->flags !=0; }
+
+	// SPIFFS.open() to write a file served by the web server, and drop
+	// what is known about it
+	File openToWrite(const char* path,const char* mode="w"){
+		File f=SPIFFS.open(path,mode);
+		invalidate(path);
+		return f;
+	}
+
+	// drop every entry starting with path: a file and its .gz, or a directory
+	void invalidate(const char* path);
+	void invalidate(void);
+	// changed on every invalidation
+	uint32_t sequence(void){ return _sequence; }
+
+private:
+	FileCacheEntry _entries[FileCacheSize];
+	uint8_t _next;
+	uint32_t _sequence;
+};
+
+extern FileCacheClass FileCache;
+
+#endif
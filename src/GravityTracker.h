@@ -4,6 +4,13 @@
 #define InvalidValue 0
 #define AveragePeriod  3600
 
+typedef struct _GravityTrackerState{
+    int16_t record[NumberOfSlots];
+    int16_t idx;
+    int16_t lastValue;
+    uint32_t currentStartTime;
+} GravityTrackerState;
+
 class GravityTracker
 {
     int _idx;
@@ -34,6 +41,20 @@ public:
         return (_record[previous] - _record[current]) <= to;
     }
 
+    void getState(GravityTrackerState& state){
+        for(int i=0;i<NumberOfSlots;i++) state.record[i]=_record[i];
+        state.idx=_idx;
+        state.lastValue=_lastValue;
+        state.currentStartTime=_currentStartTime;
+    }
+
+    void setState(const GravityTrackerState& state){
+        for(int i=0;i<NumberOfSlots;i++) _record[i]=state.record[i];
+        _idx= (state.idx >=0 && state.idx < NumberOfSlots)? state.idx:0;
+        _lastValue=state.lastValue;
+        _currentStartTime=state.currentStartTime;
+    }
+
     void add(float fgravity,uint32_t time){
         uint16_t gravity =round(fgravity * 1000.0);
         uint32_t timediff = time - _currentStartTime;
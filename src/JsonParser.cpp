@@ -0,0 +1,77 @@
+#include "JsonParser.h"
+
+inline bool isJsonSpace(char c) {
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+/**
+ * Decodes a key or value in place and nul-terminates it. Spaces around it are removed,
+ * quoted parts are kept as they are, with \ escaping the next character.
+ * \return the delimiter that ends the token: ':', ',' or '}', 0 at the end of the span,
+ * or JSON_TOKEN_UNTERMINATED for a string without its closing quote
+ */
+int parseJsonToken(JsonSpan& s, char*& token) {
+	while (s.p < s.end && isJsonSpace(*s.p))
+		s.p++;
+	token = s.p;
+	char* out = s.p;
+	char* last = out;	// end without trailing spaces
+	while (s.p < s.end) {
+		char c = *s.p++;
+		if (c == '"') {
+			for (;;) {
+				if (s.p >= s.end)
+					return JSON_TOKEN_UNTERMINATED;
+				c = *s.p++;
+				if (c == '"')
+					break;
+				if (c == '\\' && s.p < s.end)
+					c = *s.p++;
+				*out++ = c;
+			}
+			last = out;
+		}
+		else if (c == ':' || c == ',' || c == '}') {
+			// the decoded token is never longer, this is at most where the delimiter was
+			*last = 0;
+			return c;
+		}
+		else {
+			*out++ = c;
+			if (!isJsonSpace(c))
+				last = out;
+		}
+	}
+	*last = 0;	// the span is followed by a nul
+	return 0;
+}
+
+uint8_t parseJsonObject(JsonSpan& s, JsonPairCallback fn, void* data)
+{
+	while (s.p < s.end && isJsonSpace(*s.p))
+		s.p++;
+	if (s.p == s.end || *s.p != '{')
+		return JsonExpectedBracket;
+	s.p++;
+
+	for (;;) {
+		char* key;
+		char* val;
+		int end = parseJsonToken(s, key);
+		if (end == '}' && !*key)	// {} or a trailing comma
+			return JsonOk;
+		if (end != ':') {
+			return (end == JSON_TOKEN_UNTERMINATED)? JsonUnterminatedString
+				: (end == 0)? JsonUnexpectedEnd : JsonExpectedColon;
+		}
+		end = parseJsonToken(s, val);
+		if (end != ',' && end != '}') {
+			return (end == JSON_TOKEN_UNTERMINATED)? JsonUnterminatedString
+				: (end == 0)? JsonUnexpectedEnd : JsonExpectedComma;
+		}
+		if (*key && *val)
+			fn(key, val, data);
+		if (end == '}')
+			return JsonOk;
+	}
+}
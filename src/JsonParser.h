@@ -0,0 +1,83 @@
+#ifndef JsonParser_H
+#define JsonParser_H
+
+#include <Arduino.h>
+
+// the {...} of the j, U and other commands, decoded in place.
+// Keys and values can be quoted or not. They are passed to the callback
+// decoded and nul-terminated, with no limit on length.
+
+// result of parseJsonObject(), PiLink also logs it with ERROR_INVALID_JSON
+enum JsonParseResult {
+	JsonOk = 0,
+	JsonExpectedBracket,
+	JsonExpectedColon,
+	JsonExpectedComma,
+	JsonUnterminatedString,
+	JsonUnexpectedEnd
+};
+
+// the text to parse. The byte at end must be writable, a token at the end
+// of the span is nul-terminated there.
+struct JsonSpan {
+	char* p;
+	char* end;
+};
+
+#define JSON_TOKEN_UNTERMINATED -1
+
+typedef void (*JsonPairCallback)(const char* key, const char* val, void* data);
+
+// one key or value, see JsonParser.cpp
+int parseJsonToken(JsonSpan& s, char*& token);
+
+// the object at s.p, spaces before it are skipped. s.p is left after the
+// closing '}', or where the error is.
+uint8_t parseJsonObject(JsonSpan& s, JsonPairCallback fn, void* data);
+
+// hash index of a PROGMEM table whose entries have the FNV-1a hash of their
+// key in 'hash' and the PROGMEM key in 'key'. Open addressing over Slots
+// slots, a power of two larger than the table, so a lookup is a probe or two
+// and one strcmp_P. Built at the first lookup.
+template<class Entry, uint8_t Slots>
+class JsonKeyIndex
+{
+public:
+	JsonKeyIndex(const Entry* table, uint8_t count):_table(table),_count(count),_built(false){}
+
+	// the entry of the key, NULL if none. hash is the FNV-1a hash of key.
+	const Entry* find(uint32_t hash, const char* key) {
+		if (!_built)
+			build();
+		for (uint8_t slot = hash & (Slots - 1); _slots[slot]; slot = (slot + 1) & (Slots - 1)) {
+			const Entry* entry = _table + _slots[slot] - 1;
+			if (pgm_read_dword(&entry->hash) != hash)
+				continue;
+			const char* entryKey;
+			memcpy_P(&entryKey, &entry->key, sizeof(entryKey));
+			if (strcmp_P(key, entryKey) == 0)
+				return entry;
+		}
+		return NULL;
+	}
+
+private:
+	const Entry* _table;
+	uint8_t _count;
+	bool _built;
+	// entry index + 1, 0 is empty
+	uint8_t _slots[Slots];
+
+	void build(void) {
+		memset(_slots, 0, sizeof(_slots));
+		for (uint8_t i = 0; i < _count && i < Slots - 1; i++) {
+			uint8_t slot = pgm_read_dword(&_table[i].hash) & (Slots - 1);
+			while (_slots[slot])
+				slot = (slot + 1) & (Slots - 1);
+			_slots[slot] = i + 1;
+		}
+		_built = true;
+	}
+};
+
+#endif
@@ -0,0 +1,190 @@
+#ifndef JsonWriter_H
+#define JsonWriter_H
+#include <Arduino.h>
+
+// JSON written straight to a Print, an AsyncResponseStream or a BufferPrint,
+// without building Strings on the heap.
+//	JsonWriter json(out);
+//	json.beginObject();
+//	json.key("rssi"); json.number(rssi);
+//	json.endObject();
+// Commas are added as needed, up to 16 levels of nesting.
+
+// a Print into a fixed buffer, always nul-terminated. What doesn't fit is dropped.
+class BufferPrint: public Print
+{
+public:
+	BufferPrint(char *buffer,size_t size):_buffer(buffer),_size(size),_length(0),_overflow(false){
+		if(size) _buffer[0]='\0';
+	}
+
+	size_t write(uint8_t c){
+		if(_length + 1 >= _size){
+			_overflow=true;
+			return 0;
+		}
+		_buffer[_length++]=c;
+		_buffer[_length]='\0';
+		return 1;
+	}
+
+	size_t write(const uint8_t *data,size_t len){
+		size_t i;
+		for(i=0;i<len;i++)
+			if(!write(data[i])) break;
+		return i;
+	}
+
+	const char *c_str(void){ return _buffer; }
+	size_t length(void){ return _length; }
+	bool overflow(void){ return _overflow; }
+private:
+	char *_buffer;
+	size_t _size;
+	size_t _length;
+	bool _overflow;
+};
+
+class JsonWriter
+{
+public:
+	JsonWriter(Print& out):_out(out),_depth(0),_first(1){}
+
+	void beginObject(void){ begin('{'); }
+	void endObject(void){ end('}'); }
+	void beginArray(void){ begin('['); }
+	void endArray(void){ end(']'); }
+
+	void key(const char *name){
+		separator();
+		quoted(name);
+		_out.write(':');
+		// the value follows without a comma
+		_first |= (1 << _depth);
+	}
+
+	void string(const char *str){
+		separator();
+		quoted(str);
+	}
+
+	void number(int32_t v){
+		separator();
+		char buf[12];
+		char *p=buf;
+		if(v < 0){
+			*p++ = '-';
+			p=digits(p,-(uint32_t)v);
+		}else{
+			p=digits(p,v);
+		}
+		_out.write((const uint8_t*)buf,p - buf);
+	}
+
+	void number(uint32_t v){
+		separator();
+		char buf[12];
+		char *p=digits(buf,v);
+		_out.write((const uint8_t*)buf,p - buf);
+	}
+
+	// fixed point, rounded, e.g. 2 decimals for temperatures
+	void number(float v,uint8_t decimals){
+		if(isnan(v) || isinf(v)){
+			null();
+			return;
+		}
+		separator();
+		uint32_t scale=1;
+		for(uint8_t i=0;i<decimals;i++) scale *= 10;
+		char buf[24];
+		char *p=buf;
+		bool negative= v < 0;
+		if(negative) v = -v;
+		uint32_t fixed=(uint32_t)(v * scale + 0.5);
+		if(negative && fixed) *p++ = '-';
+		p=digits(p,fixed / scale);
+		if(decimals){
+			*p++ = '.';
+			uint32_t frac=fixed % scale;
+			for(uint32_t d=scale/10;d >0;d /= 10) *p++ = '0' + (frac / d) % 10;
+		}
+		_out.write((const uint8_t*)buf,p - buf);
+	}
+
+	void boolean(bool v){
+		separator();
+		_out.print(v? "true":"false");
+	}
+
+	void null(void){
+		separator();
+		_out.print("null");
+	}
+
+	// a value already in JSON
+	void raw(const char *json){
+		separator();
+		_out.print(json);
+	}
+
+	// key and value
+	void add(const char *name,const char *v){ key(name); string(v); }
+	void add(const char *name,int32_t v){ key(name); number(v); }
+	void add(const char *name,uint32_t v){ key(name); number(v); }
+	void add(const char *name,float v,uint8_t decimals){ key(name); number(v,decimals); }
+
+private:
+	Print& _out;
+	uint8_t _depth;
+	uint16_t _first;
+
+	void begin(char c){
+		separator();
+		_out.write(c);
+		if(_depth < 15) _depth++;
+		_first |= (1 << _depth);
+	}
+
+	void end(char c){
+		_out.write(c);
+		if(_depth) _depth--;
+		_first &= ~(1 << _depth);
+	}
+
+	void separator(void){
+		if(_first & (1 << _depth)) _first &= ~(1 << _depth);
+		else _out.write(',');
+	}
+
+	void quoted(const char *str){
+		_out.write('"');
+		for(;*str;str++){
+			char c=*str;
+			if(c == '"' || c == '\\'){
+				_out.write('\\');
+				_out.write(c);
+			}else if((uint8_t)c < 0x20){
+				char esc[7];
+				sprintf(esc,"\\u%04x",c);
+				_out.print(esc);
+			}else{
+				_out.write(c);
+			}
+		}
+		_out.write('"');
+	}
+
+	static char *digits(char *p,uint32_t v){
+		char tmp[10];
+		int n=0;
+		do{
+			tmp[n++] = '0' + v % 10;
+			v /= 10;
+		}while(v);
+		while(n) *p++ = tmp[--n];
+		return p;
+	}
+};
+
+#endif
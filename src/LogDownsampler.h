@@ -0,0 +1,214 @@
+#ifndef LogDownsampler_H
+#define LogDownsampler_H
+#include "BrewLogger.h"
+#include "LogReader.h"
+
+// reduce a log to min/max buckets.
+// Every bucket of PeriodTag or DeltaPeriodTag records is replaced by two full PeriodTag records,
+// holding the minimum and maximum of each channel in the order they occurred.
+// The output is the same binary format with a header of a longer period, so
+// the chart viewer parses it as it is.
+// "points" is not a hard limit: a ResumeBrewTag closes the bucket before it,
+// so each resume of the log can add one partial bucket, two more records.
+
+#define DownsampleReadSize 256
+#define DownsampleOutSize 48
+
+class LogDownsampler
+{
+public:
+	LogDownsampler(LogReader *reader,uint32_t bucketSize):_reader(reader),_eof(false),
+		_inStart(0),_inEnd(0),_outStart(0),_outEnd(0),_bucketSize(bucketSize),_end(false)
+	{
+		for(int i=0;i<7;i++) _values[i]=INVALID_TEMP_INT;
+		resetBucket();
+	}
+
+	~LogDownsampler(void){
+		delete _reader;
+	}
+
+	// number of records per bucket to output about "points" records, 0 if no reduction needed
+	static uint32_t bucketSize(uint32_t records,uint32_t points)
+	{
+		uint32_t buckets= points/2;
+		if(buckets ==0) buckets=1;
+		uint32_t size=(records + buckets -1)/buckets;
+		if(size <= 2) return 0;
+		// two records for one bucket, keep the new period an integer
+		if(size & 1) size ++;
+		return size;
+	}
+
+	// returns 0 when all data are sent
+	size_t read(uint8_t *buffer, size_t maxLen)
+	{
+		size_t sizeRead=0;
+		while(sizeRead < maxLen){
+			if(_outStart < _outEnd){
+				size_t len=_outEnd - _outStart;
+				if(len > maxLen - sizeRead) len = maxLen - sizeRead;
+				memcpy(buffer+sizeRead,_out+_outStart,len);
+				_outStart += len;
+				sizeRead += len;
+				continue;
+			}
+			if(_end) break;
+			_outStart = _outEnd =0;
+			if(!processRecord()){
+				flushBucket();
+				_end=true;
+			}
+		}
+		return sizeRead;
+	}
+
+private:
+	LogReader *_reader;
+	bool _eof;
+
+	uint8_t _in[DownsampleReadSize];
+	size_t _inStart;
+	size_t _inEnd;
+	uint8_t _out[DownsampleOutSize];
+	size_t _outStart;
+	size_t _outEnd;
+
+	uint32_t _bucketSize;
+	uint32_t _count;
+	bool _end;
+
+	uint16_t _values[7];
+	uint8_t  _has;
+	uint16_t _min[7];
+	uint16_t _max[7];
+	uint32_t _minAt[7];
+	uint32_t _maxAt[7];
+
+	void resetBucket(void)
+	{
+		_count=0;
+		_has=0;
+	}
+
+	// valid temperature: 0 ~ 225 as it is, -100 ~ 0 as 22500 - t
+	static int decodeValue(int channel,uint16_t v)
+	{
+		if(channel == OrderGravity) return v;
+		return (v >= 22500)? (22500 - (int)v):(int)v;
+	}
+
+	size_t fillInput(void)
+	{
+		if(_inStart > 0){
+			size_t left=_inEnd - _inStart;
+			memmove(_in,_in+_inStart,left);
+			_inStart=0;
+			_inEnd=left;
+		}
+		size_t byteRead=_reader->read(_in + _inEnd,DownsampleReadSize - _inEnd);
+		if(byteRead ==0) _eof=true;
+		_inEnd += byteRead;
+		return byteRead;
+	}
+
+	void output(const uint8_t *data,size_t len)
+	{
+		memcpy(_out + _outEnd,data,len);
+		_outEnd += len;
+	}
+
+	// process one record, false if no more data
+	bool processRecord(void)
+	{
+		if((_inEnd - _inStart) < LogMaxRecordSize && !_eof) fillInput();
+
+		uint8_t *ptr=_in+_inStart;
+		size_t size=BrewLogger::recordLength(ptr,_inEnd - _inStart);
+		if(size ==0) return false; // incomplete record
+		if(size == InvalidLogRecord){
+			// skip the corrupt byte
+			_inStart++;
+			return true;
+		}
+		_inStart += size;
+		uint8_t tag=ptr[0];
+		uint8_t mask=ptr[1];
+
+		if(tag == PeriodTag || tag == DeltaPeriodTag){
+			BrewLogger::decodePeriodRecord(ptr,_values);
+			for(int i=0;i<7;i++){
+				// aux temperature and gravity are not repeated
+				if(i >= OrderExtTemp && !(mask & (1<<i))) _values[i] = INVALID_TEMP_INT;
+				uint16_t v=_values[i];
+				if(v == INVALID_TEMP_INT) continue;
+				int dv=decodeValue(i,v);
+				if(!(_has & (1<<i))){
+					_has |= (1<<i);
+					_min[i]=_max[i]=v;
+					_minAt[i]=_maxAt[i]=_count;
+				}else if(dv < decodeValue(i,_min[i])){
+					_min[i]=v;
+					_minAt[i]=_count;
+				}else if(dv > decodeValue(i,_max[i])){
+					_max[i]=v;
+					_maxAt[i]=_count;
+				}
+			}
+			_count ++;
+			if(_count >= _bucketSize) flushBucket();
+		}else if(tag == StartLogTag){
+			// header: period scaled up to the bucket
+			uint8_t header[8];
+			memcpy(header,ptr,8);
+			uint32_t period = (((uint32_t)ptr[2] << 8) | ptr[3]) * _bucketSize /2;
+			if(period > 0xFFFF) period = 0xFFFF;
+			header[2] = (uint8_t)(period >> 8);
+			header[3] = (uint8_t)(period & 0xFF);
+			output(header,8);
+		}else if(tag == ResumeBrewTag){
+			// time changes, close the bucket before it.
+			flushBucket();
+			output(ptr,size);
+		}else{
+			// mode, state, OG
+			output(ptr,size);
+		}
+		return true;
+	}
+
+	void flushBucket(void)
+	{
+		if(_count ==0) return;
+		uint8_t rec[2][16];
+		uint8_t len[2]={2,2};
+		uint8_t mask[2]={0,0};
+
+		for(int i=0;i<7;i++){
+			uint16_t first,second;
+			if(_has & (1<<i)){
+				bool minFirst= _minAt[i] <= _maxAt[i];
+				first = minFirst? _min[i]:_max[i];
+				second = minFirst? _max[i]:_min[i];
+			}else if(i < OrderExtTemp){
+				first = second = INVALID_TEMP_INT;
+			}else{
+				continue;
+			}
+			mask[0] |= (1<<i);
+			mask[1] |= (1<<i);
+			rec[0][len[0]++] = (first >> 8) & 0x7F;
+			rec[0][len[0]++] = first & 0xFF;
+			rec[1][len[1]++] = (second >> 8) & 0x7F;
+			rec[1][len[1]++] = second & 0xFF;
+		}
+		for(int r=0;r<2;r++){
+			rec[r][0]=PeriodTag;
+			rec[r][1]=mask[r];
+			output(rec[r],len[r]);
+		}
+		resetBucket();
+	}
+};
+
+#endif
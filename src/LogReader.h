@@ -0,0 +1,142 @@
+#ifndef LogReader_H
+#define LogReader_H
+#include <FS.h>
+
+#include "BrewLogger.h"
+
+// a read cursor on the current log, owned by one response.
+// Data before brewLogger.savedLength() are read from the log file,
+// the rest from the buffer of brewLogger.
+
+// number of readers, each takes about 300 bytes of heap
+#ifndef MaxLogReaders
+#define MaxLogReaders 2
+#endif
+// seconds a client is asked to wait when all readers are in use
+#define LogReaderRetryAfter "2"
+#define LogReadAheadSize 256
+
+class LogReader
+{
+public:
+	LogReader(void):_pos(0),_end(0),_headerSize(0),_headerSent(0),
+		_aheadStart(0),_aheadLen(0),_filePos(0)
+	{
+		count() ++;
+	}
+
+	~LogReader(void)
+	{
+		if(_file) _file.close();
+		count() --;
+	}
+
+	static bool available(void)
+	{
+		return count() < MaxLogReaders;
+	}
+
+	// records after offset "last", returns size of data
+	size_t beginAfter(size_t last)
+	{
+		return beginBytes(last,brewLogger.currentLogLength());
+	}
+
+	// bytes [start,end) of the log
+	size_t beginBytes(size_t start,size_t end)
+	{
+		if(!brewLogger.isLogging()) return 0;
+		_pos = start;
+		_end = end;
+		if(_end > brewLogger.currentLogLength()) _end = brewLogger.currentLogLength();
+		return (_pos < _end)? (_end - _pos):0;
+	}
+
+	// records between time "from" and "to", led by a header of full channel values
+	size_t beginRange(uint32_t from,uint32_t to)
+	{
+		if(!brewLogger.isLogging()) return 0;
+		_headerSize = brewLogger.locateRange(from,to,_pos,_end,_header);
+		if(_pos >= _end) return 0;
+		return _headerSize + _end - _pos;
+	}
+
+	size_t read(uint8_t *buffer,size_t maxLen)
+	{
+		size_t sizeRead=0;
+		if(_headerSent < _headerSize){
+			sizeRead = _headerSize - _headerSent;
+			if(sizeRead > maxLen) sizeRead = maxLen;
+			memcpy(buffer,_header + _headerSent,sizeRead);
+			_headerSent += sizeRead;
+		}
+
+		while(sizeRead < maxLen && _pos < _end){
+			size_t want= maxLen - sizeRead;
+			if(want > _end - _pos) want = _end - _pos;
+			size_t len;
+
+			if(_pos >= _aheadStart && _pos < _aheadStart + _aheadLen){
+				len = _aheadStart + _aheadLen - _pos;
+				if(len > want) len = want;
+				memcpy(buffer + sizeRead,_ahead + (_pos - _aheadStart),len);
+			}else if(_pos >= brewLogger.savedLength()){
+				len = brewLogger.readBuffered(_pos,buffer + sizeRead,want);
+			}else if(want >= LogReadAheadSize){
+				// large enough, read directly
+				len = readFile(buffer + sizeRead,want);
+			}else{
+				_aheadLen = readFile(_ahead,LogReadAheadSize);
+				_aheadStart = _pos;
+				if(_aheadLen ==0) break;
+				continue;
+			}
+			if(len ==0) break;
+			_pos += len;
+			sizeRead += len;
+		}
+		return sizeRead;
+	}
+
+private:
+	size_t _pos;
+	size_t _end;
+	char   _header[RangeHeaderSize];
+	size_t _headerSize;
+	size_t _headerSent;
+
+	File _file;
+	uint8_t _ahead[LogReadAheadSize];
+	size_t _aheadStart;
+	size_t _aheadLen;
+	size_t _filePos;
+
+	static uint8_t& count(void)
+	{
+		static uint8_t readers=0;
+		return readers;
+	}
+
+	// read the log file at _pos, not beyond the part written
+	size_t readFile(uint8_t *buffer,size_t len)
+	{
+		if(!_file){
+			char path[36];
+			brewLogger.getCurrentLogPath(path);
+			_file=SPIFFS.open(path,"r");
+			if(!_file){
+				DBG_PRINTF("error open file\n");
+				return 0;
+			}
+			_filePos=0;
+		}
+		size_t saved=brewLogger.savedLength();
+		if(len > saved - _pos) len = saved - _pos;
+		if(_filePos != _pos) _file.seek(_pos,SeekSet);
+		len=_file.read(buffer,len);
+		_filePos = _pos + len;
+		return len;
+	}
+};
+
+#endif
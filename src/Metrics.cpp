@@ -0,0 +1,145 @@
+#include "Metrics.h"
+
+#if EnableMetrics == true
+#include "TaskScheduler.h"
+#include "VirtualSerial.h"
+#include "JsonWriter.h"
+
+extern LineRing brewPiRxBuffer;
+extern LineRing brewPiTxBuffer;
+
+MetricsProbe *MetricsProbe::_first;
+MetricsClass Metrics;
+
+// deviation of the control tick from MetricsControlPeriod
+static MetricsProbe controlJitter("control_jitter");
+
+void MetricsProbe::begin(const char *name,const char *label)
+{
+	if(_name) return;
+	_name=name;
+	_label=label;
+	// keep the order of registration
+	MetricsProbe **p= &_first;
+	while(*p) p= &(*p)->_next;
+	*p=this;
+}
+
+void MetricsClass::controlTick(void)
+{
+	uint32_t now=micros();
+	if(_lastTick){
+		int32_t deviation=(int32_t)(now - _lastTick) - MetricsControlPeriod * 1000L;
+		controlJitter.record((deviation < 0)? -deviation:deviation);
+	}
+	_lastTick=now;
+}
+
+static void printNumber(Print& out,uint64_t v)
+{
+	char buf[21];
+	char *p=buf + sizeof(buf);
+	*--p='\0';
+	do{
+		*--p = '0' + v % 10;
+		v /= 10;
+	}while(v);
+	out.print(p);
+}
+
+void MetricsClass::printLabels(Print& out,MetricsProbe *probe)
+{
+	out.print("probe=\"");
+	out.print(probe->name());
+	if(probe->label()){
+		out.print("\",path=\"");
+		out.print(probe->label());
+	}
+	out.write('"');
+}
+
+void MetricsClass::printPrometheus(Print& out)
+{
+	out.print("# TYPE bpl_latency_us histogram\n");
+	for(MetricsProbe *probe=MetricsProbe::first();probe;probe=probe->next()){
+		if(probe->count() ==0) continue;
+		// empty buckets after the longest one are left out
+		uint8_t last=MetricsBuckets;
+		while(last && probe->bucket(last - 1) ==0) last--;
+		uint32_t total=0;
+		for(uint8_t i=0;i<last;i++){
+			total += probe->bucket(i);
+			out.print("bpl_latency_us_bucket{");
+			printLabels(out,probe);
+			out.printf(",le=\"%u\"} %u\n",1u << i,total);
+		}
+		out.print("bpl_latency_us_bucket{");
+		printLabels(out,probe);
+		out.printf(",le=\"+Inf\"} %u\n",probe->count());
+		out.print("bpl_latency_us_sum{");
+		printLabels(out,probe);
+		out.print("} ");
+		printNumber(out,probe->sum());
+		out.print("\nbpl_latency_us_count{");
+		printLabels(out,probe);
+		out.printf("} %u\n",probe->count());
+	}
+	out.print("# TYPE bpl_latency_max_us gauge\n");
+	for(MetricsProbe *probe=MetricsProbe::first();probe;probe=probe->next()){
+		if(probe->count() ==0) continue;
+		out.print("bpl_latency_max_us{");
+		printLabels(out,probe);
+		out.printf("} %u\n",probe->max());
+	}
+
+	out.print("# TYPE bpl_task_runs_total counter\n");
+	for(uint8_t i=0;i<TaskScheduler.count();i++)
+		out.printf("bpl_task_runs_total{task=\"%s\"} %u\n",TaskScheduler.task(i).name,TaskScheduler.task(i).runs);
+	out.print("# TYPE bpl_task_overruns_total counter\n");
+	for(uint8_t i=0;i<TaskScheduler.count();i++)
+		out.printf("bpl_task_overruns_total{task=\"%s\"} %u\n",TaskScheduler.task(i).name,TaskScheduler.task(i).overruns);
+	out.print("# TYPE bpl_task_max_us gauge\n");
+	for(uint8_t i=0;i<TaskScheduler.count();i++)
+		out.printf("bpl_task_max_us{task=\"%s\"} %u\n",TaskScheduler.task(i).name,TaskScheduler.task(i).maxTime);
+	out.print("# TYPE bpl_task_max_late_ms gauge\n");
+	for(uint8_t i=0;i<TaskScheduler.count();i++)
+		out.printf("bpl_task_max_late_ms{task=\"%s\"} %u\n",TaskScheduler.task(i).name,TaskScheduler.task(i).maxLate);
+	out.printf("# TYPE bpl_tasks_dropped gauge\nbpl_tasks_dropped %u\n",TaskScheduler.dropped());
+	out.printf("# TYPE bpl_idle_ms_total counter\nbpl_idle_ms_total %u\n",TaskScheduler.idleTime());
+	out.printf("# TYPE bpl_uptime_ms counter\nbpl_uptime_ms %u\n",TaskScheduler.upTime());
+
+	out.printf("# TYPE bpl_line_overflows_total counter\nbpl_line_overflows_total{ring=\"rx\"} %u\nbpl_line_overflows_total{ring=\"tx\"} %u\n",
+		brewPiRxBuffer.overflows(),brewPiTxBuffer.overflows());
+	out.printf("# TYPE bpl_ring_high_water_bytes gauge\nbpl_ring_high_water_bytes{ring=\"rx\"} %u\nbpl_ring_high_water_bytes{ring=\"tx\"} %u\n",
+		brewPiRxBuffer.highWater(),brewPiTxBuffer.highWater());
+	out.printf("# TYPE bpl_free_heap_bytes gauge\nbpl_free_heap_bytes %u\n",ESP.getFreeHeap());
+}
+
+void MetricsClass::printJson(Print& out)
+{
+	// "name":[count,mean,max], in us
+	JsonWriter json(out);
+	json.beginObject();
+	json.add("up",TaskScheduler.upTime());
+	json.add("idle",TaskScheduler.idleTime());
+	json.add("heap",(uint32_t)ESP.getFreeHeap());
+	json.key("probes");
+	json.beginObject();
+	for(MetricsProbe *probe=MetricsProbe::first();probe;probe=probe->next()){
+		if(probe->count() ==0) continue;
+		char name[48];
+		if(probe->label()) snprintf(name,sizeof(name),"%s %s",probe->name(),probe->label());
+		else strncpy(name,probe->name(),sizeof(name));
+		name[sizeof(name) -1]='\0';
+		json.key(name);
+		json.beginArray();
+		json.number(probe->count());
+		json.number((uint32_t)(probe->sum() / probe->count()));
+		json.number(probe->max());
+		json.endArray();
+	}
+	json.endObject();
+	json.endObject();
+}
+
+#endif
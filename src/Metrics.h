@@ -0,0 +1,119 @@
+#ifndef Metrics_H
+#define Metrics_H
+#include <Arduino.h>
+#include "espconfig.h"
+
+// latency probes.
+// A probe times a block with the CPU cycle counter and keeps the count, the
+// sum, the maximum and a histogram with a bucket per power of two us.
+//	void TempControl::updateTemperatures(void){
+//		METRICS_PROBE("update_temperatures");
+//		...
+// The probes are read in Prometheus text format at METRICS_PATH, and as a
+// short summary on the "metrics" SSE event.
+// With EnableMetrics false the macros are empty, and nothing is compiled in.
+
+#if EnableMetrics == true
+
+// 1us to 2^(MetricsBuckets-1) us, about 2s. Longer ones are only in +Inf
+#define MetricsBuckets 22
+// nominal period of the control tick, ms
+#define MetricsControlPeriod 1000
+// the SSE summary
+#define MetricsJsonSize 1536
+
+class MetricsProbe
+{
+public:
+	// the label is a path, for web handlers
+	MetricsProbe(void):_name(NULL),_label(NULL),_next(NULL){ clear(); }
+	MetricsProbe(const char *name,const char *label=NULL):MetricsProbe(){ begin(name,label); }
+	// registers the probe, once
+	void begin(const char *name,const char *label=NULL);
+
+	void record(uint32_t us){
+		_count++;
+		_sum += us;
+		if(us > _max) _max=us;
+		uint8_t i= (us > 1)? (32 - __builtin_clz(us - 1)):0;
+		if(i >= MetricsBuckets) return;
+		_buckets[i]++;
+	}
+	void clear(void){
+		_count=0;
+		_sum=0;
+		_max=0;
+		memset(_buckets,0,sizeof(_buckets));
+	}
+
+	const char *name(void){ return _name; }
+	const char *label(void){ return _label; }
+	uint32_t count(void){ return _count; }
+	uint64_t sum(void){ return _sum; }
+	uint32_t max(void){ return _max; }
+	// bucket i: longer than 2^(i-1) us, up to 2^i us
+	uint32_t bucket(uint8_t i){ return _buckets[i]; }
+	MetricsProbe *next(void){ return _next; }
+
+	static MetricsProbe *first(void){ return _first; }
+private:
+	const char *_name;
+	const char *_label;
+	MetricsProbe *_next;
+	uint32_t _count;
+	uint64_t _sum;
+	uint32_t _max;
+	uint32_t _buckets[MetricsBuckets];
+
+	static MetricsProbe *_first;
+};
+
+// times its own scope
+class MetricsScope
+{
+public:
+	MetricsScope(MetricsProbe& probe):_probe(probe),_start(ESP.getCycleCount()){}
+	~MetricsScope(void){
+		// the counter wraps in 26s at 160MHz, which is long enough here
+		_probe.record((ESP.getCycleCount() - _start) / ESP.getCpuFreqMHz());
+	}
+private:
+	MetricsProbe& _probe;
+	uint32_t _start;
+};
+
+class MetricsClass
+{
+public:
+	MetricsClass(void):_lastTick(0){}
+	// at each control tick, for the jitter against MetricsControlPeriod
+	void controlTick(void);
+
+	void printPrometheus(Print& out);
+	// "name":[count,mean,max] for each probe
+	void printJson(Print& out);
+private:
+	uint32_t _lastTick;
+
+	void printLabels(Print& out,MetricsProbe *probe);
+};
+
+extern MetricsClass Metrics;
+
+#define MetricsJoin2(a,b) a##b
+#define MetricsJoin(a,b) MetricsJoin2(a,b)
+// a probe of its own for the rest of the block
+#define METRICS_PROBE(name) static MetricsProbe MetricsJoin(_metricsProbe,__LINE__)(name); \
+	MetricsScope MetricsJoin(_metricsScope,__LINE__)(MetricsJoin(_metricsProbe,__LINE__))
+// the rest of the block, to a probe defined elsewhere
+#define METRICS_SCOPE(probe) MetricsScope MetricsJoin(_metricsScope,__LINE__)(probe)
+#define METRICS_CONTROL_TICK() Metrics.controlTick()
+
+#else
+
+#define METRICS_PROBE(name)
+#define METRICS_SCOPE(probe)
+#define METRICS_CONTROL_TICK()
+
+#endif
+#endif
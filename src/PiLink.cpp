@@ -39,6 +39,7 @@
 #ifdef ESP8266_ONE
 #include "VirtualSerial.h"
 #endif
+#include "Metrics.h"
 
 #ifdef ESP8266_WiFi_Control
 #include <ESP8266WiFi.h>          //ESP8266 Core WiFi Library
@@ -113,21 +114,24 @@ void formatStandardAnnotation(String &annotation, const char* str_1, const char*
 extern void handleReset();
 
 #ifdef ESP8266_ONE
-extern QueueBuffer brewPiTxBuffer;
-extern QueueBuffer brewPiRxBuffer;
+extern LineRing brewPiTxBuffer;
+extern LineRing brewPiRxBuffer;
+// every response line is assembled here, then committed to brewPiTxBuffer
+static LineWriter txLine(brewPiTxBuffer, TX_LINE_BUFFER_SIZE);
 #endif
 
 // create a printf like interface to the Arduino Serial function. Format string stored in PROGMEM
 void PiLink::print_P(const char *fmt, ... ){
 	va_list args;
 	va_start (args, fmt );
+#ifdef ESP8266_ONE
+	txLine.vprintf_P(fmt, args);
+	va_end (args);
+#else
 	vsnprintf_P(printfBuff, PRINTF_BUFFER_SIZE, fmt, args);
 //	vsnprintf(printfBuff, PRINTF_BUFFER_SIZE, fmt, args);
 	va_end (args);
 
-#ifdef ESP8266_ONE
-	brewPiTxBuffer.print(printfBuff);
-#else
 #ifdef ESP8266_WiFi
 	if (piStream && piStream.connected()) { // if WiFi client connected
 #ifdef BUFFER_PILINK_PRINTS
@@ -148,11 +152,12 @@ void PiLink::print_P(const char *fmt, ... ){
 void PiLink::print(const char *fmt, ... ){
 	va_list args;
 	va_start (args, fmt );
-	vsnprintf(printfBuff, PRINTF_BUFFER_SIZE, fmt, args);
-	va_end (args);
 #ifdef ESP8266_ONE
-	brewPiTxBuffer.print(printfBuff);
+	txLine.vprintf(fmt, args);
+	va_end (args);
 #else
+	vsnprintf(printfBuff, PRINTF_BUFFER_SIZE, fmt, args);
+	va_end (args);
 #ifdef ESP8266_WiFi
 	if (piStream && piStream.connected()) { // if WiFi client connected
 #ifdef BUFFER_PILINK_PRINTS
@@ -176,7 +181,7 @@ void PiLink::print(const char *fmt, ... ){
 #ifdef ESP8266
 void PiLink::print(char out) {
 #ifdef ESP8266_ONE
-brewPiTxBuffer.print(out);
+	txLine.write(out);
 #else
 #ifdef ESP8266_WiFi
 	if (piStream && piStream.connected()) { // if WiFi client connected
@@ -198,7 +203,7 @@ brewPiTxBuffer.print(out);
 
 void PiLink::printNewLine(){
 #ifdef ESP8266_ONE
-	brewPiTxBuffer.println();
+	txLine.endLine();
 #else
 #ifdef ESP8266_WiFi
 	if (piStream && piStream.connected()) { // if WiFi client connected
@@ -235,18 +240,28 @@ void PiLink::printNibble(uint8_t n)
 }
 #endif
 
+#ifdef ESP8266_ONE
+// the rest of the line being received, commands and their json are read from it
+static char* rxCursor;
+static char* rxEnd;
+#endif
+
 // Trying to enforce that the only thing to talk to piStream is piLink
 int PiLink::read() {
 #ifdef ESP8266_ONE
-	return brewPiRxBuffer.read();
+	return (rxCursor < rxEnd)? *rxCursor++ : -1;
 #else
 	return piStream.read();
 #endif
 }
 
 void PiLink::receive(void){
+	METRICS_PROBE("pilink_receive");
 #ifdef ESP8266_ONE
-	while (brewPiRxBuffer.available() > 0) {
+	size_t len;
+	while ((rxCursor = brewPiRxBuffer.nextLine(len)) != NULL) {
+	rxEnd = rxCursor + len;
+	while (rxCursor < rxEnd) {
 #else
 	while (piStream.available() > 0) {
 #endif
@@ -412,6 +427,9 @@ void PiLink::receive(void){
 			logWarningInt(WARNING_INVALID_COMMAND, inByte);
 		}
 	}
+#ifdef ESP8266_ONE
+	}
+#endif
 }
 
 
@@ -562,9 +580,14 @@ void PiLink::debugMessage(const char * message, ...){
 
 	// Using print_P for the Annotation fails. Arguments are not passed correctly. Use Serial directly as a work around.
 	va_start (args, message );
+#ifdef ESP8266_ONE
+	txLine.vprintf_P(message, args);
+	va_end (args);
+#else
 	vsnprintf_P(printfBuff, PRINTF_BUFFER_SIZE, message, args);
 	va_end (args);
 	print(printfBuff);
+#endif
 	printNewLine();
 }
 
@@ -574,19 +597,6 @@ void PiLink::sendJsonClose() {
 	printNewLine();
 }
 
-// Send settings as JSON string
-void PiLink::sendControlSettings(void){
-	char tempString[12];
-	printResponse('S');
-	ControlSettings& cs = tempControl.cs;
-	sendJsonPair(JSONKEY_mode, cs.mode);
-	sendJsonPair(JSONKEY_beerSetting, tempToString(tempString, cs.beerSetting, 2, 12));
-	sendJsonPair(JSONKEY_fridgeSetting, tempToString(tempString, cs.fridgeSetting, 2, 12));
-	sendJsonPair(JSONKEY_heatEstimator, fixedPointToString(tempString, cs.heatEstimator, 3, 12));
-	sendJsonPair(JSONKEY_coolEstimator, fixedPointToString(tempString, cs.coolEstimator, 3, 12));
-	sendJsonClose();
-}
-
 // where the offset is relative to. This saves having to store a full 16-bit pointer.
 // becasue the structs are static, we can only compute an offset relative to the struct (cc,cs,cv etc..)
 // rather than offset from tempControl.
@@ -609,6 +619,12 @@ void PiLink::jsonOutputTempToString(const char* key,  uint8_t offset) {
 	piLink.sendJsonPair(key, tempToString(buf, *((temperature*)(jsonOutputBase+offset)), 1, 12));
 }
 
+// settings have 2 decimals
+void PiLink::jsonOutputTempSettingToString(const char* key, uint8_t offset) {
+	char buf[12];
+	piLink.sendJsonPair(key, tempToString(buf, *((temperature*)(jsonOutputBase+offset)), 2, 12));
+}
+
 void PiLink::jsonOutputFixedPointToString(const char* key, uint8_t offset) {
 	char buf[12];
 	piLink.sendJsonPair(key, fixedPointToString(buf, *((temperature*)(jsonOutputBase+offset)), 3, 12));
@@ -632,6 +648,7 @@ enum JsonOutputIndex {
 	JOCC_TEMP_DIFF=3,
 	JOCC_CHAR=4,
 	JOCC_UINT16=5,
+	JOCC_TEMP_SETTING=6,
 };
 
 const PiLink::JsonOutputHandler PiLink::JsonOutputHandlers[] = {
@@ -641,12 +658,38 @@ const PiLink::JsonOutputHandler PiLink::JsonOutputHandlers[] = {
 	PiLink::jsonOutputTempDiffToString,
 	PiLink::jsonOutputChar,
 	PiLink::jsonOutputUint16,
+	PiLink::jsonOutputTempSettingToString,
+};
+
+// size of the value of each handler, to find what changed
+const uint8_t PiLink::JsonOutputSizes[] = {
+	sizeof(uint8_t),
+	sizeof(temperature),
+	sizeof(temperature),
+	sizeof(temperature),
+	sizeof(char),
+	sizeof(uint16_t),
+	sizeof(temperature),
 };
 
 #define JSON_OUTPUT_CC_MAP(name, fn) { JSONKEY_ ## name,  offsetof(ControlConstants, name), fn }
 #define JSON_OUTPUT_CV_MAP(name, fn) { JSONKEY_ ## name,  offsetof(ControlVariables, name), fn }
 #define JSON_OUTPUT_CS_MAP(name, fn) { JSONKEY_ ## name,  offsetof(ControlSettings, name), fn }
 
+const PiLink::JsonOutput PiLink::jsonOutputCSMap[] PROGMEM = {
+	JSON_OUTPUT_CS_MAP(mode, JOCC_CHAR),
+	JSON_OUTPUT_CS_MAP(beerSetting, JOCC_TEMP_SETTING),
+	JSON_OUTPUT_CS_MAP(fridgeSetting, JOCC_TEMP_SETTING),
+	JSON_OUTPUT_CS_MAP(heatEstimator, JOCC_FIXED_POINT),
+	JSON_OUTPUT_CS_MAP(coolEstimator, JOCC_FIXED_POINT)
+};
+
+// Send settings as JSON string
+void PiLink::sendControlSettings(const ControlSettings* before){
+	jsonOutputBase = (uint8_t*)&tempControl.cs;
+	sendJsonValues('S', jsonOutputCSMap, sizeof(jsonOutputCSMap)/sizeof(jsonOutputCSMap[0]), (const uint8_t*)before);
+}
+
 const PiLink::JsonOutput PiLink::jsonOutputCCMap[] PROGMEM = {
 	JSON_OUTPUT_CC_MAP(tempFormat, JOCC_CHAR),
 	JSON_OUTPUT_CC_MAP(tempSettingMin, JOCC_TEMP_FORMAT),
@@ -685,20 +728,32 @@ const PiLink::JsonOutput PiLink::jsonOutputCCMap[] PROGMEM = {
 
 };
 
-void PiLink::sendJsonValues(char responseType, const JsonOutput* /*PROGMEM*/ jsonOutputMap, uint8_t mapCount) {
-	printResponse(responseType);
+// before is a copy of the struct at jsonOutputBase. If given, only the values
+// that differ from it are sent, and no line at all if none do. Values are
+// compared as stored, so after a change of tempFormat the callers pass NULL.
+void PiLink::sendJsonValues(char responseType, const JsonOutput* /*PROGMEM*/ jsonOutputMap, uint8_t mapCount, const uint8_t* before) {
+	bool open = (before == NULL);
+	if (open)
+		printResponse(responseType);
 	while (mapCount-->0) {
 		JsonOutput output;
 		memcpy_P(&output, jsonOutputMap++, sizeof(output));
+		if (before && memcmp(jsonOutputBase+output.offset, before+output.offset, JsonOutputSizes[output.handlerOffset]) == 0)
+			continue;
+		if (!open) {
+			printResponse(responseType);
+			open = true;
+		}
 		JsonOutputHandlers[output.handlerOffset](output.key,output.offset);
 	}
-	sendJsonClose();
+	if (open)
+		sendJsonClose();
 }
 
 // Send control constants as JSON string. Might contain spaces between minus sign and number. Python will have to strip these
-void PiLink::sendControlConstants(void){
+void PiLink::sendControlConstants(const ControlConstants* before){
 	jsonOutputBase = (uint8_t*)&tempControl.cc;
-	sendJsonValues('C', jsonOutputCCMap, sizeof(jsonOutputCCMap)/sizeof(jsonOutputCCMap[0]));
+	sendJsonValues('C', jsonOutputCCMap, sizeof(jsonOutputCCMap)/sizeof(jsonOutputCCMap[0]), (const uint8_t*)before);
 }
 
 const PiLink::JsonOutput PiLink::jsonOutputCVMap[] PROGMEM = {
@@ -724,9 +779,16 @@ void PiLink::sendControlVariables(void){
 void PiLink::printJsonName(const char * name)
 {
 	printJsonSeparator();
+#ifdef ESP8266_ONE
+	// the name is not a format, it is copied as it is
+	txLine.write('"');
+	txLine.print_P(name);
+	txLine.write("\":", 2);
+#else
 	print('"');
 	print_P(name);
 	print("\":");
+#endif
 }
 
 inline void PiLink::printJsonSeparator() {
@@ -739,6 +801,8 @@ void PiLink::sendJsonPair(const char * name, const char * val){
 	// TODO - Fix this to use PiLink.print in all cases
 #ifndef ESP8266
 	piStream.print(val);
+#elif defined(ESP8266_ONE)
+	txLine.print(val);
 #else
 	print_P(val);
 #endif
@@ -760,11 +824,11 @@ void PiLink::sendJsonPair(const char * name, uint8_t val) {
 	sendJsonPair(name, (uint16_t)val);
 }
 
+#ifndef ESP8266_ONE
+#define JSON_BUFFER_SIZE 128
+
 int readNext()
 {
-#ifdef ESP8266_ONE
-	return piLink.read();
-#else
 	uint8_t retries = 0;
 	while (piStream.available()==0) {
 #ifdef ESP8266
@@ -780,63 +844,66 @@ int readNext()
 		}
 	}
 	return piLink.read();
-#endif
 }
+
 /**
- * Parses a token from the piStream.
- * \return true if a token was parsed
+ * Reads the json object from the piStream, up to and including the closing brace.
+ * \return the end of the text read
  */
-bool parseJsonToken(char* val) {
-	uint8_t index = 0;
-	val[0] = 0;
-	bool result = true;
-	for(;;) // get value
-	{
+char* readJson(char* buffer) {
+	char* p = buffer;
+	// one byte is kept for the terminating nul
+	while (p < buffer + JSON_BUFFER_SIZE - 1) {
 		int character = readNext();
-		if (index==29 || character == '}' || character==-1) {
-			result = false;
+		if (character == -1 || character == '\n')
 			break;
-		}
-		if(character == ',' || character==':')  // end of value
+		*p++ = character;
+		if (character == '}')
 			break;
-		if(character == ' ' || character == '"'){
-			; // skip spaces and apostrophes
-		}
-		else
-			val[index++] = character;
 	}
-	val[index]=0; // null terminate string
-	return result;
+	*p = 0;
+	return p;
 }
+#endif
 
-void PiLink::parseJson(ParseJsonCallback fn, void* data)
+uint8_t PiLink::parseJson(ParseJsonCallback fn, void* data)
 {
-	char key[30];
-	char val[30];
-	*key = 0;
-	*val = 0;
-	bool next = true;
-	// read first open brace
-	int c = readNext();
-	if (c!='{')
-	{
-		logErrorInt(ERROR_EXPECTED_BRACKET, c);
-		return;
-	}
-	do {
-		next = parseJsonToken(key) && parseJsonToken(val);
-		if (val[0] && key[0])
-			fn(key, val, data);
-	} while (next);
+	JsonSpan s;
+#ifdef ESP8266_ONE
+	s.p = rxCursor;
+	s.end = rxEnd;
+#else
+	static char buffer[JSON_BUFFER_SIZE];
+	s.p = buffer;
+	s.end = readJson(buffer);
+#endif
+	char* start = s.p;
+	uint8_t result = parseJsonObject(s, fn, data);
+#ifdef ESP8266_ONE
+	// commands after the object are still received, the rest of a bad line is not
+	rxCursor = (result == JsonOk)? s.p : rxEnd;
+#endif
+	if (result == JsonExpectedBracket)
+		logErrorInt(ERROR_EXPECTED_BRACKET, (s.p == s.end)? -1 : *s.p);
+	else if (result != JsonOk)
+		logErrorIntInt(ERROR_INVALID_JSON, result, s.p - start);
+	return result;
 }
 
 void PiLink::receiveJson(void){
+#if !BREWPI_SIMULATE
+	ControlSettings cs = tempControl.cs;
+	ControlConstants cc = tempControl.cc;
+#endif
 
 	parseJson(&processJsonPair, NULL);
 
 #if !BREWPI_SIMULATE	// this is quite an overhead and not needed for the simulator
-	sendControlSettings();	// update script with new settings
-	sendControlConstants();
+	// update script with what changed, 's' and 'c' still send everything.
+	// The values are kept in C, a new format changes all of them as sent.
+	bool formatChanged = (cc.tempFormat != tempControl.cc.tempFormat);
+	sendControlSettings(formatChanged? NULL : &cs);
+	sendControlConstants(formatChanged? NULL : &cc);
 #endif
 	return;
 }
@@ -857,46 +924,26 @@ static const char STR_FRIDGE_TEMP[] PROGMEM = "Fridge temp";
 static const char STR_FMT_SET_TO[] PROGMEM = "%S set to %s %S";
 #endif
 
-void PiLink::setMode(const char* val) {
-	char mode = val[0];
+void PiLink::setMode(char mode) {
 	tempControl.setMode(mode);
-#if 0 //#ifdef ESP8266
-	String annotation = "";
-	formatStandardAnnotation(annotation, STR_MODE, val, "in web interface");
-	printTemperaturesJSON(0, annotation.c_str());
-#else
+	char val[2]={mode,'\0'};
 	piLink.printFridgeAnnotation(STR_FMT_SET_TO, STR_MODE, val, STR_WEB_INTERFACE);
-#endif
 }
 
-void PiLink::setBeerSetting(const char* val) {
-#if 0 //#ifdef ESP8266
-	String annotation = "";
-#endif
+void PiLink::setBeerSetting(temperature newTemp) {
 	const char* source = NULL;
-	temperature newTemp = stringToTemp(val);
 	if (tempControl.cs.mode == 'p') {
 		if (abs(newTemp - tempControl.cs.beerSetting) > 100) { // this excludes gradual updates under 0.2 degrees
-#if 0 //#ifdef ESP8266
-			formatStandardAnnotation(annotation, STR_BEER_TEMP, val, "by temperature profile");
-#else
 			source = STR_TEMPERATURE_PROFILE;
-#endif
 		}
 	} else {
-#if 0 //#ifdef ESP8266
-		formatStandardAnnotation(annotation, STR_BEER_TEMP, val, "in web interface");
-#else
 		source = STR_WEB_INTERFACE;
-#endif
 	}
-#if 0 //#ifdef ESP8266
-	if (annotation.length() > 0)
-		printTemperaturesJSON(annotation.c_str(), 0);
-#else
-	if (source)
+	if (source){
+		char val[12];
+		tempToString(val, newTemp, 2, 12);
 		printBeerAnnotation(STR_FMT_SET_TO, STR_BEER_TEMP, val, source);
-#endif
+	}
 	tempControl.setBeerTemp(newTemp);
 }
 
@@ -913,20 +960,65 @@ void formatStandardAnnotation(String &annotation, const char* str_1, const char*
 #endif
 
 
-void PiLink::setFridgeSetting(const char* val) {
-	temperature newTemp = stringToTemp(val);
+void PiLink::setFridgeSetting(temperature newTemp) {
 	if(tempControl.cs.mode == 'f'){
-#if 0 //#ifdef ESP8266
-		String annotation = "";
-		formatStandardAnnotation(annotation, STR_FRIDGE_TEMP, val, "in web interface");
-		printTemperaturesJSON(0, annotation.c_str());
-#else
+		char val[12];
+		tempToString(val, newTemp, 2, 12);
 		printFridgeAnnotation(STR_FMT_SET_TO, STR_FRIDGE_TEMP, val, STR_WEB_INTERFACE);
-#endif
 	}
 	tempControl.setFridgeTemp(newTemp);
 }
 
+void PiLink::setConstants(const ControlConstants& cc) {
+	bool formatChanged = (cc.tempFormat != tempControl.cc.tempFormat);
+	tempControl.cc = cc;
+	tempControl.fridgeSensor->setFastFilterCoefficients(cc.fridgeFastFilter);
+	tempControl.fridgeSensor->setSlowFilterCoefficients(cc.fridgeSlowFilter);
+	tempControl.fridgeSensor->setSlopeFilterCoefficients(cc.fridgeSlopeFilter);
+	tempControl.beerSensor->setFastFilterCoefficients(cc.beerFastFilter);
+	tempControl.beerSensor->setSlowFilterCoefficients(cc.beerSlowFilter);
+	tempControl.beerSensor->setSlopeFilterCoefficients(cc.beerSlopeFilter);
+	if (formatChanged)
+		display.printStationaryText(); // reprint stationary text to update to right degree unit
+	eepromManager.storeTempConstantsAndSettings();
+}
+
+void PiLink::applyCommand(const ControlCommand& command) {
+#if !BREWPI_SIMULATE
+	ControlSettings cs = tempControl.cs;
+	ControlConstants cc = tempControl.cc;
+#endif
+	if (command.mask & CommandMode) setMode(command.mode);
+	if (command.mask & CommandBeerSetting) setBeerSetting(command.beerSetting);
+	if (command.mask & CommandFridgeSetting) setFridgeSetting(command.fridgeSetting);
+	if ((command.mask & CommandConstants) && command.constants) setConstants(*command.constants);
+
+#if !BREWPI_SIMULATE
+	// all of them after a new format, as in receiveJson()
+	if (cc.tempFormat != tempControl.cc.tempFormat) {
+		sendControlSettings();
+		sendControlConstants();
+		return;
+	}
+	if (command.mask & (CommandMode | CommandBeerSetting | CommandFridgeSetting))
+		sendControlSettings(&cs);
+	if (command.mask & CommandConstants)
+		sendControlConstants(&cc);
+#endif
+}
+
+void PiLink::parseMode(const char* val) {
+	setMode(val[0]);
+}
+
+void PiLink::parseBeerSetting(const char* val) {
+	setBeerSetting(stringToTemp(val));
+}
+
+void PiLink::parseFridgeSetting(const char* val) {
+	setFridgeSetting(stringToTemp(val));
+}
+
 void PiLink::setTempFormat(const char* val) {
 	tempControl.cc.tempFormat = val[0];
 	display.printStationaryText(); // reprint stationary text to update to right degree unit
@@ -996,12 +1088,12 @@ void setBool(const char* value, uint8_t* target) {
 }
 
 
-#define JSON_CONVERT(jsonKey, target, fn) { jsonKey, target, (JsonParserHandlerFn)&fn }
+#define JSON_CONVERT(jsonKey, target, fn) { keyHash(jsonKey), jsonKey, target, (JsonParserHandlerFn)&fn }
 
 const PiLink::JsonParserConvert PiLink::jsonParserConverters[] PROGMEM = {
-	JSON_CONVERT(JSONKEY_mode, NULL, setMode),
-	JSON_CONVERT(JSONKEY_beerSetting, NULL, setBeerSetting),
-	JSON_CONVERT(JSONKEY_fridgeSetting, NULL, setFridgeSetting),
+	JSON_CONVERT(JSONKEY_mode, NULL, parseMode),
+	JSON_CONVERT(JSONKEY_beerSetting, NULL, parseBeerSetting),
+	JSON_CONVERT(JSONKEY_fridgeSetting, NULL, parseFridgeSetting),
 
 	JSON_CONVERT(JSONKEY_heatEstimator, &tempControl.cs.heatEstimator, setStringToFixedPoint),
 	JSON_CONVERT(JSONKEY_coolEstimator, &tempControl.cs.coolEstimator, setStringToFixedPoint),
@@ -1043,18 +1135,19 @@ const PiLink::JsonParserConvert PiLink::jsonParserConverters[] PROGMEM = {
 
 };
 
+JsonKeyIndex<PiLink::JsonParserConvert, JsonParserSlots> PiLink::jsonParserIndex(jsonParserConverters,
+	sizeof(jsonParserConverters)/sizeof(jsonParserConverters[0]));
+
 void PiLink::processJsonPair(const char * key, const char * val, void* pv){
+	static_assert(sizeof(jsonParserConverters)/sizeof(jsonParserConverters[0]) < JsonParserSlots, "JsonParserSlots is too small");
 	logInfoStringString(INFO_RECEIVED_SETTING, key, val);
 
-	for (uint8_t i=0; i<sizeof(jsonParserConverters)/sizeof(jsonParserConverters[0]); i++) {
+	const JsonParserConvert* entry = jsonParserIndex.find(keyHash(key), key);
+	if (entry) {
 		JsonParserConvert converter;
-		memcpy_P(&converter, &jsonParserConverters[i], sizeof(converter));
-		//logDeveloper("Handling converter %d %s %S %d %d"), i, key, converter.key, converter.fn, converter.target);
-		if (strcmp_P(key,converter.key) == 0) {
-			//logDeveloper("Handling json key %s"), key);
-			converter.fn(val, converter.target);
-			return;
-		}
+		memcpy_P(&converter, entry, sizeof(converter));
+		converter.fn(val, converter.target);
+		return;
 	}
 	logWarning(WARNING_COULD_NOT_PROCESS_SETTING);
 }
@@ -24,9 +24,31 @@
 #include "TemperatureFormats.h"
 #include "DeviceManager.h"
 #include "Logger.h"
+#include "EepromStructs.h"
+#include "JsonParser.h"
 
 
 #define PRINTF_BUFFER_SIZE 128
+// response lines are assembled in this much before they go to the TX ring,
+// enough for most in one piece. Longer ones are not cut.
+#define TX_LINE_BUFFER_SIZE 256
+// slots of the hash index of jsonParserConverters, a power of two larger than the table
+#define JsonParserSlots 64
+
+// a typed j{...} command: the parts in mask are applied in this order,
+// then the new settings and constants are reported once.
+#define CommandMode 0x01
+#define CommandBeerSetting 0x02
+#define CommandFridgeSetting 0x04
+#define CommandConstants 0x08
+
+struct ControlCommand {
+	uint8_t mask;
+	char mode;
+	temperature beerSetting;
+	temperature fridgeSetting;
+	const ControlConstants *constants;
+};
 
 class DeviceConfig;
 
@@ -49,15 +71,26 @@ class PiLink{
 
 	typedef void (*ParseJsonCallback)(const char* key, const char* val, void* data);
 
-	static void parseJson(ParseJsonCallback fn, void* data=NULL);
+	// the {...} that follows the command on the same line, see JsonParser.h.
+	// Returns a JsonParseResult, errors are logged with ERROR_INVALID_JSON.
+	static uint8_t parseJson(ParseJsonCallback fn, void* data=NULL);
 
 	static int read(void);  // Adding so we can completely abstract away piStream outside of piLink
 
+	// typed commands, for callers in the same loop as the controller.
+	// Annotations are the same as for the text command.
+	static void setMode(char mode);
+	static void setBeerSetting(temperature newTemp);
+	static void setFridgeSetting(temperature newTemp);
+	static void setConstants(const ControlConstants& cc);
+	static void applyCommand(const ControlCommand& command);
+
 	private:
 
-	static void sendControlSettings(void);
+	// with the values before a change: only the keys that changed, nothing if none did
+	static void sendControlSettings(const ControlSettings* before=NULL);
 	static void receiveControlConstants(void);
-	static void sendControlConstants(void);
+	static void sendControlConstants(const ControlConstants* before=NULL);
 	static void sendControlVariables(void);
 
 	static void receiveJson(void); // receive settings as JSON key:value pairs
@@ -109,36 +142,47 @@ private:
 		uint8_t handlerOffset;		// handler index
 	};
 	typedef void (*JsonOutputHandler)(const char* key, uint8_t offset);
-	static void sendJsonValues(char responseType, const JsonOutput* /*PROGMEM*/ jsonOutputMap, uint8_t mapCount);
+	static void sendJsonValues(char responseType, const JsonOutput* /*PROGMEM*/ jsonOutputMap, uint8_t mapCount, const uint8_t* before=NULL);
 
 
 	// handler functions for JSON output
 	static void jsonOutputUint8(const char* key, uint8_t offset);
 	static void jsonOutputTempToString(const char* key, uint8_t offset);
+	static void jsonOutputTempSettingToString(const char* key, uint8_t offset);
 	static void jsonOutputFixedPointToString(const char* key, uint8_t offset);
 	static void jsonOutputTempDiffToString(const char* key, uint8_t offset);
 	static void jsonOutputChar(const char* key, uint8_t offset);
 	static void jsonOutputUint16(const char* key, uint8_t offset);
 	static const JsonOutputHandler JsonOutputHandlers[];
+	static const uint8_t JsonOutputSizes[];
+	static const JsonOutput jsonOutputCSMap[];
 	static const JsonOutput jsonOutputCCMap[];
 	static const JsonOutput jsonOutputCVMap[];
 
 	// Json parsing
 
-	static void setMode(const char* val);
-	static void setBeerSetting(const char* val);
-	static void setFridgeSetting(const char* val);
+	// text adapters of the typed commands
+	static void parseMode(const char* val);
+	static void parseBeerSetting(const char* val);
+	static void parseFridgeSetting(const char* val);
 	static void setTempFormat(const char* val);
 
 	typedef void (*JsonParserHandlerFn)(const char* val, void* target);
 
+	// FNV-1a of the key, the table is looked up by hash
+	static constexpr uint32_t keyHash(const char* key, uint32_t hash=2166136261u){
+		return (*key)? keyHash(key+1, (hash ^ (uint8_t)*key) * 16777619u):hash;
+	}
+
 	struct JsonParserConvert {
+		uint32_t hash;
 		const char* /*PROGMEM*/ key;
 		void* target;
 		JsonParserHandlerFn fn;
 	};
 
 	static const JsonParserConvert jsonParserConverters[];
+	static JsonKeyIndex<JsonParserConvert, JsonParserSlots> jsonParserIndex;
 
 #if BREWPI_SIMULATE
 	static void updateInputs();
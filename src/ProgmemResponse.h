@@ -0,0 +1,63 @@
+#ifndef ProgmemResponse_H
+#define ProgmemResponse_H
+#include <Arduino.h>
+#include <pgmspace.h>
+#include <ESPAsyncWebServer.h>
+#include "espconfig.h"
+
+// response of content in flash.
+// The length is known once when it is created, and the content is copied
+// in 4-byte words, flash can only be read in aligned 32-bit access anyway.
+
+class ProgmemResponse: public AsyncAbstractResponse
+{
+public:
+	// length of 0: nul-terminated string
+	ProgmemResponse(const char *contentType,const void *content,size_t len=0,bool gzip=false)
+		:_content((const uint8_t*)content),_callbacks(0)
+	{
+		_code = 200;
+		_contentType = contentType;
+		_contentLength = (len ==0)? strlen_P((PGM_P)content):len;
+		if(gzip) addHeader("Content-Encoding","gzip");
+	}
+
+	bool _sourceValid(){ return _content != NULL; }
+
+	size_t _fillBuffer(uint8_t *buf, size_t maxLen)
+	{
+		_callbacks ++;
+		size_t left = _contentLength - _sentLength;
+		size_t len = (left > maxLen)? maxLen:left;
+		copy(buf,_content + _sentLength,len);
+		if(len == left) DBG_PRINTF("progmem %d bytes in %d callbacks\n",_contentLength,_callbacks);
+		return len;
+	}
+
+	static void copy(uint8_t *dst,const uint8_t *src,size_t len)
+	{
+		// to word boundary
+		while(len >0 && ((uintptr_t)src & 3)){
+			*dst++ = pgm_read_byte(src++);
+			len --;
+		}
+		const uint32_t *word=(const uint32_t*)src;
+		while(len >= 4){
+			uint32_t v=pgm_read_dword(word++);
+			memcpy(dst,&v,4);
+			dst += 4;
+			len -= 4;
+		}
+		src=(const uint8_t*)word;
+		while(len >0){
+			*dst++ = pgm_read_byte(src++);
+			len --;
+		}
+	}
+
+private:
+	const uint8_t *_content;
+	uint16_t _callbacks;
+};
+
+#endif
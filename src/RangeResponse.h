@@ -0,0 +1,38 @@
+#ifndef RangeResponse_H
+#define RangeResponse_H
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+// response that can serve a byte range.
+// ESPAsyncWebServer puts "Accept-Ranges: none" in every HTTP/1.1 head.
+// Once addRangeHeaders() has said "bytes", that one is taken out again.
+
+class RangeResponse: public AsyncAbstractResponse
+{
+public:
+	RangeResponse(void):_acceptRanges(false){}
+
+	// range >0: the part [start,end) of size bytes, for a 206
+	void addRangeHeaders(int range,size_t start,size_t end,size_t size)
+	{
+		_acceptRanges=true;
+		addHeader("Accept-Ranges","bytes");
+		if(range >0)
+			addHeader("Content-Range","bytes " + String(start) + "-" + String(end -1) + "/" + String(size));
+	}
+
+	String _assembleHead(uint8_t version)
+	{
+		String head=AsyncAbstractResponse::_assembleHead(version);
+		if(_acceptRanges){
+			head.replace("Accept-Ranges: none\r\n","");
+			_headLength=head.length();
+		}
+		return head;
+	}
+
+private:
+	bool _acceptRanges;
+};
+
+#endif
@@ -0,0 +1,84 @@
+#include "TaskScheduler.h"
+#include "espconfig.h"
+
+TaskSchedulerClass TaskScheduler;
+
+bool TaskSchedulerClass::add(const char *name,TaskFunction fn,uint32_t period,uint16_t budget)
+{
+	if(_count >= SchedulerMaxTasks){
+		DBG_PRINTF("too many tasks, %s dropped\n",name);
+		_dropped++;
+		return false;
+	}
+	Task& task=_tasks[_count++];
+	task.name=name;
+	task.fn=fn;
+	task.period=period;
+	task.budget=budget;
+	task.due=millis();
+	task.runs=0;
+	task.overruns=0;
+	task.maxTime=0;
+	task.totalTime=0;
+	task.maxLate=0;
+	if(_count == 1) _startTime=millis();
+	return true;
+}
+
+void TaskSchedulerClass::runTask(Task& task,uint32_t now)
+{
+	uint32_t start=micros();
+	task.fn();
+	uint32_t elapsed=micros() - start;
+
+	task.runs++;
+	task.totalTime += elapsed;
+	if(elapsed > task.maxTime) task.maxTime=elapsed;
+	if(elapsed > (uint32_t)task.budget * 1000){
+		task.overruns++;
+		DBG_PRINTF("task %s overrun:%u us\n",task.name,elapsed);
+	}
+	if(task.period){
+		uint32_t late=now - task.due;
+		if(late > task.maxLate) task.maxLate=late;
+		// keep the ticks aligned, unless a whole period was missed
+		task.due += task.period;
+		if((int32_t)(task.due - now) <= 0) task.due=now + task.period;
+	}
+}
+
+void TaskSchedulerClass::run(void)
+{
+	// periodic tasks that are due, the earliest deadline first
+	uint32_t ran=0;
+	for(;;){
+		uint32_t now=millis();
+		int8_t next=-1;
+		for(uint8_t i=0;i<_count;i++){
+			if(_tasks[i].period ==0 || (ran & (1 << i))) continue;
+			if((int32_t)(_tasks[i].due - now) > 0) continue;
+			if(next < 0 || (int32_t)(_tasks[i].due - _tasks[next].due) < 0) next=i;
+		}
+		if(next < 0) break;
+		ran |= 1 << next;
+		runTask(_tasks[next],now);
+	}
+
+	for(uint8_t i=0;i<_count;i++){
+		if(_tasks[i].period ==0) runTask(_tasks[i],millis());
+	}
+
+	if(ran) return;
+	// idle until the next deadline
+	uint32_t now=millis();
+	int32_t wait=SchedulerMaxIdle;
+	for(uint8_t i=0;i<_count;i++){
+		if(_tasks[i].period ==0) continue;
+		int32_t left=(int32_t)(_tasks[i].due - now);
+		if(left < wait) wait=left;
+	}
+	if(wait > 0){
+		delay(wait);
+		_idleTime += wait;
+	}
+}
@@ -0,0 +1,59 @@
+#ifndef TaskScheduler_H
+#define TaskScheduler_H
+#include <Arduino.h>
+
+// runs the parts of loop() by deadline.
+// A task with a period runs when it is due; overdue tasks go first, the most
+// overdue first, so the control tick isn't pushed back by the tasks polled on
+// every pass (period 0). Each run is timed against the budget of the task.
+// When nothing with a period is due, the time is given to the system, up to
+// SchedulerMaxIdle ms, which lets the WiFi modem sleep between ticks.
+
+#define SchedulerMaxTasks 16
+#define SchedulerMaxIdle 10
+
+typedef void (*TaskFunction)(void);
+
+struct Task {
+	const char *name;
+	TaskFunction fn;
+	uint32_t period;	// ms, 0: every pass
+	uint16_t budget;	// ms
+	uint32_t due;		// millis
+	// statistics
+	uint32_t runs;
+	uint32_t overruns;	// runs longer than the budget
+	uint32_t maxTime;	// us
+	uint32_t totalTime;	// us, wraps
+	uint32_t maxLate;	// ms after the deadline
+};
+
+class TaskSchedulerClass
+{
+public:
+	TaskSchedulerClass(void):_count(0),_dropped(0),_idleTime(0),_startTime(0){}
+	// false if there are too many tasks: the task is dropped and counted
+	bool add(const char *name,TaskFunction fn,uint32_t period,uint16_t budget);
+	// one pass, from loop()
+	void run(void);
+
+	uint8_t count(void){ return _count; }
+	const Task& task(uint8_t i){ return _tasks[i]; }
+	// tasks not added, over SchedulerMaxTasks
+	uint8_t dropped(void){ return _dropped; }
+	// ms given to the system since the first pass
+	uint32_t idleTime(void){ return _idleTime; }
+	uint32_t upTime(void){ return millis() - _startTime; }
+private:
+	Task _tasks[SchedulerMaxTasks];
+	uint8_t _count;
+	uint8_t _dropped;
+	uint32_t _idleTime;
+	uint32_t _startTime;
+
+	void runTask(Task& task,uint32_t now);
+};
+
+extern TaskSchedulerClass TaskScheduler;
+
+#endif
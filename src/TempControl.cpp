@@ -31,6 +31,7 @@
 #include "EepromManager.h"
 #include "TempSensorDisconnected.h"
 #include "RotaryEncoder.h"
+#include "Metrics.h"
 
 TempControl tempControl;
 
@@ -116,6 +117,7 @@ void updateSensor(TempSensor* sensor) {
 }
 
 void TempControl::updateTemperatures(void){
+	METRICS_PROBE("update_temperatures");
 
 	updateSensor(beerSensor);
 	updateSensor(fridgeSensor);
@@ -54,6 +54,18 @@ float temperatureFloatValue(temperature t)
 	fracPart = ((rawValue & TEMP_FIXED_POINT_MASK) * 1000 + TEMP_FIXED_POINT_SCALE/2) >> TEMP_FIXED_POINT_BITS; // add 256 for rounding
 	return sign *((float)intPart +(float)fracPart/1000.0);
 }
+
+// rounded to 2 decimals first, as the setting was when it was sent as "j{beerSet:19.25}",
+// then converted the way stringToFixedPoint() does it
+temperature floatToTemperature(float value)
+{
+	bool negative = value < 0;
+	long_temperature hundredths = (long_temperature)((negative? -value:value) * 100 + 0.5);
+	long_temperature fracPart = (hundredths % 100) << TEMP_FIXED_POINT_BITS;
+	fracPart = ((fracPart + 5) / 10 + 5) / 10; // divide by 100 rounded, as two decimals
+	long_temperature rawTemp = ((hundredths / 100) << TEMP_FIXED_POINT_BITS) + fracPart;
+	return constrainTemp16(convertToInternalTemp(negative ? -rawTemp:rawTemp));
+}
 //new
 
 // See header file for details about the temp format used.
@@ -166,5 +166,6 @@ inline long_temperature convertFromInternalTemp(long_temperature rawTemp) {
 }
 //new ESP8266_ONE
 float temperatureFloatValue(temperature t);
+temperature floatToTemperature(float value);
 //new
 #define OPTIMIZE_TEMPERATURE_FORMATS 1 && OPTIMIZE_GLOBAL
@@ -6,6 +6,7 @@ extern "C" {
 #include <sntp.h>
 }
 #include "TimeKeeper.h"
+#include "FileCache.h"
 
 #define TIME_SAVE_FILENAME "/time.saved"
 #define TIME_SAVING_PERIOD 300
@@ -105,7 +106,7 @@ const char* TimeKeeperClass::getDateTimeStr(void)
 
 void TimeKeeperClass::saveTime(time_t t)
 {
-	File f = SPIFFS.open(TIME_SAVE_FILENAME, "w");
+	File f = FileCache.openToWrite(TIME_SAVE_FILENAME);
 	if(!f){
 		DBG_PRINTF("Failed to save time!\n");
 		return;
@@ -1,34 +1,234 @@
 #include "VirtualSerial.h"
 
-int QueueBuffer::read(void)
+bool LineRing::drop(void)
 {
-	if(_writePtr == _readPtr) return -1;
-	int r=(int)_buffer[_readPtr];
-	_readPtr++;
-	if(_readPtr == _bufferSize) _readPtr=0;
+	// no partial line, ever
+	_pending=_head;
+	_dropping=true;
+	_overflows++;
+	return false;
+}
+
+bool LineRing::append(const char* data,size_t len)
+{
+	if(_dropping) return false;
+	if(_options & LineRingUtf8Degree){
+		const char *deg=(const char*)memchr(data,0xB0,len);
+		if(deg){
+			size_t before=deg - data;
+			return appendRaw(data,before) && appendRaw("\xC2\xB0",2)
+				&& append(deg + 1,len - before - 1);
+		}
+	}
+	return appendRaw(data,len);
+}
+
+bool LineRing::appendRaw(const char* data,size_t len)
+{
+	if(_dropping) return false;
+	if(len > space()) return drop();
+	if((_options & LineRingContiguous) && _pending + len >= _size){
+		// the line and its '\n' must end before the end of the buffer: move it to the start
+		uint16_t lineLen=_pending - _head;
+		if(_head < _tail || lineLen + len >= _tail) return drop();
+		memmove(_buffer,_buffer + _head,lineLen);
+		_buffer[_head]='\0';
+		_pending=lineLen;
+	}
+	size_t first=_size - _pending;
+	if(first > len) first=len;
+	memcpy(_buffer + _pending,data,first);
+	if(len > first) memcpy(_buffer,data + first,len - first);
+	_pending += len;
+	if(_pending >= _size) _pending -= _size;
+	return true;
+}
+
+void LineRing::commit(void)
+{
+	LineRingBarrier();
+	_head=_pending;
+	uint16_t used=(_head + _size - _tail) % _size;
+	if(used > _highWater) _highWater=used;
+}
+
+void LineRing::print(char c)
+{
+	if(c != '\n'){
+		append(&c,1);
+		return;
+	}
+	if(_dropping){
+		_dropping=false;
+		return;
+	}
+	if(space() ==0){
+		_pending=_head;
+		_overflows++;
+		return;
+	}
+	_buffer[_pending]='\n';
+	_pending++;
+	if(_pending == _size) _pending=0;
+	commit();
+}
+
+void LineRing::write(const char* data,size_t len)
+{
+	while(len){
+		const char *nl=(const char*)memchr(data,'\n',len);
+		size_t part= nl? (nl - data):len;
+		if(part) append(data,part);
+		if(!nl) break;
+		print('\n');
+		data = nl + 1;
+		len -= part + 1;
+	}
+}
+
+bool LineRing::writeLine(const char* line,size_t len)
+{
+	// a line being dropped ends here, this one starts clean
+	_dropping=false;
+	if(len + 1 > space()){
+		_overflows++;
+		return false;
+	}
+	// a contiguous ring can still have to drop it, when it can't be moved
+	if(!append(line,len)){
+		_dropping=false;
+		return false;
+	}
+	uint16_t head=_head;
+	print('\n');
+	return _head != head;
+}
+
+int LineRing::read(void)
+{
+	if(_head == _tail) return -1;
+	int r=(uint8_t)_buffer[_tail];
+	LineRingBarrier();
+	uint16_t next=_tail + 1;
+	if(next == _size) next=0;
+	_tail=next;
 	return r;
 }
 
-int QueueBuffer::available(void)
+size_t LineRing::read(char* buf,size_t maxLen)
 {
+	size_t len=available();
+	if(len > maxLen) len=maxLen;
+	if(len ==0) return 0;
+	LineRingBarrier();
+	size_t first=_size - _tail;
+	if(first > len) first=len;
+	memcpy(buf,_buffer + _tail,first);
+	if(len > first) memcpy(buf + first,_buffer,len - first);
+	LineRingBarrier();
+	uint16_t next=_tail + len;
+	if(next >= _size) next -= _size;
+	_tail=next;
+	return len;
+}
+
+int LineRing::available(void)
+{
+	uint16_t head=_head;
 	 // avoid using %(mod) which takes time;
-	return (_writePtr >= _readPtr)? (_writePtr - _readPtr):(_bufferSize  + _writePtr - _readPtr);
+	return (head >= _tail)? (head - _tail):(_size + head - _tail);
+}
+
+char* LineRing::nextLine(size_t& len)
+{
+	uint16_t head=_head;
+	uint16_t pos=_tail + _held;
+	if(pos >= _size) pos -= _size;
+	if(pos == head) return NULL;
+	// the end left unused by a moved line
+	if(_buffer[pos] == '\0') pos=0;
+
+	size_t span=(head > pos)? (head - pos):(_size - pos);
+	char *line=_buffer + pos;
+	char *nl=(char*)memchr(line,'\n',span);
+	if(!nl) return NULL; // not possible for a committed line
+	LineRingBarrier();
+	// the line before is released
+	_tail=pos;
+	*nl='\0';
+	len=nl - line;
+	_held=len + 1;
+	return line;
 }
 
-void QueueBuffer::print(char c)
+void LineWriter::write(const char* data,size_t len)
 {
-	_buffer[_writePtr] = c;
-	_writePtr++;
-	if(_writePtr == _bufferSize) _writePtr=0;
-//	if(_writePtr == _readPtr){
-	//		DBGPRINT("Fatal Error: queue buffer overlap");
-//	}
+	if(_length + len > _size){
+		flush();
+		if(len > _size){
+			_ring.write(data,len);
+			return;
+		}
+	}
+	memcpy(_buffer + _length,data,len);
+	_length += len;
 }
 
-void QueueBuffer::print(const char* c)
+void LineWriter::print_P(PGM_P str)
 {
-	for(char* cp=(char*)c; *cp != '\0';cp++)
-	{
-		print(*cp);
+	size_t len=strlen_P(str);
+	if(_length + len > _size){
+		flush();
+		if(len > _size){
+			// rare, in pieces through the buffer
+			while(len){
+				size_t part=(len > _size)? _size:len;
+				memcpy_P(_buffer,str,part);
+				_length=part;
+				flush();
+				str += part;
+				len -= part;
+			}
+			return;
+		}
 	}
+	memcpy_P(_buffer + _length,str,len);
+	_length += len;
+}
+
+void LineWriter::format(const char* fmt,va_list args,bool progmem)
+{
+	va_list again;
+	va_copy(again,args);
+	// straight into the buffer, nul included
+	int len= progmem? vsnprintf_P(_buffer + _length,_size - _length,fmt,args)
+		:vsnprintf(_buffer + _length,_size - _length,fmt,args);
+	if(len >= 0 && _length + len < _size){
+		_length += len;
+	}else if(len >= 0){
+		flush();
+		if(len < _size){
+			if(progmem) vsnprintf_P(_buffer,_size,fmt,again);
+			else vsnprintf(_buffer,_size,fmt,again);
+			_length=len;
+		}else{
+			char *text=(char*)malloc(len + 1);
+			if(text){
+				if(progmem) vsnprintf_P(text,len + 1,fmt,again);
+				else vsnprintf(text,len + 1,fmt,again);
+				_ring.write(text,len);
+				free(text);
+			}else{
+				// never a cut line
+				_ring.dropLine();
+			}
+		}
+	}
+	va_end(again);
+}
+
+void LineWriter::endLine(void)
+{
+	flush();
+	_ring.println();
 }
@@ -3,23 +3,108 @@
 
 #include <Arduino.h>
 
-class QueueBuffer
+// single producer, single consumer ring of text lines.
+// The producer (web callbacks for RX, PiLink for TX) appends to a pending line
+// that becomes visible to the consumer only when '\n' is written, so the
+// consumer never sees half a line. A line that doesn't fit is dropped as a
+// whole and counted, instead of overwriting unread data.
+// Each index is written by one side only; a compiler barrier orders the data
+// before the index that publishes it.
+
+#define LineRingBarrier() __asm__ __volatile__("" ::: "memory")
+
+// options
+// every line is kept in one piece, for nextLine(). A line that would cross the
+// end of the buffer is moved to the start, and a '\0' marks the unused end.
+#define LineRingContiguous 0x01
+// 0xB0, the degree sign of the LCD font, is written as UTF-8
+#define LineRingUtf8Degree 0x02
+
+class LineRing
 {
 protected:
 	char* _buffer;
-	int _writePtr;
-	int _readPtr;
-	int  _bufferSize;
+	uint16_t _size;
+	volatile uint16_t _head; // end of committed lines, written by producer
+	volatile uint16_t _tail; // read position, written by consumer
+	uint16_t _pending;       // end of the line being written
+	bool _dropping;          // rest of the current line is discarded
+	uint16_t _overflows;
+	uint16_t _highWater;
+	uint8_t _options;
+	uint16_t _held;          // length of the line handed out by nextLine()
+
+	uint16_t space(void){ return (_tail + _size - _pending - 1) % _size; }
+	bool append(const char* data,size_t len);
+	bool appendRaw(const char* data,size_t len);
+	bool drop(void);
+	void commit(void);
 public:
-	QueueBuffer(int size){_bufferSize=size; _buffer=(char*)malloc(size);  _writePtr=_readPtr=0;}
-	~QueueBuffer(void){ free(_buffer);}
+	LineRing(uint16_t size,uint8_t options=0):_size(size),_head(0),_tail(0),_pending(0),_dropping(false),
+		_overflows(0),_highWater(0),_options(options),_held(0)
+		{ _buffer=(char*)malloc(size); }
+	~LineRing(void){ free(_buffer);}
 
+	// producer
 	void print(char c);
-	void print(const char* c);
-    void println(){ print('\n');}
+	void print(const char* str){ write(str,strlen(str)); }
+	void write(const char* data,size_t len);
+	void println(){ print('\n');}
+	// a whole line, '\n' is added. false if there is no room for all of it
+	bool writeLine(const char* line,size_t len);
+	// the line being written is discarded, and counted as an overflow
+	void dropLine(void){ if(!_dropping) drop(); }
 
+	// consumer, committed lines only
 	int read(void);
+	// not for LineRingContiguous
+	size_t read(char* buf,size_t maxLen);
 	int available(void);
+	// LineRingContiguous only: the next line, nul-terminated in place, NULL if none.
+	// The line stays in the ring until the following call, so it can be used
+	// as the last line without a copy. The consumer may change it in place.
+	char* nextLine(size_t& len);
+	const char* currentLine(void){ return (_held)? (_buffer + _tail):""; }
+
+	uint16_t overflows(void){ return _overflows; }
+	uint16_t highWater(void){ return _highWater; }
+	uint16_t size(void){ return _size; }
+};
+
+// assembles a line of a LineRing in a small buffer, so that the ring sees
+// a few large appends instead of many small ones. A short line goes in with
+// one copy. A long one is passed on in pieces, but the ring still commits it
+// whole at endLine(), or drops it whole if it doesn't fit.
+class LineWriter
+{
+public:
+	LineWriter(LineRing& ring,uint16_t size):_ring(ring),_size(size),_length(0)
+		{ _buffer=(char*)malloc(size); }
+	~LineWriter(void){ free(_buffer);}
+
+	void write(char c){
+		if(_length == _size) flush();
+		_buffer[_length++]=c;
+	}
+	void write(const char* data,size_t len);
+	void print(const char* str){ write(str,strlen(str)); }
+	void print_P(PGM_P str);
+	// no limit on the length of the result
+	void vprintf(const char* fmt,va_list args){ format(fmt,args,false); }
+	void vprintf_P(PGM_P fmt,va_list args){ format(fmt,args,true); }
+	void endLine(void);
+
+protected:
+	LineRing& _ring;
+	char* _buffer;
+	uint16_t _size;
+	uint16_t _length;
+
+	void flush(void){
+		if(_length) _ring.write(_buffer,_length);
+		_length=0;
+	}
+	void format(const char* fmt,va_list args,bool progmem);
 };
 
 #endif
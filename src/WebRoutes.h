@@ -0,0 +1,96 @@
+#ifndef WebRoutes_h
+#define WebRoutes_h
+// the fixed paths of BrewPiWebHandler, their table and the lookup.
+// Nothing here needs the core, so extra/hosttest builds the same table.
+#include <stdint.h>
+#include <string.h>
+#include <ESPAsyncWebServer.h>
+#include "espconfig.h"
+
+#define POLLING_PATH 	"/getline_p"
+#define PUTLINE_PATH	"/putline"
+#define CONTROL_CC_PATH	"/tcc"
+
+#ifdef ENABLE_LOGGING
+#define LOGGING_PATH	"/log"
+#endif
+
+#define CONFIG_PATH		"/config"
+#define TIME_PATH       "/time"
+#define RESETWIFI_PATH       "/erasewifisetting"
+
+#define FPUTS_PATH       "/fputs"
+#define FLIST_PATH       "/list"
+#define DELETE_PATH       "/rm"
+
+#define GETSTATUS_PATH "/getstatus"
+#define SNAPSHOT_PATH "/snapshot"
+
+// WEB_ROUTES(ROUTE) calls ROUTE(method,path,auth,handler) for each fixed
+// path. The includer defines ROUTE to make an entry of its table.
+#ifdef ENABLE_LOGGING
+#define LOGGING_ROUTES(ROUTE) \
+	ROUTE(HTTP_GET,  LOGGING_PATH,    false, handleGetLogging) \
+	ROUTE(HTTP_POST, LOGGING_PATH,    false, handleSetLogging)
+#else
+#define LOGGING_ROUTES(ROUTE)
+#endif
+
+#if EnableMetrics == true
+#define METRICS_ROUTES(ROUTE) \
+	ROUTE(HTTP_GET,  METRICS_PATH,    false, handleMetrics)
+#else
+#define METRICS_ROUTES(ROUTE)
+#endif
+
+#define WEB_ROUTES(ROUTE) \
+	ROUTE(HTTP_GET,  POLLING_PATH,    false, handlePolling) \
+	ROUTE(HTTP_POST, PUTLINE_PATH,    false, handlePutLine) \
+	ROUTE(HTTP_GET,  CONTROL_CC_PATH, false, handleControlConstant) \
+	ROUTE(HTTP_GET,  CONFIG_PATH,     true,  handleGetConfig) \
+	ROUTE(HTTP_POST, CONFIG_PATH,     true,  handleSetConfig) \
+	ROUTE(HTTP_GET,  TIME_PATH,       false, handleGetTime) \
+	ROUTE(HTTP_POST, TIME_PATH,       false, handleSetTime) \
+	ROUTE(HTTP_GET,  RESETWIFI_PATH,  true,  handleResetWiFi) \
+	ROUTE(HTTP_POST, FLIST_PATH,      true,  handleFileList) \
+	ROUTE(HTTP_DELETE, DELETE_PATH,   true,  handleFileDelete) \
+	ROUTE(HTTP_POST, FPUTS_PATH,      true,  handleFilePuts) \
+	ROUTE(HTTP_GET,  GETSTATUS_PATH,  false, handleGetStatus) \
+	ROUTE(HTTP_GET,  SNAPSHOT_PATH,   false, handleSnapshot) \
+	LOGGING_ROUTES(ROUTE) \
+	METRICS_ROUTES(ROUTE)
+
+template<typename Handler>
+struct WebRoute{
+	uint32_t hash;
+	uint8_t  method;
+	bool     auth;
+	Handler  handler;
+	const char *path;
+};
+
+// FNV-1a, also evaluated at compile time for the table
+constexpr uint32_t pathHash(const char *path,uint32_t hash=2166136261u){
+	return (*path)? pathHash(path+1,(hash ^ (uint8_t)*path) * 16777619u):hash;
+}
+
+inline uint32_t urlHash(const char *url){
+	uint32_t hash=2166136261u;
+	while(*url) hash = (hash ^ (uint8_t)*url++) * 16777619u;
+	return hash;
+}
+
+// a scan of the table that compares the hash and the method before the
+// path. NULL when the url is not a fixed path.
+template<typename Handler>
+const WebRoute<Handler>* findRoute(const WebRoute<Handler> *routes,uint8_t number,uint8_t method,const char *url){
+	uint32_t hash=urlHash(url);
+	for(uint8_t i=0;i< number;i++){
+		const WebRoute<Handler> *route= & routes[i];
+		if(route->hash == hash && route->method == method
+			&& strcmp(route->path,url) ==0) return route;
+	}
+	return NULL;
+}
+
+#endif
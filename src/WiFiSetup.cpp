@@ -6,6 +6,7 @@
 #include <FS.h>
 #include "espconfig.h"
 #include "WiFiSetup.h"
+#include "FileCache.h"
 
 #define IPConfigFileName "ip.cfg"
 
@@ -48,7 +49,7 @@ bool startSetupPortal(WiFiManager& wifiManager,const char* ssid,const char*pass)
   	bool connected= wifiManager.startConfigPortal(ssid,pass);
     if(connected){
         //SAVE configuration.
-        File fh= SPIFFS.open(IPConfigFileName, "w");
+        File fh= FileCache.openToWrite(IPConfigFileName);
         if(!fh){
             DBG_PRINTF("Error opening file!!\n");
     	    return connected;
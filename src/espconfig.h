@@ -43,6 +43,21 @@
 #define FILE_MANAGEMENT_PATH "/filemanager"
 #define SYSTEM_UPDATE_PATH "/systemupdate"
 
+// the BrewPi protocol over TCP, for brewpi-script. There is no authentication.
+#ifndef EnableBrewPiTcpServer
+#define EnableBrewPiTcpServer false
+#endif
+#define BREWPI_TCP_SERVER_PORT 23
+
+// latency probes, at /metrics and as the "metrics" SSE event.
+// When false, the probes are not compiled in.
+#ifndef EnableMetrics
+#define EnableMetrics false
+#endif
+#define METRICS_PATH "/metrics"
+// seconds between SSE reports
+#define MetricsReportPeriod 10
+
 // don't change this.
 #define MAX_PROFILE_LEN 1024
 #endif